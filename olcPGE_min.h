@@ -57,6 +57,27 @@ enum MouseButton  // JK
 };
 
 
+// -------------------------------------------
+
+enum PixelMode
+{
+	PIXEL_NORMAL,  // source pixels overwrite the target
+	PIXEL_MASK,    // only fully opaque source pixels are drawn
+	PIXEL_ALPHA,   // source pixels are blended over the target by their alpha
+	PIXEL_ADD      // source pixels, scaled by their alpha, are added to the target
+};
+
+
+// -------------------------------------------
+
+enum CaptureFormat
+{
+	CAPTURE_RAW,  // RGBA frames back to back
+	CAPTURE_Y4M,  // YUV4MPEG2, 4:4:4
+	CAPTURE_RLE   // per frame runs of unchanged and changed pixels, see PGE_captureStart
+};
+
+
 // -------------------------------------------
 
 struct _Pixel
@@ -70,18 +91,177 @@ struct _Pixel
 typedef struct _Pixel Pixel;
 
 
+// -------------------------------------------
+
+struct _Rect
+{
+	int32_t x;
+	int32_t y;
+	int32_t w;
+	int32_t h;
+};
+
+typedef struct _Rect Rect;
+
+
 // -------------------------------------------
 
 struct _Sprite
 {
 	int32_t width;
 	int32_t height;
+	int32_t nStride;    // pixels from one row to the next, width unless a view
 	Pixel*  pColData;
+	bool    bOwnsData;  // false when pColData is borrowed, e.g. mapped from a sprite pack
 };
 
 typedef struct _Sprite Sprite;
 
 
+/* A sprite compiled into runs of visible pixels per row,
+   see SpriteRLE_new
+*/
+typedef struct _SpriteRLE SpriteRLE;
+
+
+/* One bit per pixel of a sprite, for collision tests,
+   see SpriteMask_new
+*/
+typedef struct _SpriteMask SpriteMask;
+
+
+/* A set of sprites stored uncompressed in a single file, with each
+   pixel payload aligned to a page boundary. The file is memory mapped
+   and its sprites use the mapping in place as their pColData.
+*/
+typedef struct _SpritePack SpritePack;
+
+
+/* A sprite uploaded once to a GL texture and drawn by the GPU,
+   see Decal_new
+*/
+typedef struct _Decal Decal;
+
+
+/* Packs many small sprites into a few large pages, see Atlas_new
+*/
+typedef struct _Atlas Atlas;
+
+// Where a sprite added to an atlas ended up
+struct _AtlasEntry
+{
+	int32_t nPage;
+	int32_t x;       // top left within the page, in pixels
+	int32_t y;
+	int32_t width;
+	int32_t height;
+	float   u0;      // the same rectangle in texture coordinates
+	float   v0;
+	float   u1;
+	float   v1;
+};
+
+typedef struct _AtlasEntry AtlasEntry;
+
+
+/* A grid of tiles drawn from a tile sheet, see TileMap_new
+*/
+typedef struct _TileMap TileMap;
+
+
+/* A fixed capacity pool of single pixel particles, see Particles_new
+*/
+typedef struct _Particles Particles;
+
+
+/* Timing of a single asset load, see PGE_getLoadStat
+*/
+struct _LoadStat
+{
+	const char* sName;     // file path, or "pack:entry" for sprite pack entries
+	int32_t     width;
+	int32_t     height;
+	float       fSeconds;  // wall time spent loading
+};
+
+typedef struct _LoadStat LoadStat;
+
+
+/* Time and hardware event counts, see PGE_perfSample
+*/
+struct _PerfSample
+{
+	double   fSeconds;
+	uint64_t nCycles;
+	uint64_t nInstructions;
+	uint64_t nL1Misses;      // L1 data cache read misses
+	uint64_t nLLCMisses;     // last level cache read misses
+	uint64_t nBranchMisses;
+};
+
+typedef struct _PerfSample PerfSample;
+
+
+/* Totals for one engine frame phase, see PGE_benchStart
+*/
+struct _PhaseStat
+{
+	const char* sName;
+	uint32_t    nCalls;
+	PerfSample  total;
+};
+
+typedef struct _PhaseStat PhaseStat;
+
+
+/* Starts each shared framebuffer mapping, see PGE_shareFramebuffer.
+   Pixels follow at nHeaderSize bytes in, rows top first.
+*/
+#define PGE_SHARED_FRAME_MAGIC 0x46454750  // "PGEF"
+#define PGE_SHARED_FRAME_RGBA8 0           // bytes r, g, b, a
+
+struct _SharedFrameHeader
+{
+	uint32_t nMagic;
+	uint32_t nVersion;
+	uint32_t nHeaderSize;
+	uint32_t nFormat;
+	uint32_t nWidth;
+	uint32_t nHeight;
+	uint32_t nStride;    // bytes per row
+	int32_t  nOriginX;   // scroll origin, see PGE_setScrollRing
+	int32_t  nOriginY;
+	uint32_t nSeq;       // odd while a frame is being drawn
+	uint64_t nFrame;     // frames completed
+};
+
+typedef struct _SharedFrameHeader SharedFrameHeader;
+
+
+/* Where startup time went, in seconds, see PGE_getStartupProfile.
+   Steps a platform does not have are left at zero.
+*/
+struct _StartupProfile
+{
+	float fDisplayOpen;    // connecting to the display, or registering the window class
+	float fVisualSelect;   // choosing the framebuffer config or pixel format
+	float fWindowMap;      // creating and mapping the window
+	float fContextCreate;  // creating the GL context and making it current
+	float fFirstSwap;      // the first buffer swap
+	float fTotal;          // PGE_start to the first frame shown
+};
+
+typedef struct _StartupProfile StartupProfile;
+
+
+
+// -------------------------------------------
+
+/* Owns all state of one engine instance, see PGE_createContext
+*/
+typedef struct _PGE_Context PGE_Context;
+
+
 
 // -------------------------------------------
 
@@ -111,6 +291,39 @@ enum rcode PGE_construct ( uint32_t screen_w, uint32_t screen_h,
 enum rcode PGE_start     ( void );
 enum rcode PGE_destroy   ( void );  // JK, cleanup
 
+// No window or OpenGL, frames are only simulated. Call before PGE_start
+void PGE_setHeadless ( bool headless );
+
+/* Builds for one resolution can define PGE_SCREEN_W and PGE_SCREEN_H,
+   and optionally PGE_PIXEL_W and PGE_PIXEL_H, for both the library and
+   its callers. The engine then treats them as constants, and
+   PGE_construct returns FAIL for any other size.
+*/
+
+
+// Contexts
+/* Every function acts on the calling thread's current context. Threads
+   start out on a shared default context; make a context of their own
+   current to run independent engines side by side.
+*/
+PGE_Context* PGE_createContext      ( void );
+void         PGE_destroyContext     ( PGE_Context* ctx );  // after PGE_destroy
+void         PGE_makeContextCurrent ( PGE_Context* ctx );  // NULL for the default context
+PGE_Context* PGE_getCurrentContext  ( void );
+void         PGE_setUserData        ( void* p );  // per context, e.g. for the UI_ callbacks
+void*        PGE_getUserData        ( void );
+
+
+// Fixed timestep
+/* onSimulate is called at a fixed fHz, zero or more times per frame,
+   before UI_onUserUpdate renders. At most nMaxSteps run per frame and
+   any further backlog is dropped, so a slow simulation cannot spiral.
+   Returning false ends the application. A NULL callback, or fHz of 0,
+   returns to a single UI_onUserUpdate per frame.
+*/
+void  PGE_setFixedTimestep      ( float fHz, int32_t nMaxSteps, bool ( *onSimulate ) ( float fStep ) );
+float PGE_getInterpolationAlpha ( void );  // 0 to 1, progress towards the next step
+
 
 // User input
 HWButton PGE_getKey    ( enum Key k );
@@ -121,6 +334,7 @@ int32_t  PGE_getMouseY ( void );
 
 
 // Environment
+float   PGE_getElapsedTime  ( void );  // seconds since the previous frame
 int32_t PGE_getScreenWidth  ( void );
 int32_t PGE_getScreenHeight ( void );
 
@@ -129,8 +343,443 @@ Sprite* PGE_getDrawTarget       ( void );
 int32_t PGE_getDrawTargetWidth  ( void );
 int32_t PGE_getDrawTargetHeight ( void );
 
+/* Clipping. PGE_pushClip narrows drawing to the rectangle's overlap
+   with the current clip, and PGE_popClip restores the one before it.
+   The sprite, tile map and particle draws, PGE_drawRGB and
+   PGE_clearRGB clip once per call rather than per pixel, and return
+   early when nothing is left. Each draw target keeps its own stack:
+   switching to another target and back leaves it as it was, and a
+   target nothing was pushed on is unclipped. Decals and PGE_scroll
+   are not clipped.
+*/
+void PGE_pushClip ( int32_t x, int32_t y, int32_t w, int32_t h );
+void PGE_popClip  ( void );
+Rect PGE_getClip  ( void );
+
 
 // Drawing
-void PGE_clearRGB ( uint8_t r, uint8_t g, uint8_t b );
+void PGE_clearRGB ( uint8_t r, uint8_t g, uint8_t b );  // opaque
+void PGE_clear    ( Pixel p );  // alpha included, e.g. fully transparent for layer 0
 bool PGE_drawRGB  ( int32_t x, int32_t y, uint8_t r, uint8_t g, uint8_t b );
 // bool PGE_draw    ( int32_t x, int32_t y, Pixel* p );
+
+/* Replaces the 4-connected region of pixels exactly matching the one
+   at ( x, y ), alpha included, with col, within the clip. Works a
+   horizontal span at a time from a heap allocated stack, so large
+   regions cost neither recursion nor a pixel per stack entry.
+*/
+void PGE_floodFill ( int32_t x, int32_t y, Pixel col );
+
+void           PGE_setPixelMode ( enum PixelMode mode );  // how sprites are drawn, PIXEL_NORMAL by default
+enum PixelMode PGE_getPixelMode ( void );
+
+/* Draws a sprite through an affine transform m, which maps sprite
+   coordinates to draw target coordinates:
+
+     x' = m[ 0 ] * x + m[ 1 ] * y + m[ 2 ]
+     y' = m[ 3 ] * x + m[ 4 ] * y + m[ 5 ]
+
+   So { 2, 0, 10,  0, 2, 20 } draws at double size with the sprite's
+   top left at ( 10, 20 ). Pixels are sampled at their centres, nearest
+   or bilinear, and drawn in the current pixel mode.
+*/
+void PGE_drawSpriteTransformed ( Sprite* sp, const float m [ 6 ], bool bBilinear );
+
+// Draws the w x h rectangle of sp at ( ox, oy ) with its top left at ( x, y ), in the current pixel mode
+void PGE_drawSprite        ( int32_t x, int32_t y, Sprite* sp );
+void PGE_drawPartialSprite ( int32_t x, int32_t y, Sprite* sp, int32_t ox, int32_t oy, int32_t w, int32_t h );
+
+/* Run length encoded sprites. Each row is compiled into runs of fully
+   opaque or partly transparent pixels, with fully transparent ones
+   left out, so drawing costs about the visible pixels rather than the
+   bounding box. Opaque runs are copied with memcpy, the gaps between
+   runs are jumped, and clipping trims whole runs. Drawing follows the
+   current pixel mode, except that transparent pixels are skipped in
+   PIXEL_NORMAL too. The sprite's pixels are copied, so later changes
+   to it need a new SpriteRLE.
+*/
+SpriteRLE* SpriteRLE_new  ( Sprite* sp );
+void       SpriteRLE_free ( SpriteRLE* rle );
+
+void PGE_drawSpriteRLE ( int32_t x, int32_t y, SpriteRLE* rle );
+
+
+// Collision masks
+/* A mask holds a bit per pixel, set where the sprite's alpha is at
+   least nAlphaMin, packed 64 pixels to a word along each row, and the
+   bounding box of the set bits. SpriteMask_overlap tells whether two
+   masks placed with their top lefts at ( ax, ay ) and ( bx, by ) share
+   a set pixel. Boxes that do not meet return at once; otherwise each
+   overlapping row costs a shift, an OR and an AND per 64 pixels.
+*/
+SpriteMask* SpriteMask_new     ( Sprite* sp, uint8_t nAlphaMin );
+void        SpriteMask_free    ( SpriteMask* m );
+bool        SpriteMask_get     ( const SpriteMask* m, int32_t x, int32_t y );  // false outside the mask
+bool        SpriteMask_overlap ( const SpriteMask* a, int32_t ax, int32_t ay, const SpriteMask* b, int32_t bx, int32_t by );
+
+
+// Scrolling
+/* PGE_scroll moves the draw target's contents by ( dx, dy ) and
+   returns how many rectangles were exposed, filling pExposed if given,
+   which needs room for PGE_MAX_EXPOSED. Only those need redrawing.
+
+   In ring mode the default draw target is never copied. Instead the
+   scroll origin, the target position shown at the screen's top left,
+   moves and wraps, and the screen is presented from there. Exposed
+   rectangles are then in target coordinates, already wrapped, and
+   everything drawn must be too: screen ( x, y ) is target
+   ( ( x + ox ) % w, ( y + oy ) % h ) for origin ( ox, oy ). Leaving
+   ring mode moves the pixels back so the origin is ( 0, 0 ) again, and
+   fails, staying in ring mode, if there is no memory to do so. Asking
+   for the mode already set changes nothing.
+   Capture records the target as stored, not as shown.
+*/
+#define PGE_MAX_EXPOSED 6
+
+int32_t    PGE_scroll          ( int32_t dx, int32_t dy, Rect* pExposed );
+enum rcode PGE_setScrollRing   ( bool b );
+void       PGE_getScrollOrigin ( int32_t* ox, int32_t* oy );
+
+
+// Layers
+/* Layer 0 is the default draw target and is drawn on top, layers with
+   higher indices are drawn behind it. A layer's texture is only
+   re-uploaded when the layer has been marked dirty.
+
+   Layers are blended by their alpha, and layer 0 starts opaque, as
+   PGE_clearRGB leaves it. To see the layers behind, clear layer 0 with
+   PGE_clear( ( Pixel ) { 0, 0, 0, 0 } ) instead, and draw over that.
+*/
+int32_t PGE_createLayer        ( void );  // new, fully transparent layer
+void    PGE_enableLayer        ( int32_t layer, bool b );
+void    PGE_setDrawTargetLayer ( int32_t layer );  // also marks the layer dirty
+void    PGE_setLayerDirty      ( int32_t layer );
+Sprite* PGE_getLayerSprite     ( int32_t layer );
+int32_t PGE_getLayerCount      ( void );
+
+
+// Decals
+/* Decals are drawn over all layers, in the order they were drawn.
+   Their quads are batched up over the frame and drawn with one call
+   per run of quads sharing a texture. Create, update and free decals
+   on the engine thread, e.g. from UI_onUserCreate. Positions are in
+   screen pixels.
+*/
+Decal* Decal_new    ( Sprite* sp );  // sp must outlive the decal
+void   Decal_update ( Decal* d );    // re-uploads the sprite after it changed
+void   Decal_free   ( Decal* d );
+
+void PGE_drawDecal            ( float x, float y, Decal* d, float fScaleX, float fScaleY, Pixel tint );
+void PGE_drawPartialDecal     ( float x, float y, Decal* d, float sx, float sy, float sw, float sh, float fScaleX, float fScaleY, Pixel tint );
+void PGE_drawDecalTransformed ( Decal* d, const float m [ 6 ], Pixel tint );  // m as for PGE_drawSpriteTransformed
+
+
+// Atlases
+/* Sprites are copied into pages of a fixed size by a skyline packer,
+   with nPadding transparent pixels between them, and are then referred
+   to by the handle Atlas_add returns. Drawing from an atlas reads one
+   page's memory on the CPU, or binds one page texture on the GPU, for
+   any number of its sprites. Atlas_addMany packs better than adding
+   one at a time, as it places the tallest sprites first.
+*/
+Atlas*            Atlas_new          ( int32_t nPageWidth, int32_t nPageHeight, int32_t nPadding );
+void              Atlas_free         ( Atlas* at );
+int32_t           Atlas_add          ( Atlas* at, Sprite* sp );  // handle, or -1 if sp cannot fit a page
+bool              Atlas_addMany      ( Atlas* at, Sprite** sprites, int32_t count, int32_t* handles );
+const AtlasEntry* Atlas_getEntry     ( Atlas* at, int32_t handle );
+int32_t           Atlas_getPageCount ( Atlas* at );
+Sprite*           Atlas_getPage      ( Atlas* at, int32_t page );
+Decal*            Atlas_getDecal     ( Atlas* at, int32_t page );  // engine thread only, re-uploaded if sprites were added
+
+void PGE_drawAtlasSprite ( int32_t x, int32_t y, Atlas* at, int32_t handle );
+void PGE_drawAtlasDecal  ( float x, float y, Atlas* at, int32_t handle, float fScaleX, float fScaleY, Pixel tint );
+
+
+// Tile maps
+/* Tile i is the i-th tile of the sheet, counting along its rows, and
+   tile -1 is empty. The map is split into chunks of 16 x 16 tiles,
+   each pre-rendered into its own sprite the first time it is seen and
+   again only after one of its tiles changes. Drawing blits the chunks
+   that overlap the draw target, so it costs about one screenful of
+   pixel copies however large the map.
+*/
+TileMap* TileMap_new     ( int32_t w, int32_t h, int32_t nTileWidth, int32_t nTileHeight, Sprite* pTileSheet );  // all tiles empty
+void     TileMap_free    ( TileMap* tm );
+void     TileMap_setTile ( TileMap* tm, int32_t x, int32_t y, int32_t tile );
+int32_t  TileMap_getTile ( TileMap* tm, int32_t x, int32_t y );  // -1 outside the map
+void     TileMap_refresh ( TileMap* tm );  // re-renders every chunk, after the tile sheet changed
+
+/* Map pixel ( nScrollX, nScrollY ) lands on the draw target's top left.
+   Empty tiles leave the target untouched. Other tiles are drawn in the
+   current pixel mode, so PIXEL_NORMAL copies them as they are.
+*/
+void PGE_drawTileMap ( TileMap* tm, int32_t nScrollX, int32_t nScrollY );
+
+
+// Particles
+/* Particles move in a straight line under constant acceleration until
+   their life runs out, and are then removed, by moving the last live
+   particle into their slot. Storage is allocated once, up front, as
+   separate arrays per field so updates run four particles at a time.
+   Drawing plots one pixel per particle in the current pixel mode,
+   PIXEL_ADD and PIXEL_ALPHA being the usual choices.
+*/
+Particles* Particles_new      ( int32_t nCapacity );
+void       Particles_free     ( Particles* ps );
+bool       Particles_emit     ( Particles* ps, float x, float y, float vx, float vy, float fLife, Pixel col );  // false when full
+void       Particles_update   ( Particles* ps, float fElapsedTime, float ax, float ay );
+int32_t    Particles_getCount ( Particles* ps );
+void       Particles_clear    ( Particles* ps );
+
+void PGE_drawParticles ( Particles* ps );
+
+
+// Capture
+/* Presented frames are copied into a ring of nBuffers preallocated
+   frames and written out by a background thread. When the ring is
+   full the frame is dropped, and counted, rather than waiting.
+   nFps is the rate frames are presented at, written to Y4M headers so
+   players run at the right speed.
+*/
+enum rcode PGE_captureStart         ( const char* sFile, enum CaptureFormat format, int32_t nBuffers, int32_t nFps );
+void       PGE_captureStop          ( void );  // writes out queued frames first
+uint32_t   PGE_getCaptureFrameCount ( void );
+uint32_t   PGE_getCaptureDropCount  ( void );
+
+
+// Shared framebuffer
+/* PGE_shareFramebuffer moves the default draw target into shared
+   memory, for other processes to map read only and take frames from
+   without copies. sName names a POSIX shm object, e.g. "/pge-frame",
+   or on Windows a file mapping; NULL makes an anonymous memfd on
+   Linux, passed to readers by its fd. Call after PGE_construct; the
+   mapping is removed by PGE_destroy.
+
+   Readers use the header's nSeq as a seqlock. It is odd while a frame
+   is being drawn, and from the share until the first frame is done,
+   and changes with every frame:
+
+       do
+       {
+           s = atomic_load_explicit( &nSeq, memory_order_acquire );
+           ...copy the pixels...
+           atomic_thread_fence( memory_order_acquire );
+       }
+       while ( ( s & 1 ) || atomic_load_explicit( &nSeq, memory_order_relaxed ) != s );
+
+   The fence keeps the pixel reads from moving past the second load.
+*/
+enum rcode PGE_shareFramebuffer       ( const char* sName );
+int        PGE_getSharedFramebufferFd ( void );  // -1 unless an anonymous memfd
+
+
+// Record and replay
+/* A recording logs each frame's elapsed time and input state. Replay
+   feeds a log back in place of window input, elapsed time included,
+   and ends the run after its last frame.
+*/
+enum rcode PGE_recordStart ( const char* sFile );
+enum rcode PGE_recordStop  ( void );  // writes the log out
+enum rcode PGE_replayStart ( const char* sFile );
+bool       PGE_isReplaying ( void );
+
+
+// Tracing
+/* Build both the engine and the application with PGE_TRACE defined to
+   record engine frame phases and user scopes to a Chrome trace JSON
+   file. Without it these compile to nothing. Scope names are stored by
+   pointer, so pass string literals. Scopes on other threads, load
+   callbacks included, must be finished before PGE_traceStop.
+   A trace covers the whole process, every context included, so only
+   one can run at a time. PGE_traceStart fails while another is running.
+*/
+#ifdef PGE_TRACE
+
+	enum rcode PGE_traceStart ( const char* sFile );
+	void       PGE_traceStop  ( void );
+	void       PGE_traceBegin ( const char* sName );
+	void       PGE_traceEnd   ( void );
+
+#else
+
+	#define PGE_traceStart( sFile ) ( FAIL )
+	#define PGE_traceStop()         ( ( void ) 0 )
+	#define PGE_traceBegin( sName ) ( ( void ) 0 )
+	#define PGE_traceEnd()          ( ( void ) 0 )
+
+#endif
+
+
+// CPU kernels
+/* The pixel kernels, "fill", "blit", "blend", "add", "expand",
+   "scale", "nearest" and "bilinear", each come in "scalar", "sse2",
+   "avx2" and "avx512" variants, or the best of those below where a
+   level has nothing to add, picked for the CPU by the first
+   PGE_construct. "nearest" and "bilinear" sample rotated sprites.
+   PGE_KERNELS in the environment caps the pick for comparison, e.g.
+   "sse2" for every kernel, or "sse2,blend=scalar". A variant the CPU
+   lacks is never used.
+*/
+int32_t     PGE_getKernelCount   ( void );
+const char* PGE_getKernelName    ( int32_t i );
+const char* PGE_getKernelVariant ( int32_t i );  // in use
+
+
+// Hardware counters
+/* Counters come from perf_event_open on Linux and count the calling
+   thread in user space. Where they cannot be opened, on other
+   platforms, under a strict perf_event_paranoid or in a VM without a
+   PMU, PGE_perfOpen returns FAIL and samples hold the time alone.
+   Events a CPU does not have read as zero.
+*/
+enum rcode PGE_perfOpen    ( void );
+void       PGE_perfClose   ( void );
+bool       PGE_perfIsOpen  ( void );
+void       PGE_perfSample  ( PerfSample* s );  // totals so far
+void       PGE_perfElapsed ( const PerfSample* pStart, PerfSample* pOut );  // totals since pStart
+
+/* Benchmark mode totals each frame phase: events, input, loads,
+   simulate, update, capture, upload, decals and swap. Counters are
+   included when open.
+*/
+void             PGE_benchStart        ( void );  // starts from zero
+void             PGE_benchStop         ( void );
+int32_t          PGE_getPhaseStatCount ( void );
+const PhaseStat* PGE_getPhaseStat      ( int32_t i );
+
+
+// Sprites
+Sprite*    Sprite_new          ( int32_t w, int32_t h );
+Sprite*    Sprite_newFromFile  ( const char* sImageFile );  // NULL on failure
+enum rcode Sprite_loadFromFile ( Sprite* sp, const char* sImageFile );  // BMP, PNG or QOI
+void       Sprite_free         ( Sprite* sp );
+
+/* A view is a sprite over a rectangle of its parent's pixels, shared
+   rather than copied, for sprite sheet frames or split screen
+   viewports. The rectangle is clipped to the parent, and views of
+   views are allowed. Views work as draw targets and with every draw
+   and blit; free them with Sprite_free before the parent.
+*/
+Sprite*    Sprite_newView      ( Sprite* parent, int32_t x, int32_t y, int32_t w, int32_t h );  // NULL when empty
+
+/* Sprites returned by a pack are owned by it,
+   and remain valid until SpritePack_free
+*/
+SpritePack* SpritePack_load      ( const char* sPackFile );
+void        SpritePack_free      ( SpritePack* pack );
+int32_t     SpritePack_getCount  ( SpritePack* pack );
+Sprite*     SpritePack_getSprite ( SpritePack* pack, int32_t i );
+Sprite*     SpritePack_find      ( SpritePack* pack, const char* sName );
+enum rcode  SpritePack_save      ( const char* sPackFile, Sprite** sprites, const char** names, int32_t count );
+
+/* Background loading. Load functions run on a pool of loader threads;
+   completion callbacks run on the engine thread at the start of a
+   frame. Submit from UI_onUserCreate and return straight away, and the
+   frame loop can show a loading screen while assets arrive.
+   Unfinished jobs are discarded by PGE_destroy without a callback.
+*/
+void    PGE_loadAsync           ( bool ( *onLoad ) ( void* pUser ), void ( *onDone ) ( void* pUser, bool bOk ), void* pUser );
+void    PGE_loadSpriteAsync     ( const char* sImageFile, void ( *onLoaded ) ( Sprite* sp, void* pUser ), void* pUser );  // sp is NULL on failure
+int32_t PGE_getLoadsPending     ( void );  // submitted jobs whose callbacks have not run yet
+float   PGE_getTimeToFirstFrame ( void );  // seconds from PGE_start to the first frame shown
+
+// Every load is recorded, oldest first
+int32_t         PGE_getLoadStatCount ( void );
+const LoadStat* PGE_getLoadStat      ( int32_t i );
+void            PGE_clearLoadStats   ( void );
+
+// Filled in as the engine starts, complete once the first frame is shown
+const StartupProfile* PGE_getStartupProfile ( void );
+
+
+// -------------------------------------------
+
+/* Inline fast path.
+   Define PGE_INLINE before including this header to have the draw
+   target accessors and PGE_drawRGB defined inline here, rather than
+   called in the library. Loops drawing pixels can then be inlined,
+   have their bounds checks hoisted and be vectorised. The library is
+   built out of line either way, so translation units with and without
+   PGE_INLINE mix freely.
+*/
+#ifdef PGE_INLINE
+
+	#ifdef _WIN32
+
+		#define PGE_INLINE_THREAD_LOCAL __declspec( thread )
+
+	#else
+
+		#define PGE_INLINE_THREAD_LOCAL __thread
+
+	#endif
+
+	/* The calling thread's current draw target and clip, kept up to date
+	   by the library. NULL while the default target awaits its first
+	   fill, or on a thread that has neither made a context current nor
+	   set or got a draw target. The calls below then go to the library.
+	*/
+	extern PGE_INLINE_THREAD_LOCAL Sprite* pgeDrawTarget;
+	extern PGE_INLINE_THREAD_LOCAL Rect    pgeClip;
+
+	static inline Sprite* PGE_inlineGetDrawTarget ( void )
+	{
+		return pgeDrawTarget ? pgeDrawTarget : PGE_getDrawTarget();
+	}
+
+	static inline int32_t PGE_inlineGetDrawTargetWidth ( void )
+	{
+		return pgeDrawTarget ? pgeDrawTarget->width : PGE_getDrawTargetWidth();
+	}
+
+	static inline int32_t PGE_inlineGetDrawTargetHeight ( void )
+	{
+		return pgeDrawTarget ? pgeDrawTarget->height : PGE_getDrawTargetHeight();
+	}
+
+	static inline bool PGE_inlineDrawRGB ( int32_t x, int32_t y, uint8_t r, uint8_t g, uint8_t b )
+	{
+		Sprite* sp;
+		Pixel*  p;
+
+		sp = pgeDrawTarget;
+
+		if ( ! sp )
+		{
+			return PGE_drawRGB( x, y, r, g, b );
+		}
+
+		/* Negative offsets wrap to large unsigned ones, one compare each.
+		   The clip lies within the target, and is empty without one.
+		*/
+		if ( ( uint32_t ) ( x - pgeClip.x ) >= ( uint32_t ) pgeClip.w || ( uint32_t ) ( y - pgeClip.y ) >= ( uint32_t ) pgeClip.h )
+		{
+			return false;
+		}
+
+		p = sp->pColData + ( y * sp->nStride + x );
+
+		p->r = r;
+		p->g = g;
+		p->b = b;
+		p->a = 255;
+
+		return true;
+	}
+
+	// Function-like, so &PGE_drawRGB still names the library's function
+	#define PGE_getDrawTarget()       PGE_inlineGetDrawTarget()
+	#define PGE_getDrawTargetWidth()  PGE_inlineGetDrawTargetWidth()
+	#define PGE_getDrawTargetHeight() PGE_inlineGetDrawTargetHeight()
+
+	#define PGE_drawRGB( x, y, r, g, b ) PGE_inlineDrawRGB( x, y, r, g, b )
+
+	#ifdef PGE_SCREEN_W
+		#define PGE_getScreenWidth() ( ( int32_t ) PGE_SCREEN_W )
+	#endif
+
+	#ifdef PGE_SCREEN_H
+		#define PGE_getScreenHeight() ( ( int32_t ) PGE_SCREEN_H )
+	#endif
+
+#endif
@@ -34,6 +34,26 @@
 	#include <X11/X.h>
 	#include <X11/Xlib.h>
 
+	// Background threads
+	#include <pthread.h>
+
+	// Sprite packs, timing
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <time.h>
+	#include <unistd.h>
+
+	// Hardware counters, shared frames
+	#ifdef __linux__
+
+		#include <linux/memfd.h>
+		#include <linux/perf_event.h>
+		#include <sys/ioctl.h>
+		#include <sys/syscall.h>
+
+	#endif
+
 #endif
 
 #include <stdbool.h>
@@ -42,551 +62,9073 @@
 #include <stdio.h>
 #include <string.h>  // strdup
 
+// Vector kernels, SSE2 is part of every x86-64 target
+#if defined( __SSE2__ ) || defined( _M_X64 )
+
+	#define PGE_SSE2
+	#include <emmintrin.h>
+
+#endif
+
+/* AVX2 and AVX-512 kernels are built alongside, for use where the CPU
+   has them, given a compiler that can target them function by function
+*/
+#if defined( PGE_SSE2 ) && ( defined( __GNUC__ ) || defined( _MSC_VER ) )
+
+	#define PGE_AVX
+	#include <immintrin.h>
+
+	#ifdef _MSC_VER
+
+		#include <intrin.h>  // __cpuid
+
+		#define PGE_TARGET_AVX2
+		#define PGE_TARGET_AVX512
+
+	#else
+
+		#define PGE_TARGET_AVX2   __attribute__(( target( "avx2" ) ))
+		#define PGE_TARGET_AVX512 __attribute__(( target( "avx2,avx512f,avx512bw" ) ))
+
+	#endif
+
+#endif
+
+// The library is always built out of line, see PGE_INLINE
+#undef PGE_INLINE
+
 #include "olcPGE_min.h"
 
 
 //================================================================================
 
-static char* appTitle;
+// Threading primitives, for the engine's background workers
+
+#ifdef _WIN32
+
+	typedef CRITICAL_SECTION   PGE_Mutex;
+	typedef CONDITION_VARIABLE PGE_Cond;
+	typedef HANDLE             PGE_Thread;
+
+	static void Mutex_init      ( PGE_Mutex* m ) { InitializeCriticalSection( m ); }
+	static void Mutex_destroy   ( PGE_Mutex* m ) { DeleteCriticalSection( m ); }
+	static void Mutex_lock      ( PGE_Mutex* m ) { EnterCriticalSection( m ); }
+	static void Mutex_unlock    ( PGE_Mutex* m ) { LeaveCriticalSection( m ); }
+	static void Cond_init       ( PGE_Cond* c )  { InitializeConditionVariable( c ); }
+	static void Cond_destroy    ( PGE_Cond* c )  { }
+	static void Cond_signal     ( PGE_Cond* c )  { WakeConditionVariable( c ); }
+	static void Cond_broadcast  ( PGE_Cond* c )  { WakeAllConditionVariable( c ); }
+	static void Cond_wait       ( PGE_Cond* c, PGE_Mutex* m ) { SleepConditionVariableCS( c, m, INFINITE ); }
+
+	static bool Thread_create ( PGE_Thread* t, LPTHREAD_START_ROUTINE fn, void* arg )
+	{
+		*t = CreateThread( NULL, 0, fn, arg, 0, NULL );
+
+		return *t != NULL;
+	}
+
+	static void Thread_join ( PGE_Thread t )
+	{
+		WaitForSingleObject( t, INFINITE );
+		CloseHandle( t );
+	}
+
+	#define PGE_THREAD_FUNC( name ) DWORD WINAPI name ( LPVOID arg )
+	#define PGE_THREAD_RETURN       return 0
+
+	// 32 bit loads acquire, stores release, and CAS is true when *p was e and is now v
+	#define PGE_ATOMIC_LOAD( p )       ( ( uint32_t ) InterlockedCompareExchange( ( volatile LONG* ) ( p ), 0, 0 ) )
+	#define PGE_ATOMIC_STORE( p, v )   InterlockedExchange( ( volatile LONG* ) ( p ), ( LONG ) ( v ) )
+	#define PGE_ATOMIC_CAS( p, e, v )  ( InterlockedCompareExchange( ( volatile LONG* ) ( p ), ( LONG ) ( v ), ( LONG ) ( e ) ) == ( LONG ) ( e ) )
+	#define PGE_ATOMIC_FENCE()         MemoryBarrier()
+
+	#define PGE_SLEEP_MS( ms ) Sleep( ms )
 
-static Sprite* pDefaultDrawTarget = NULL;
-static Sprite* pDrawTarget        = NULL;
+#else
+
+	typedef pthread_mutex_t PGE_Mutex;
+	typedef pthread_cond_t  PGE_Cond;
+	typedef pthread_t       PGE_Thread;
+
+	static void Mutex_init      ( PGE_Mutex* m ) { pthread_mutex_init( m, NULL ); }
+	static void Mutex_destroy   ( PGE_Mutex* m ) { pthread_mutex_destroy( m ); }
+	static void Mutex_lock      ( PGE_Mutex* m ) { pthread_mutex_lock( m ); }
+	static void Mutex_unlock    ( PGE_Mutex* m ) { pthread_mutex_unlock( m ); }
+	static void Cond_init       ( PGE_Cond* c )  { pthread_cond_init( c, NULL ); }
+	static void Cond_destroy    ( PGE_Cond* c )  { pthread_cond_destroy( c ); }
+	static void Cond_signal     ( PGE_Cond* c )  { pthread_cond_signal( c ); }
+	static void Cond_broadcast  ( PGE_Cond* c )  { pthread_cond_broadcast( c ); }
+	static void Cond_wait       ( PGE_Cond* c, PGE_Mutex* m ) { pthread_cond_wait( c, m ); }
+
+	static bool Thread_create ( PGE_Thread* t, void* ( *fn ) ( void* ), void* arg )
+	{
+		return pthread_create( t, NULL, fn, arg ) == 0;
+	}
 
-static uint32_t nScreenWidth  = 256;
-static uint32_t nScreenHeight = 240;
-static uint32_t nPixelWidth   = 4;
-static uint32_t nPixelHeight  = 4;
+	static void Thread_join ( PGE_Thread t )
+	{
+		pthread_join( t, NULL );
+	}
 
-static int32_t nWindowWidth  = 0;
-static int32_t nWindowHeight = 0;
-static int32_t nViewX        = 0;
-static int32_t nViewY        = 0;
-static int32_t nViewW        = 0;
-static int32_t nViewH        = 0;
+	#define PGE_THREAD_FUNC( name ) void* name ( void* arg )
+	#define PGE_THREAD_RETURN       return NULL
 
-static int32_t nMousePosX      = 0;
-static int32_t nMousePosY      = 0;
-static int32_t nMousePosXCache = 0;
-static int32_t nMousePosYCache = 0;
+	// 32 bit loads acquire, stores release, and CAS is true when *p was e and is now v
+	#define PGE_ATOMIC_LOAD( p )       __atomic_load_n( ( p ), __ATOMIC_ACQUIRE )
+	#define PGE_ATOMIC_STORE( p, v )   __atomic_store_n( ( p ), ( v ), __ATOMIC_RELEASE )
+	#define PGE_ATOMIC_CAS( p, e, v )  __sync_bool_compare_and_swap( ( p ), ( e ), ( v ) )
+	#define PGE_ATOMIC_FENCE()         __atomic_thread_fence( __ATOMIC_SEQ_CST )
 
-static bool     pMouseNewState [ 5 ] = { 0 };
-static bool     pMouseOldState [ 5 ] = { 0 };
-static HWButton pMouseState    [ 5 ] = { { 0 } };
+	#define PGE_SLEEP_MS( ms ) usleep( ( ms ) * 1000 )
 
-static bool     pKeyNewState   [ 256 ] = { 0 };
-static bool     pKeyOldState   [ 256 ] = { 0 };
-static HWButton pKeyboardState [ 256 ] = { { 0 } };
+#endif
 
-static bool bHasInputFocus = false;
 
-static GLuint glBuffer;
+//================================================================================
 
-static bool bAtomActive = false;  // JK, not yet implemented as atomic
+/* Engine state.
+   Everything an engine instance owns lives in a context. Each thread
+   works on its own current context, the default one unless another
+   has been made current, so engines on different threads share nothing.
+*/
 
 #ifdef _WIN32
 
-	static HDC   glDeviceContext = NULL;
-	static HGLRC glRenderContext = NULL;
+	#define PGE_THREAD_LOCAL __declspec( thread )
 
-	static HWND   olc_hWnd = NULL;
-	static LPVOID sge      = NULL;
+#else
 
-	static LRESULT CALLBACK olc_WindowEvent  ( HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam );
-	static HWND             PGE_windowCreate ( void );
+	#define PGE_THREAD_LOCAL __thread
+
+#endif
+
+// A clip stack left on a target when another was made current
+struct _ClipState
+{
+	Sprite* pTarget;
+	Rect    clip;
+	Rect*   pClips;
+	int32_t nClips;
+	int32_t nClipCap;
+};
+
+typedef struct _ClipState ClipState;
+
+struct _PGE_Context
+{
+	char* appTitle;
+	void* pUserData;
+
+	Sprite* pDefaultDrawTarget;
+	Sprite* pDrawTarget;
+
+	// Clip rectangle, always within the draw target, and those pushed before it
+	Rect    clip;
+	Rect*   pClips;
+	int32_t nClips;
+	int32_t nClipCap;
+
+	// Stacks of the other targets that have clips pushed
+	ClipState* pClipStates;
+	int32_t    nClipStates;
+	int32_t    nClipStateCap;
+
+	enum PixelMode pixelMode;
+
+	bool    bScrollRing;
+	int32_t nScrollOriginX;
+	int32_t nScrollOriginY;
+
+	uint32_t nScreenWidth;
+	uint32_t nScreenHeight;
+	uint32_t nPixelWidth;
+	uint32_t nPixelHeight;
+
+	int32_t nWindowWidth;
+	int32_t nWindowHeight;
+	int32_t nViewX;
+	int32_t nViewY;
+	int32_t nViewW;
+	int32_t nViewH;
+
+	int32_t nMousePosX;
+	int32_t nMousePosY;
+	int32_t nMousePosXCache;
+	int32_t nMousePosYCache;
+
+	bool     pMouseNewState [ 5 ];
+	bool     pMouseOldState [ 5 ];
+	HWButton pMouseState    [ 5 ];
 
+	bool     pKeyNewState   [ 256 ];
+	bool     pKeyOldState   [ 256 ];
+	HWButton pKeyboardState [ 256 ];
+
+	bool bHasInputFocus;
+
+	float  fElapsedTime;
+	double tFrameStart;
+
+	bool ( *pfnSimulate ) ( float fStep );  // fixed timestep mode when set
+	float   fStep;
+	int32_t nMaxSteps;
+	double  fAccumulator;
+	float   fAlpha;
+
+	bool bHeadless;
+
+	GLuint glBuffer;
+
+	bool bAtomActive;  // JK, not yet implemented as atomic
+
+	struct _LoadStat** ppLoadStats;
+	int32_t            nLoadStats;
+	int32_t            nLoadStatsCap;
+	PGE_Mutex          statsMutex;       // guards the load statistics, see PGE_lockLoadStats
+	uint32_t           nStatsMutexState; // 0 before statsMutex is made, 1 while, 2 after
+
+	struct _Loader* pLoader;
+	double          tStart;
+	StartupProfile  startup;
+
+	bool bTargetInitPending;  // default target pixels not yet initialised
+
+	struct _Layer* pLayers;
+	int32_t        nLayers;
+	int32_t        nLayerCap;
+
+	struct _DecalVertex* pDecalVerts;
+	int32_t              nDecalVerts;
+	int32_t              nDecalVertCap;
+	struct _DecalRun*    pDecalRuns;
+	int32_t              nDecalRuns;
+	int32_t              nDecalRunCap;
+
+	struct _Perf*  pPerf;
+	struct _Bench* pBench;
+
+	struct _SharedFrame* pShared;
+
+	struct _Capture*  pCapture;
+	struct _InputLog* pRecordLog;
+	struct _InputLog* pReplayLog;
+
+	#ifdef _WIN32
+
+		HDC   glDeviceContext;
+		HGLRC glRenderContext;
+
+		HWND   olc_hWnd;
+		LPVOID sge;
+
+	#else
+
+		GLXContext  glDeviceContext;
+		GLXFBConfig glFBConfig;
+
+		Display*             olc_Display;
+		Window               olc_WindowRoot;
+		Window               olc_Window;
+		XVisualInfo*         olc_VisualInfo;
+		Colormap             olc_ColourMap;
+		XSetWindowAttributes olc_SetWindowAttribs;
+
+	#endif
+};
+
+#define PGE_CONTEXT_INIT { .nScreenWidth = 256, .nScreenHeight = 240, .nPixelWidth = 4, .nPixelHeight = 4 }
+
+/* Fixed resolution.
+   Building with PGE_SCREEN_W and PGE_SCREEN_H, and optionally
+   PGE_PIXEL_W and PGE_PIXEL_H, defined makes them constants wherever
+   the engine reads them. The default target's bounds, stride and
+   clear length, and the size of its texture uploads, then fold into
+   the code. PGE_construct refuses any other size.
+*/
+#ifdef PGE_SCREEN_W
+	#define PGE_SCREEN_WIDTH ( ( uint32_t ) PGE_SCREEN_W )
+#else
+	#define PGE_SCREEN_WIDTH pCtx->nScreenWidth
+#endif
+
+#ifdef PGE_SCREEN_H
+	#define PGE_SCREEN_HEIGHT ( ( uint32_t ) PGE_SCREEN_H )
+#else
+	#define PGE_SCREEN_HEIGHT pCtx->nScreenHeight
+#endif
+
+#ifdef PGE_PIXEL_W
+	#define PGE_PIXEL_WIDTH ( ( uint32_t ) PGE_PIXEL_W )
+#else
+	#define PGE_PIXEL_WIDTH pCtx->nPixelWidth
+#endif
+
+#ifdef PGE_PIXEL_H
+	#define PGE_PIXEL_HEIGHT ( ( uint32_t ) PGE_PIXEL_H )
 #else
+	#define PGE_PIXEL_HEIGHT pCtx->nPixelHeight
+#endif
+
+#if defined( PGE_SCREEN_W ) && defined( PGE_SCREEN_H )
+	#define PGE_FIXED_SCREEN
+#endif
+
+static PGE_Context defaultContext = PGE_CONTEXT_INIT;
 
-	static GLXContext glDeviceContext = NULL;
+static PGE_THREAD_LOCAL PGE_Context* pCtx = &defaultContext;
 
-	static Display*             olc_Display = NULL;
-	static Window               olc_WindowRoot;
-	static Window               olc_Window;
-	static XVisualInfo*         olc_VisualInfo;
-	static Colormap             olc_ColourMap;
-	static XSetWindowAttributes olc_SetWindowAttribs;
+/* The current context's draw target and clip, for the inline fast
+   path in the header. Kept in step wherever they change.
+*/
+PGE_THREAD_LOCAL Sprite* pgeDrawTarget = NULL;
+PGE_THREAD_LOCAL Rect    pgeClip       = { 0, 0, 0, 0 };
+
+#ifdef _WIN32
+
+	static LRESULT CALLBACK olc_WindowEvent  ( HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam );
+	static HWND             PGE_windowCreate ( void );
+
+#else
 
 	static Display* PGE_windowCreate ( void );
 
 #endif
 
-
 static enum Key mapKey           ( unsigned int sym );
 static bool     PGE_OpenGLCreate ( void );
 
 
 //================================================================================
 
-static void Pixel_setRGB ( Pixel* p, uint8_t r, uint8_t g, uint8_t b )
+// Monotonic wall clock, in seconds
+static double PGE_getTime ( void )
 {
-	p->r = r;
-	p->g = g;
-	p->b = b;
-	p->a = 255;
-}
-
+	#ifdef _WIN32
 
-//================================================================================
+		LARGE_INTEGER freq;
+		LARGE_INTEGER now;
 
-static Sprite* Sprite_new ( int w, int h )
-{
-	Sprite* sp;
-	Pixel*  p;
-	int32_t i;
+		QueryPerformanceFrequency( &freq );
+		QueryPerformanceCounter( &now );
 
-	sp = ( Sprite* ) malloc( sizeof( Sprite ) );
+		return ( double ) now.QuadPart / ( double ) freq.QuadPart;
 
-	sp->width  = w;
-	sp->height = h;
+	#else
 
-	sp->pColData = ( Pixel* ) malloc( w * h * sizeof( Pixel ) );
+		struct timespec ts;
 
-	for ( i = 0; i < w * h; i += 1 )
-	{
-		p = sp->pColData + i;
+		clock_gettime( CLOCK_MONOTONIC, &ts );
 
-		// Pixel_setRGB( p, 0, 0, 0 );
-		Pixel_setRGB( p, 0, 255, 0 );
-	}
+		return ( double ) ts.tv_sec + ( double ) ts.tv_nsec * 1e-9;
 
-	return sp;
+	#endif
 }
 
-static void Sprite_free ( Sprite* sp )
-{
-	free( sp->pColData );
-
-	free( sp );
 
-	sp = NULL;
-}
+//================================================================================
 
-static bool Sprite_setPixelRGB ( Sprite* sp, int32_t x, int32_t y, uint8_t r, uint8_t g, uint8_t b )
+/* Load statistics are recorded by loader threads too. The mutex is
+   made the first time, by exactly one thread, so it exists before any
+   loader can, whichever thread gets there first; contexts from
+   PGE_createContext make it up front.
+*/
+static void PGE_lockLoadStats ( PGE_Context* ctx, bool bLock )
 {
-	Pixel* psp;
-
-	if ( x >= 0 && x < sp->width &&
-	     y >= 0 && y < sp->height )
+	if ( PGE_ATOMIC_LOAD( &ctx->nStatsMutexState ) != 2 )
 	{
-		// sp->pColData[ y * sp->width + x ] = p;
+		if ( PGE_ATOMIC_CAS( &ctx->nStatsMutexState, 0, 1 ) )
+		{
+			Mutex_init( &ctx->statsMutex );
 
-		psp = sp->pColData + ( y * sp->width + x );
+			PGE_ATOMIC_STORE( &ctx->nStatsMutexState, 2 );
+		}
 
-		Pixel_setRGB( psp, r, g, b );
+		while ( PGE_ATOMIC_LOAD( &ctx->nStatsMutexState ) != 2 )
+		{
+			PGE_SLEEP_MS( 0 );
+		}
+	}
 
-		return true;
+	if ( bLock )
+	{
+		Mutex_lock( &ctx->statsMutex );
 	}
 	else
 	{
-		return false;
+		Mutex_unlock( &ctx->statsMutex );
 	}
 }
 
-static Pixel* Sprite_getData ( Sprite* sp )
+PGE_Context* PGE_createContext ( void )
 {
-	return sp->pColData;
-}
+	PGE_Context  init = PGE_CONTEXT_INIT;
+	PGE_Context* ctx;
 
+	ctx = ( PGE_Context* ) malloc( sizeof( PGE_Context ) );
 
-//================================================================================
+	*ctx = init;
 
-void PGE_setDrawTarget ( Sprite* target )
+	PGE_lockLoadStats( ctx, true );
+	PGE_lockLoadStats( ctx, false );
+
+	return ctx;
+}
+
+/* Mirrors the current context's target and clip for the inline path.
+   A default target still awaiting its fill is left out, so inline draws
+   come through PGE_getDrawTarget and PGE_drawRGB, which finish it.
+*/
+static void PGE_syncInlineTarget ( void )
 {
-	if ( target )
+	if ( pCtx->bTargetInitPending && pCtx->pDrawTarget == pCtx->pDefaultDrawTarget )
 	{
-		pDrawTarget = target;
+		pgeDrawTarget = NULL;
 	}
 	else
 	{
-		pDrawTarget = pDefaultDrawTarget;
+		pgeDrawTarget = pCtx->pDrawTarget;
 	}
+
+	pgeClip = pCtx->clip;
 }
 
-Sprite* PGE_getDrawTarget ( void )
+static void PGE_setCurrentContext ( PGE_Context* ctx )
 {
-	return pDrawTarget;
+	pCtx = ctx;
+
+	PGE_syncInlineTarget();
 }
 
-int32_t PGE_getDrawTargetWidth ( void )
+void PGE_destroyContext ( PGE_Context* ctx )
 {
-	if ( pDrawTarget )
+	if ( ctx == pCtx )
 	{
-		return pDrawTarget->width;
+		PGE_setCurrentContext( &defaultContext );
 	}
-	else
+
+	if ( ctx != &defaultContext )
 	{
-		return 0;
+		if ( ctx->nStatsMutexState == 2 )
+		{
+			Mutex_destroy( &ctx->statsMutex );
+		}
+
+		free( ctx );
 	}
 }
 
-int32_t PGE_getDrawTargetHeight ( void )
+void PGE_makeContextCurrent ( PGE_Context* ctx )
 {
-	if ( pDrawTarget )
-	{
-		return pDrawTarget->height;
-	}
-	else
-	{
-		return 0;
-	}
+	PGE_setCurrentContext( ctx ? ctx : &defaultContext );
 }
 
-bool PGE_drawRGB ( int32_t x, int32_t y, uint8_t r, uint8_t g, uint8_t b )
+PGE_Context* PGE_getCurrentContext ( void )
 {
-	if ( ! pDrawTarget )
-	{
-		return false;
-	}
+	return pCtx;
+}
 
-	// Assume Pixel::NORMAL
-	return Sprite_setPixelRGB( pDrawTarget, x, y, r, g, b );
+void PGE_setUserData ( void* p )
+{
+	pCtx->pUserData = p;
 }
 
-void PGE_clearRGB ( uint8_t r, uint8_t g, uint8_t b )
+void* PGE_getUserData ( void )
 {
-	Sprite* sp;
-	Pixel*  psp;
-	int     nPixels;
-	int     i;
+	return pCtx->pUserData;
+}
 
-	nPixels = PGE_getDrawTargetWidth() * PGE_getDrawTargetHeight();
 
-	sp = PGE_getDrawTarget();
+//================================================================================
 
-	// Per pixel...
-	for ( i = 0; i < nPixels; i += 1 )
-	{
-		psp = sp->pColData + i;
+/* Background loading.
+   Jobs run on a small pool of loader threads, which act on the
+   context that submitted them. Finished jobs queue up until the
+   engine thread calls their completion callbacks at the start of a
+   frame, so callbacks never race the user's update.
+*/
 
-		Pixel_setRGB( psp, r, g, b );
-	}
-}
+struct _LoadJob
+{
+	bool ( *pfnLoad ) ( void* pUser );
+	void ( *pfnDone ) ( void* pUser, bool bOk );
+	void ( *pfnDiscard ) ( void* pUser );  // frees what the engine's own jobs hold, or NULL
+	void* pUser;
+	bool  bOk;
 
+	struct _LoadJob* pNext;
+};
 
-//================================================================================
+typedef struct _LoadJob LoadJob;
 
-int32_t PGE_getScreenWidth ( void )
-{
-	return nScreenWidth;
-}
+#define LOADER_MAX_THREADS 8
 
-int32_t PGE_getScreenHeight ( void )
+struct _Loader
 {
-	return nScreenHeight;
-}
+	PGE_Context* ctx;
+	PGE_Mutex    mutex;       // guards the queues and bQuit
+	PGE_Cond     cond;
+	PGE_Thread   threads [ LOADER_MAX_THREADS ];
+	int32_t      nThreads;
+	LoadJob*     pQueued;     // oldest first
+	LoadJob*     pQueuedTail;
+	LoadJob*     pDone;
+	int32_t      nPending;    // submitted, callback not yet called
+	bool         bQuit;
+};
+
+typedef struct _Loader Loader;
+
+struct _SpriteJob
+{
+	char*   sFile;
+	Sprite* sp;
+	void ( *pfnLoaded ) ( Sprite* sp, void* pUser );
+	void*   pUser;
+};
 
-static void PGE_updateViewport ( void )
+typedef struct _SpriteJob SpriteJob;
+
+static PGE_THREAD_FUNC( Loader_thread )
 {
-	int32_t ww;
-	int32_t wh;
-	float   wasp;
+	Loader*  ld;
+	LoadJob* job;
 
-	ww   = nScreenWidth * nPixelWidth;
-	wh   = nScreenHeight * nPixelHeight;
-	wasp = ( float ) ww / ( float ) wh;
+	ld = ( Loader* ) arg;
 
-	nViewW = ( int32_t ) nWindowWidth;
-	nViewH = ( int32_t ) ( ( float ) nViewW / wasp );
+	/* Load statistics belong to the submitting engine. Workers never draw,
+	   so the inline target mirrors are left to the engine thread.
+	*/
+	pCtx = ld->ctx;
 
-	if ( nViewH > nWindowHeight )
+	while ( true )
 	{
-		nViewH = nWindowHeight;
-		nViewW = ( int32_t ) ( ( float ) nViewH * wasp );
-	}
+		Mutex_lock( &ld->mutex );
 
-	nViewX = ( nWindowWidth - nViewW ) / 2;
-	nViewY = ( nWindowHeight - nViewH ) / 2;
-}
+		while ( ! ld->pQueued && ! ld->bQuit )
+		{
+			Cond_wait( &ld->cond, &ld->mutex );
+		}
 
-void PGE_updateWindowSize ( int32_t x, int32_t y )
-{
-	nWindowWidth = x;
-	nWindowHeight = y;
+		if ( ld->bQuit )
+		{
+			Mutex_unlock( &ld->mutex );
 
-	PGE_updateViewport();
-}
+			break;
+		}
 
+		job         = ld->pQueued;
+		ld->pQueued = job->pNext;
 
-//================================================================================
+		Mutex_unlock( &ld->mutex );
 
-bool PGE_isFocused ( void )
-{
-	return bHasInputFocus;
-}
+		job->bOk = job->pfnLoad( job->pUser );
 
+		Mutex_lock( &ld->mutex );
 
-//================================================================================
+		job->pNext = ld->pDone;
+		ld->pDone  = job;
 
-HWButton PGE_getMouse ( enum MouseButton b )
-{
-	return pMouseState[ b ];
-}
+		Mutex_unlock( &ld->mutex );
+	}
 
-int32_t PGE_getMouseX ( void )
-{
-	return nMousePosX;
+	PGE_THREAD_RETURN;
 }
 
-int32_t PGE_getMouseY ( void )
+static int32_t Loader_cpuCount ( void )
 {
-	return nMousePosY;
-}
+	#ifdef _WIN32
 
-static void PGE_updateMouse ( int32_t x, int32_t y )
-{
-	/* Mouse coords come in screen space,
-	   but leave in pixel space.
-	*/
+		SYSTEM_INFO si;
 
-	// Full Screen mode may have a weird viewport we must clamp to
-	x -= nViewX;
-	y -= nViewY;
+		GetSystemInfo( &si );
 
-	nMousePosXCache = ( int32_t ) ( ( float ) x /
-	                                ( float ) ( nWindowWidth - ( nViewX * 2 ) ) *
-	                                ( float ) nScreenWidth );
+		return ( int32_t ) si.dwNumberOfProcessors;
 
-	nMousePosYCache = ( int32_t ) ( ( float ) y /
-	                                ( float ) ( nWindowHeight - ( nViewY * 2 ) ) *
-	                                ( float ) nScreenHeight );
+	#else
 
-	if ( nMousePosXCache >= ( int32_t ) nScreenWidth )
-	{
-		nMousePosXCache = nScreenWidth - 1;
-	}
-	if ( nMousePosYCache >= ( int32_t ) nScreenHeight )
-	{
-		nMousePosYCache = nScreenHeight - 1;
-	}
+		return ( int32_t ) sysconf( _SC_NPROCESSORS_ONLN );
 
-	if ( nMousePosXCache < 0 )
-	{
-		nMousePosXCache = 0;
-	}
-	if ( nMousePosYCache < 0 )
+	#endif
+}
+
+static Loader* Loader_get ( void )
+{
+	Loader* ld;
+	int32_t i;
+	int32_t n;
+
+	if ( pCtx->pLoader )
 	{
-		nMousePosYCache = 0;
+		return pCtx->pLoader;
 	}
-}
 
+	ld = ( Loader* ) calloc( 1, sizeof( Loader ) );
 
-//================================================================================
+	ld->ctx = pCtx;
 
-HWButton PGE_getKey ( enum Key k )
-{
-	return pKeyboardState[ k ];
-}
+	Mutex_init( &ld->mutex );
+	Cond_init( &ld->cond );
 
-#ifdef _WIN32
+	// Leave a core for the engine thread
+	n = Loader_cpuCount() - 1;
+	n = n < 1 ? 1 : n > LOADER_MAX_THREADS ? LOADER_MAX_THREADS : n;
 
-	static enum Key mapKey ( unsigned int sym )
+	// Published before any worker can record a load
+	pCtx->pLoader = ld;
+
+	for ( i = 0; i < n; i += 1 )
 	{
-		// Create Keyboard Mapping
-		switch ( sym )
+		if ( Thread_create( &ld->threads[ ld->nThreads ], Loader_thread, ld ) )
 		{
-			case 0x00 : return KEY_NONE;
-			case 0x41 : return KEY_A;
-			case 0x42 : return KEY_B;
-			case 0x43 : return KEY_C;
-			case 0x44 : return KEY_D;
-			case 0x45 : return KEY_E;
-			case 0x46 : return KEY_F;
-			case 0x47 : return KEY_G;
-			case 0x48 : return KEY_H;
-			case 0x49 : return KEY_I;
-			case 0x4A : return KEY_J;
-			case 0x4B : return KEY_K;
-			case 0x4C : return KEY_L;
-			case 0x4D : return KEY_M;
-			case 0x4E : return KEY_N;
-			case 0x4F : return KEY_O;
-			case 0x50 : return KEY_P;
-			case 0x51 : return KEY_Q;
-			case 0x52 : return KEY_R;
-			case 0x53 : return KEY_S;
-			case 0x54 : return KEY_T;
-			case 0x55 : return KEY_U;
-			case 0x56 : return KEY_V;
-			case 0x57 : return KEY_W;
-			case 0x58 : return KEY_X;
-			case 0x59 : return KEY_Y;
-			case 0x5A : return KEY_Z;
+			ld->nThreads += 1;
+		}
+	}
+
+	return ld;
+}
+
+/* Discards queued and finished jobs without calling their callbacks,
+   though the engine's own jobs free what they hold
+*/
+static void Loader_destroy ( void )
+{
+	Loader*  ld;
+	LoadJob* job;
+	int32_t  i;
+
+	ld = pCtx->pLoader;
+
+	if ( ! ld )
+	{
+		return;
+	}
+
+	Mutex_lock( &ld->mutex );
+	ld->bQuit = true;
+	Cond_broadcast( &ld->cond );
+	Mutex_unlock( &ld->mutex );
+
+	for ( i = 0; i < ld->nThreads; i += 1 )
+	{
+		Thread_join( ld->threads[ i ] );
+	}
+
+	while ( ld->pQueued || ld->pDone )
+	{
+		job = ld->pQueued ? ld->pQueued : ld->pDone;
+
+		if ( job == ld->pQueued )
+		{
+			ld->pQueued = job->pNext;
+		}
+		else
+		{
+			ld->pDone = job->pNext;
+		}
+
+		if ( job->pfnDiscard )
+		{
+			job->pfnDiscard( job->pUser );
+		}
+
+		free( job );
+	}
+
+	pCtx->pLoader = NULL;
+
+	Mutex_destroy( &ld->mutex );
+	Cond_destroy( &ld->cond );
+	free( ld );
+}
+
+static void Loader_submit ( bool ( *onLoad ) ( void* pUser ), void ( *onDone ) ( void* pUser, bool bOk ), void ( *onDiscard ) ( void* pUser ), void* pUser )
+{
+	Loader*  ld;
+	LoadJob* job;
+
+	ld  = Loader_get();
+	job = ( LoadJob* ) calloc( 1, sizeof( LoadJob ) );
+
+	job->pfnLoad    = onLoad;
+	job->pfnDone    = onDone;
+	job->pfnDiscard = onDiscard;
+	job->pUser      = pUser;
+
+	Mutex_lock( &ld->mutex );
+
+	if ( ld->pQueued )
+	{
+		ld->pQueuedTail->pNext = job;
+	}
+	else
+	{
+		ld->pQueued = job;
+	}
+
+	ld->pQueuedTail = job;
+	ld->nPending   += 1;
+
+	Cond_signal( &ld->cond );
+	Mutex_unlock( &ld->mutex );
+}
+
+void PGE_loadAsync ( bool ( *onLoad ) ( void* pUser ), void ( *onDone ) ( void* pUser, bool bOk ), void* pUser )
+{
+	Loader_submit( onLoad, onDone, NULL, pUser );
+}
+
+static bool SpriteJob_load ( void* pUser )
+{
+	SpriteJob* job;
+
+	job     = ( SpriteJob* ) pUser;
+	job->sp = Sprite_newFromFile( job->sFile );
+
+	return job->sp != NULL;
+}
+
+static void SpriteJob_done ( void* pUser, bool bOk )
+{
+	SpriteJob* job;
+
+	job = ( SpriteJob* ) pUser;
+
+	job->pfnLoaded( bOk ? job->sp : NULL, job->pUser );
+
+	free( job->sFile );
+	free( job );
+}
+
+// Loaded but never handed over, or never loaded
+static void SpriteJob_discard ( void* pUser )
+{
+	SpriteJob* job;
+
+	job = ( SpriteJob* ) pUser;
+
+	if ( job->sp )
+	{
+		Sprite_free( job->sp );
+	}
+
+	free( job->sFile );
+	free( job );
+}
+
+void PGE_loadSpriteAsync ( const char* sImageFile, void ( *onLoaded ) ( Sprite* sp, void* pUser ), void* pUser )
+{
+	SpriteJob* job;
+
+	job = ( SpriteJob* ) calloc( 1, sizeof( SpriteJob ) );
+
+	job->sFile     = strdup( sImageFile );
+	job->pfnLoaded = onLoaded;
+	job->pUser     = pUser;
+
+	Loader_submit( SpriteJob_load, SpriteJob_done, SpriteJob_discard, job );
+}
+
+float PGE_getTimeToFirstFrame ( void )
+{
+	return pCtx->startup.fTotal;
+}
+
+int32_t PGE_getLoadsPending ( void )
+{
+	Loader* ld;
+	int32_t n;
+
+	ld = pCtx->pLoader;
+
+	if ( ! ld )
+	{
+		return 0;
+	}
+
+	Mutex_lock( &ld->mutex );
+	n = ld->nPending;
+	Mutex_unlock( &ld->mutex );
+
+	return n;
+}
+
+// Called by the engine thread once per frame
+static void PGE_completeLoads ( void )
+{
+	Loader*  ld;
+	LoadJob* job;
+	LoadJob* pDone;
+	LoadJob* pOrdered;
+
+	ld = pCtx->pLoader;
+
+	if ( ! ld )
+	{
+		return;
+	}
+
+	Mutex_lock( &ld->mutex );
+
+	pDone     = ld->pDone;
+	ld->pDone = NULL;
+
+	Mutex_unlock( &ld->mutex );
+
+
+	// Completed in reverse, call back in completion order
+	pOrdered = NULL;
+
+	while ( pDone )
+	{
+		job         = pDone;
+		pDone       = job->pNext;
+		job->pNext  = pOrdered;
+		pOrdered    = job;
+	}
+
+	while ( pOrdered )
+	{
+		job      = pOrdered;
+		pOrdered = job->pNext;
+
+		if ( job->pfnDone )
+		{
+			job->pfnDone( job->pUser, job->bOk );
+		}
+
+		free( job );
+
+		Mutex_lock( &ld->mutex );
+		ld->nPending -= 1;
+		Mutex_unlock( &ld->mutex );
+	}
+}
+
+
+//================================================================================
+
+/* Tracing, only compiled in with PGE_TRACE defined.
+   Each thread records into its own ring of events, which only it
+   writes and only the dump thread reads, so recording takes no locks.
+   The dump thread drains every ring a few hundred times a second into
+   a Chrome trace JSON file, which chrome://tracing and Perfetto open.
+   A full ring drops events rather than waiting.
+   The trace belongs to the process rather than to a context, as the
+   threads it follows may serve any of them. Only one runs at a time,
+   and it records every context's engine and user scopes.
+*/
+
+#ifdef PGE_TRACE
+
+	#define TRACE_RING_SIZE ( 1 << 16 )  // events per thread, a power of two
+
+	struct _TraceEvent
+	{
+		const char* sName;
+		double      t;
+		char        ph;  // 'B' or 'E'
+	};
+
+	typedef struct _TraceEvent TraceEvent;
+
+	struct _TraceBuffer
+	{
+		TraceEvent events [ TRACE_RING_SIZE ];
+		uint32_t   nHead;  // written by the owning thread
+		uint32_t   nTail;  // written by the dump thread
+		uint32_t   nDropped;
+		uint32_t   nTid;
+
+		struct _TraceBuffer* pNext;
+	};
+
+	typedef struct _TraceBuffer TraceBuffer;
+
+	static PGE_Mutex    traceMutex;  // guards the buffer list
+	static bool         bTraceMutexInit = false;
+	static TraceBuffer* pTraceBuffers   = NULL;
+	static uint32_t     nTraceThreads   = 0;
+	static FILE*        traceFile       = NULL;
+	static double       tTraceStart     = 0.0;
+	static bool         bTraceFirst     = true;
+	static PGE_Thread   traceThread;
+
+	// Flags set by other threads, so read and written with PGE_ATOMIC_*
+	static uint32_t bTraceClaimed = 0;  // from PGE_traceStart until PGE_traceStop has finished
+	static uint32_t bTraceActive  = 0;
+	static uint32_t bTraceStop    = 0;
+	static uint32_t nTraceGen     = 0;  // bumped when buffers are freed
+
+	static PGE_THREAD_LOCAL TraceBuffer* pThreadTrace    = NULL;
+	static PGE_THREAD_LOCAL uint32_t     nThreadTraceGen = 0;
+
+	static void PGE_traceRecord ( const char* sName, char ph )
+	{
+		TraceBuffer* tb;
+		TraceEvent*  e;
+		uint32_t     head;
+
+		if ( ! PGE_ATOMIC_LOAD( &bTraceActive ) )
+		{
+			return;
+		}
+
+		tb = pThreadTrace;
+
+		// First event on this thread since tracing started
+		if ( ! tb || nThreadTraceGen != PGE_ATOMIC_LOAD( &nTraceGen ) )
+		{
+			tb = ( TraceBuffer* ) calloc( 1, sizeof( TraceBuffer ) );
+
+			Mutex_lock( &traceMutex );
+
+			nTraceThreads += 1;
+
+			tb->nTid      = nTraceThreads;
+			tb->pNext     = pTraceBuffers;
+			pTraceBuffers = tb;
+
+			Mutex_unlock( &traceMutex );
+
+			pThreadTrace    = tb;
+			nThreadTraceGen = PGE_ATOMIC_LOAD( &nTraceGen );
+		}
+
+		head = tb->nHead;
+
+		if ( head - PGE_ATOMIC_LOAD( &tb->nTail ) == TRACE_RING_SIZE )
+		{
+			tb->nDropped += 1;
+
+			return;
+		}
+
+		e = tb->events + ( head & ( TRACE_RING_SIZE - 1 ) );
+
+		e->sName = sName;
+		e->t     = PGE_getTime();
+		e->ph    = ph;
+
+		// Publish the event to the dump thread
+		PGE_ATOMIC_STORE( &tb->nHead, head + 1 );
+	}
+
+	void PGE_traceBegin ( const char* sName )
+	{
+		PGE_traceRecord( sName, 'B' );
+	}
+
+	void PGE_traceEnd ( void )
+	{
+		PGE_traceRecord( NULL, 'E' );
+	}
+
+	static void PGE_traceDrain ( void )
+	{
+		TraceBuffer* tb;
+		TraceBuffer* pList;
+		TraceEvent*  e;
+		uint32_t     head;
+		uint32_t     tail;
+		const char*  c;
+
+		/* New buffers are only ever pushed on the front with pNext already
+		   set, and none are freed before PGE_traceStop joins this thread,
+		   so a snapshot of the head stays walkable after the lock is
+		   released. Writing the file without the lock keeps a thread's
+		   first event from waiting on disk I/O.
+		*/
+		Mutex_lock( &traceMutex );
+
+		pList = pTraceBuffers;
+
+		Mutex_unlock( &traceMutex );
+
+		for ( tb = pList; tb; tb = tb->pNext )
+		{
+			head = PGE_ATOMIC_LOAD( &tb->nHead );
+			tail = tb->nTail;
+
+			while ( tail != head )
+			{
+				e = tb->events + ( tail & ( TRACE_RING_SIZE - 1 ) );
+
+				fprintf( traceFile, bTraceFirst ? "\n" : ",\n" );
+
+				bTraceFirst = false;
+
+				if ( e->ph == 'B' )
+				{
+					fputs( "{\"name\":\"", traceFile );
+
+					// Escape just enough to keep the JSON valid
+					for ( c = e->sName; *c; c += 1 )
+					{
+						if ( *c == '"' || *c == '\\' )
+						{
+							fputc( '\\', traceFile );
+						}
+
+						fputc( ( unsigned char ) *c < 0x20 ? ' ' : *c, traceFile );
+					}
+
+					fputs( "\",", traceFile );
+				}
+				else
+				{
+					fputc( '{', traceFile );
+				}
+
+				fprintf(
+
+					traceFile,
+					"\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+					e->ph,
+					tb->nTid,
+					( e->t - tTraceStart ) * 1e6
+				);
+
+				tail += 1;
+			}
+
+			PGE_ATOMIC_STORE( &tb->nTail, tail );
+		}
+	}
+
+	static PGE_THREAD_FUNC( PGE_traceThread )
+	{
+		while ( ! PGE_ATOMIC_LOAD( &bTraceStop ) )
+		{
+			PGE_SLEEP_MS( 5 );
+
+			PGE_traceDrain();
+		}
+
+		PGE_THREAD_RETURN;
+	}
+
+	// Fails while any context's trace is running
+	enum rcode PGE_traceStart ( const char* sFile )
+	{
+		if ( ! PGE_ATOMIC_CAS( &bTraceClaimed, 0, 1 ) )
+		{
+			return FAIL;
+		}
+
+		if ( ! bTraceMutexInit )
+		{
+			Mutex_init( &traceMutex );
+
+			bTraceMutexInit = true;
+		}
+
+		traceFile = fopen( sFile, "w" );
+
+		if ( ! traceFile )
+		{
+			PGE_ATOMIC_STORE( &bTraceClaimed, 0 );
+
+			return NO_FILE;
+		}
+
+		fputs( "{\"traceEvents\":[", traceFile );
+
+		tTraceStart = PGE_getTime();
+		bTraceFirst = true;
+
+		PGE_ATOMIC_STORE( &bTraceStop, 0 );
+
+		if ( ! Thread_create( &traceThread, PGE_traceThread, NULL ) )
+		{
+			fclose( traceFile );
+
+			PGE_ATOMIC_STORE( &bTraceClaimed, 0 );
+
+			return FAIL;
+		}
+
+		PGE_ATOMIC_STORE( &bTraceActive, 1 );
+
+		return OK;
+	}
+
+	/* Other threads must have stopped tracing by now, user load callbacks
+	   included. The engine's loader threads record nothing themselves.
+	*/
+	void PGE_traceStop ( void )
+	{
+		TraceBuffer* tb;
+		uint32_t     nDropped;
+
+		if ( ! PGE_ATOMIC_CAS( &bTraceActive, 1, 0 ) )
+		{
+			return;
+		}
+
+		PGE_ATOMIC_STORE( &bTraceStop, 1 );
+
+		Thread_join( traceThread );
+
+		PGE_traceDrain();
+
+		nDropped = 0;
+
+		while ( pTraceBuffers )
+		{
+			tb            = pTraceBuffers;
+			pTraceBuffers = tb->pNext;
+			nDropped     += tb->nDropped;
+
+			free( tb );
+		}
+
+		nTraceThreads = 0;
+
+		PGE_ATOMIC_STORE( &nTraceGen, nTraceGen + 1 );
+
+		fprintf( traceFile, "\n],\"otherData\":{\"droppedEvents\":%u}}\n", nDropped );
+		fclose( traceFile );
+
+		traceFile = NULL;
+
+		PGE_ATOMIC_STORE( &bTraceClaimed, 0 );
+	}
+
+#endif
+
+
+//================================================================================
+
+/* Hardware counters.
+   The events are opened as one group, led by the cycle counter, so
+   they are scheduled together and one read returns them all. If the
+   kernel had to multiplex the group, counts are scaled up by the
+   fraction of time it ran.
+*/
+
+enum
+{
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_L1_MISSES,
+	PERF_LLC_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_EVENTS
+};
+
+struct _Perf
+{
+	int     fds    [ PERF_EVENTS ];
+	int32_t slots  [ PERF_EVENTS ];  // position in a group read, -1 when not counting
+	int32_t nSlots;
+};
+
+typedef struct _Perf Perf;
+
+#ifdef __linux__
+
+	static int PGE_perfOpenEvent ( uint32_t type, uint64_t config, int group )
+	{
+		struct perf_event_attr attr;
+
+		memset( &attr, 0, sizeof( attr ) );
+
+		attr.size           = sizeof( attr );
+		attr.type           = type;
+		attr.config         = config;
+		attr.disabled       = group < 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv     = 1;
+		attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		return ( int ) syscall( __NR_perf_event_open, &attr, 0, -1, group, 0 );
+	}
+
+#endif
+
+enum rcode PGE_perfOpen ( void )
+{
+	#ifdef __linux__
+
+		Perf*    pf;
+		int32_t  i;
+		uint64_t cache;
+
+		uint32_t types [ PERF_EVENTS ] = {
+
+			PERF_TYPE_HARDWARE,
+			PERF_TYPE_HARDWARE,
+			PERF_TYPE_HW_CACHE,
+			PERF_TYPE_HW_CACHE,
+			PERF_TYPE_HARDWARE
+		};
+
+		uint64_t configs [ PERF_EVENTS ];
+
+		if ( pCtx->pPerf )
+		{
+			return OK;
+		}
+
+		cache = ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 );
+
+		configs[ PERF_CYCLES ]        = PERF_COUNT_HW_CPU_CYCLES;
+		configs[ PERF_INSTRUCTIONS ]  = PERF_COUNT_HW_INSTRUCTIONS;
+		configs[ PERF_L1_MISSES ]     = PERF_COUNT_HW_CACHE_L1D | cache;
+		configs[ PERF_LLC_MISSES ]    = PERF_COUNT_HW_CACHE_LL  | cache;
+		configs[ PERF_BRANCH_MISSES ] = PERF_COUNT_HW_BRANCH_MISSES;
+
+		pf = ( Perf* ) malloc( sizeof( Perf ) );
+
+		pf->nSlots = 0;
+
+		for ( i = 0; i < PERF_EVENTS; i += 1 )
+		{
+			pf->fds[ i ]   = PGE_perfOpenEvent( types[ i ], configs[ i ], i == 0 ? -1 : pf->fds[ 0 ] );
+			pf->slots[ i ] = pf->fds[ i ] < 0 ? -1 : pf->nSlots;
+			pf->nSlots    += pf->fds[ i ] < 0 ? 0 : 1;
+
+			// Without the leader there is nothing to count with
+			if ( i == 0 && pf->fds[ 0 ] < 0 )
+			{
+				free( pf );
+
+				return FAIL;
+			}
+		}
+
+		ioctl( pf->fds[ 0 ], PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP );
+		ioctl( pf->fds[ 0 ], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+
+		pCtx->pPerf = pf;
+
+		return OK;
+
+	#else
+
+		return FAIL;
+
+	#endif
+}
+
+void PGE_perfClose ( void )
+{
+	#ifdef __linux__
+
+		Perf*   pf;
+		int32_t i;
+
+		pf = pCtx->pPerf;
+
+		if ( ! pf )
+		{
+			return;
+		}
+
+		// Members first, then the leader
+		for ( i = PERF_EVENTS - 1; i >= 0; i -= 1 )
+		{
+			if ( pf->fds[ i ] >= 0 )
+			{
+				close( pf->fds[ i ] );
+			}
+		}
+
+		free( pf );
+
+		pCtx->pPerf = NULL;
+
+	#endif
+}
+
+bool PGE_perfIsOpen ( void )
+{
+	return pCtx->pPerf != NULL;
+}
+
+void PGE_perfSample ( PerfSample* s )
+{
+	#ifdef __linux__
+
+		Perf*    pf;
+		uint64_t buf [ 3 + PERF_EVENTS ];  // count, time enabled, time running, values
+		uint64_t counts [ PERF_EVENTS ];
+		double   scale;
+		int32_t  i;
+
+	#endif
+
+	memset( s, 0, sizeof( PerfSample ) );
+
+	s->fSeconds = PGE_getTime();
+
+	#ifdef __linux__
+
+		pf = pCtx->pPerf;
+
+		if ( ! pf || read( pf->fds[ 0 ], buf, sizeof( buf ) ) < ( ssize_t ) ( ( 3 + pf->nSlots ) * sizeof( uint64_t ) ) )
+		{
+			return;
+		}
+
+		scale = ( buf[ 2 ] > 0 && buf[ 2 ] < buf[ 1 ] ) ? ( double ) buf[ 1 ] / ( double ) buf[ 2 ] : 1.0;
+
+		for ( i = 0; i < PERF_EVENTS; i += 1 )
+		{
+			counts[ i ] = pf->slots[ i ] < 0 ? 0 : ( uint64_t ) ( buf[ 3 + pf->slots[ i ] ] * scale );
+		}
+
+		s->nCycles       = counts[ PERF_CYCLES ];
+		s->nInstructions = counts[ PERF_INSTRUCTIONS ];
+		s->nL1Misses     = counts[ PERF_L1_MISSES ];
+		s->nLLCMisses    = counts[ PERF_LLC_MISSES ];
+		s->nBranchMisses = counts[ PERF_BRANCH_MISSES ];
+
+	#endif
+}
+
+void PGE_perfElapsed ( const PerfSample* pStart, PerfSample* pOut )
+{
+	PGE_perfSample( pOut );
+
+	pOut->fSeconds      -= pStart->fSeconds;
+	pOut->nCycles       -= pStart->nCycles;
+	pOut->nInstructions -= pStart->nInstructions;
+	pOut->nL1Misses     -= pStart->nL1Misses;
+	pOut->nLLCMisses    -= pStart->nLLCMisses;
+	pOut->nBranchMisses -= pStart->nBranchMisses;
+}
+
+
+//================================================================================
+
+/* Frame phases.
+   The engine brackets each phase of its frame with these, which feed
+   both the trace and benchmark mode, and cost a branch when neither
+   is running.
+*/
+
+enum PGE_Phase
+{
+	PHASE_EVENTS,
+	PHASE_INPUT,
+	PHASE_LOADS,
+	PHASE_SIMULATE,
+	PHASE_UPDATE,
+	PHASE_CAPTURE,
+	PHASE_UPLOAD,
+	PHASE_DECALS,
+	PHASE_SWAP,
+	PHASE_COUNT
+};
+
+static const char* PGE_phaseNames [ PHASE_COUNT ] = {
+
+	"events", "input", "loads", "simulate", "update", "capture", "upload", "decals", "swap"
+};
+
+struct _Bench
+{
+	PhaseStat  stats [ PHASE_COUNT ];
+	PerfSample start;
+	int32_t    nPhase;  // the phase started last
+};
+
+typedef struct _Bench Bench;
+
+static void PGE_phaseBegin ( enum PGE_Phase phase )
+{
+	PGE_traceBegin( PGE_phaseNames[ phase ] );
+
+	if ( pCtx->pBench )
+	{
+		pCtx->pBench->nPhase = phase;
+
+		PGE_perfSample( &pCtx->pBench->start );
+	}
+}
+
+static void PGE_phaseEnd ( void )
+{
+	Bench*     b;
+	PhaseStat* st;
+	PerfSample d;
+
+	b = pCtx->pBench;
+
+	if ( b )
+	{
+		PGE_perfElapsed( &b->start, &d );
+
+		st = b->stats + b->nPhase;
+
+		st->nCalls              += 1;
+		st->total.fSeconds      += d.fSeconds;
+		st->total.nCycles       += d.nCycles;
+		st->total.nInstructions += d.nInstructions;
+		st->total.nL1Misses     += d.nL1Misses;
+		st->total.nLLCMisses    += d.nLLCMisses;
+		st->total.nBranchMisses += d.nBranchMisses;
+	}
+
+	PGE_traceEnd();
+}
+
+void PGE_benchStart ( void )
+{
+	int32_t i;
+
+	if ( ! pCtx->pBench )
+	{
+		pCtx->pBench = ( Bench* ) malloc( sizeof( Bench ) );
+	}
+
+	memset( pCtx->pBench, 0, sizeof( Bench ) );
+
+	for ( i = 0; i < PHASE_COUNT; i += 1 )
+	{
+		pCtx->pBench->stats[ i ].sName = PGE_phaseNames[ i ];
+	}
+}
+
+void PGE_benchStop ( void )
+{
+	free( pCtx->pBench );
+
+	pCtx->pBench = NULL;
+}
+
+int32_t PGE_getPhaseStatCount ( void )
+{
+	return pCtx->pBench ? PHASE_COUNT : 0;
+}
+
+const PhaseStat* PGE_getPhaseStat ( int32_t i )
+{
+	if ( ! pCtx->pBench || i < 0 || i >= PHASE_COUNT )
+	{
+		return NULL;
+	}
+
+	return pCtx->pBench->stats + i;
+}
+
+
+//================================================================================
+
+static void Pixel_setRGB ( Pixel* p, uint8_t r, uint8_t g, uint8_t b )
+{
+	p->r = r;
+	p->g = g;
+	p->b = b;
+	p->a = 255;
+}
+
+
+//================================================================================
+
+/* Pixel kernels.
+   The inner loops of clearing, masked blits, blending, palette
+   expansion and scaling come in scalar, SSE2, AVX2 and AVX-512
+   variants. One binary serves every x86 CPU, so the best variant the
+   CPU and OS support is picked at run time, once, at PGE_construct.
+   Until then, and off x86, the scalar variants run. All variants give
+   identical results.
+*/
+
+typedef void ( *PGE_FillFunc   ) ( Pixel* dst, Pixel p, int32_t n );
+typedef void ( *PGE_SpanFunc   ) ( Pixel* dst, const Pixel* src, int32_t n );
+typedef void ( *PGE_ExpandFunc ) ( Pixel* dst, const uint8_t* idx, const Pixel* pal, int32_t n );
+typedef void ( *PGE_ScaleFunc  ) ( Pixel* dst, const Pixel* src, uint32_t u, uint32_t du, int32_t n );
+typedef void ( *PGE_AffineFunc ) ( Pixel* dst, const Sprite* sp, uint32_t u, uint32_t v, uint32_t du, uint32_t dv, int32_t n );
+
+enum
+{
+	CPU_SCALAR,
+	CPU_SSE2,
+	CPU_AVX2,
+	CPU_AVX512,
+	CPU_LEVELS
+};
+
+enum
+{
+	KERNEL_FILL,
+	KERNEL_BLIT,
+	KERNEL_BLEND,
+	KERNEL_ADD,
+	KERNEL_EXPAND,
+	KERNEL_SCALE,
+	KERNEL_NEAREST,
+	KERNEL_BILINEAR,
+	KERNEL_COUNT
+};
+
+static const char* PGE_cpuLevelNames [ CPU_LEVELS ] = { "scalar", "sse2", "avx2", "avx512" };
+
+static const char* PGE_kernelNames [ KERNEL_COUNT ] = { "fill", "blit", "blend", "add", "expand", "scale", "nearest", "bilinear" };
+
+// Process wide, as the CPU is, and read by every thread
+struct _Kernels
+{
+	PGE_FillFunc   fill;      // clears and span fills
+	PGE_SpanFunc   blit;      // PIXEL_MASK copies
+	PGE_SpanFunc   blend;     // PIXEL_ALPHA
+	PGE_SpanFunc   add;       // PIXEL_ADD
+	PGE_ExpandFunc expand;    // 8 bit palette indices to pixels
+	PGE_ScaleFunc  scale;     // nearest samples along a row, 16.16 steps
+	PGE_AffineFunc nearest;   // nearest samples along any line through a sprite
+	PGE_AffineFunc bilinear;  // the same, filtered
+	int32_t        levels [ KERNEL_COUNT ];
+};
+
+typedef struct _Kernels Kernels;
+
+// Rounded x / 255, exact for 0 <= x <= 255 * 255
+static uint32_t PGE_div255 ( uint32_t x )
+{
+	x += 128;
+
+	return ( x + ( x >> 8 ) ) >> 8;
+}
+
+/* Blends p over dst by p's alpha, two channels per multiply in
+   alternate bytes. dst's alpha is coverage, so accumulates instead.
+*/
+static void PGE_alphaPixel ( Pixel* dst, Pixel p )
+{
+	uint32_t a;
+	uint32_t ia;
+	uint32_t da;
+	uint32_t s;
+	uint32_t d;
+	uint32_t rb;
+	uint32_t ga;
+
+	a = p.a;
+
+	if ( a == 255 )
+	{
+		*dst = p;
+
+		return;
+	}
+
+	if ( a == 0 )
+	{
+		return;
+	}
+
+	memcpy( &s, &p, 4 );
+	memcpy( &d, dst, 4 );
+
+	ia = 255 - a;
+	da = dst->a;
+
+	rb = ( s & 0x00FF00FF ) * a + ( d & 0x00FF00FF ) * ia + 0x00800080;
+	ga = ( ( s >> 8 ) & 0x00FF00FF ) * a + ( ( d >> 8 ) & 0x00FF00FF ) * ia + 0x00800080;
+
+	rb = ( ( rb + ( ( rb >> 8 ) & 0x00FF00FF ) ) >> 8 ) & 0x00FF00FF;
+	ga = ( ( ga + ( ( ga >> 8 ) & 0x00FF00FF ) ) ) & 0xFF00FF00;
+
+	s = rb | ga;
+
+	memcpy( dst, &s, 4 );
+
+	dst->a = a + PGE_div255( da * ia );
+}
+
+// Adds p, scaled by its alpha, saturating. Alpha adds unscaled
+static void PGE_addPixel ( Pixel* dst, Pixel p )
+{
+	uint32_t a;
+	uint32_t da;
+	uint32_t s;
+	uint32_t d;
+	uint32_t rb;
+	uint32_t ga;
+	uint32_t over;
+
+	a = p.a;
+
+	memcpy( &s, &p, 4 );
+	memcpy( &d, dst, 4 );
+
+	da = dst->a + a;
+
+	// Scale by alpha
+	rb = ( s & 0x00FF00FF ) * a + 0x00800080;
+	ga = ( ( s >> 8 ) & 0x00FF00FF ) * a + 0x00800080;
+
+	rb = ( ( rb + ( ( rb >> 8 ) & 0x00FF00FF ) ) >> 8 ) & 0x00FF00FF;
+	ga = ( ( ga + ( ( ga >> 8 ) & 0x00FF00FF ) ) >> 8 ) & 0x00FF00FF;
+
+	// Add, then saturate lanes that carried into bit 8
+	rb += d & 0x00FF00FF;
+	ga += ( d >> 8 ) & 0x00FF00FF;
+
+	over = rb & 0x01000100;
+	rb   = ( rb | ( over - ( over >> 8 ) ) ) & 0x00FF00FF;
+	over = ga & 0x01000100;
+	ga   = ( ga | ( over - ( over >> 8 ) ) ) & 0x00FF00FF;
+
+	s = rb | ( ga << 8 );
+
+	memcpy( dst, &s, 4 );
+
+	dst->a = da > 255 ? 255 : da;
+}
+
+static void Kernel_fillScalar ( Pixel* dst, Pixel p, int32_t n )
+{
+	int32_t i;
+
+	for ( i = 0; i < n; i += 1 )
+	{
+		dst[ i ] = p;
+	}
+}
+
+static void Kernel_blitScalar ( Pixel* dst, const Pixel* src, int32_t n )
+{
+	int32_t i;
+
+	for ( i = 0; i < n; i += 1 )
+	{
+		if ( src[ i ].a == 255 )
+		{
+			dst[ i ] = src[ i ];
+		}
+	}
+}
+
+static void Kernel_blendScalar ( Pixel* dst, const Pixel* src, int32_t n )
+{
+	int32_t i;
+
+	for ( i = 0; i < n; i += 1 )
+	{
+		PGE_alphaPixel( dst + i, src[ i ] );
+	}
+}
+
+static void Kernel_addScalar ( Pixel* dst, const Pixel* src, int32_t n )
+{
+	int32_t i;
+
+	for ( i = 0; i < n; i += 1 )
+	{
+		PGE_addPixel( dst + i, src[ i ] );
+	}
+}
+
+static void Kernel_expandScalar ( Pixel* dst, const uint8_t* idx, const Pixel* pal, int32_t n )
+{
+	int32_t i;
+
+	for ( i = 0; i < n; i += 1 )
+	{
+		dst[ i ] = pal[ idx[ i ] ];
+	}
+}
+
+static void Kernel_scaleScalar ( Pixel* dst, const Pixel* src, uint32_t u, uint32_t du, int32_t n )
+{
+	int32_t i;
+
+	for ( i = 0; i + 4 <= n; i += 4 )
+	{
+		dst[ i + 0 ] = src[ u >> 16 ];  u += du;
+		dst[ i + 1 ] = src[ u >> 16 ];  u += du;
+		dst[ i + 2 ] = src[ u >> 16 ];  u += du;
+		dst[ i + 3 ] = src[ u >> 16 ];  u += du;
+	}
+
+	for ( ; i < n; i += 1 )
+	{
+		dst[ i ] = src[ u >> 16 ];  u += du;
+	}
+}
+
+/* Weights fx and fy are 8 bit fractions of the way from p00 to p11.
+   Like blending, works on two channels per multiply.
+*/
+static Pixel Pixel_bilinear ( Pixel p00, Pixel p10, Pixel p01, Pixel p11, uint32_t fx, uint32_t fy )
+{
+	Pixel    p;
+	uint32_t q00;
+	uint32_t q10;
+	uint32_t q01;
+	uint32_t q11;
+	uint32_t gx;
+	uint32_t gy;
+	uint32_t top;
+	uint32_t bot;
+	uint32_t rb;
+	uint32_t ga;
+
+	memcpy( &q00, &p00, 4 );
+	memcpy( &q10, &p10, 4 );
+	memcpy( &q01, &p01, 4 );
+	memcpy( &q11, &p11, 4 );
+
+	gx = 256 - fx;
+	gy = 256 - fy;
+
+	top = ( ( ( q00 & 0x00FF00FF ) * gx + ( q10 & 0x00FF00FF ) * fx + 0x00800080 ) >> 8 ) & 0x00FF00FF;
+	bot = ( ( ( q01 & 0x00FF00FF ) * gx + ( q11 & 0x00FF00FF ) * fx + 0x00800080 ) >> 8 ) & 0x00FF00FF;
+	rb  = ( ( top * gy + bot * fy + 0x00800080 ) >> 8 ) & 0x00FF00FF;
+
+	q00 >>= 8;
+	q10 >>= 8;
+	q01 >>= 8;
+	q11 >>= 8;
+
+	top = ( ( ( q00 & 0x00FF00FF ) * gx + ( q10 & 0x00FF00FF ) * fx + 0x00800080 ) >> 8 ) & 0x00FF00FF;
+	bot = ( ( ( q01 & 0x00FF00FF ) * gx + ( q11 & 0x00FF00FF ) * fx + 0x00800080 ) >> 8 ) & 0x00FF00FF;
+	ga  = ( top * gy + bot * fy + 0x00800080 ) & 0xFF00FF00;
+
+	rb |= ga;
+
+	memcpy( &p, &rb, 4 );
+
+	return p;
+}
+
+// Nearest samples along a line in 16.16 steps, all inside the sprite
+static void Kernel_nearestScalar ( Pixel* dst, const Sprite* sp, uint32_t u, uint32_t v, uint32_t du, uint32_t dv, int32_t n )
+{
+	const Pixel* src;
+	int32_t      w;
+	int32_t      i;
+
+	src = sp->pColData;
+	w   = sp->nStride;
+
+	for ( i = 0; i + 4 <= n; i += 4 )
+	{
+		dst[ i + 0 ] = src[ ( v >> 16 ) * w + ( u >> 16 ) ];  u += du;  v += dv;
+		dst[ i + 1 ] = src[ ( v >> 16 ) * w + ( u >> 16 ) ];  u += du;  v += dv;
+		dst[ i + 2 ] = src[ ( v >> 16 ) * w + ( u >> 16 ) ];  u += du;  v += dv;
+		dst[ i + 3 ] = src[ ( v >> 16 ) * w + ( u >> 16 ) ];  u += du;  v += dv;
+	}
+
+	for ( ; i < n; i += 1 )
+	{
+		dst[ i ] = src[ ( v >> 16 ) * w + ( u >> 16 ) ];  u += du;  v += dv;
+	}
+}
+
+// Bilinear samples, taps past the sprite's edges are clamped to it
+static void Kernel_bilinearScalar ( Pixel* dst, const Sprite* sp, uint32_t u, uint32_t v, uint32_t du, uint32_t dv, int32_t n )
+{
+	const Pixel* src;
+	int32_t      su;
+	int32_t      sv;
+	int32_t      x0;
+	int32_t      y0;
+	int32_t      x1;
+	int32_t      y1;
+	int32_t      i;
+
+	src = sp->pColData;
+
+	for ( i = 0; i < n; i += 1 )
+	{
+		// Texel centres sit at half way points
+		su = ( int32_t ) u - 32768;
+		sv = ( int32_t ) v - 32768;
+
+		x0 = su >> 16;
+		y0 = sv >> 16;
+		x1 = x0 + 1;
+		y1 = y0 + 1;
+
+		if ( x0 < 0 )           { x0 = 0; }
+		if ( y0 < 0 )           { y0 = 0; }
+		if ( x1 >= sp->width )  { x1 = sp->width - 1; }
+		if ( y1 >= sp->height ) { y1 = sp->height - 1; }
+
+		dst[ i ] = Pixel_bilinear(
+
+			src[ y0 * sp->nStride + x0 ],
+			src[ y0 * sp->nStride + x1 ],
+			src[ y1 * sp->nStride + x0 ],
+			src[ y1 * sp->nStride + x1 ],
+			( su >> 8 ) & 0xFF,
+			( sv >> 8 ) & 0xFF
+		);
+
+		u += du;
+		v += dv;
+	}
+}
+
+
+#ifdef PGE_SSE2
+
+	/* Blending widens each channel to 16 bits, where s * a + d * ( 255 - a )
+	   and the rounding steps of PGE_div255 fit without overflow. The
+	   source alpha lane is taken as 255, so the same sum gives the
+	   coverage a + div255( da * ( 255 - a ) ) of PGE_alphaPixel.
+	*/
+	static __m128i Kernel_blendHalfSSE2 ( __m128i s, __m128i d, __m128i a )
+	{
+		__m128i x;
+
+		x = _mm_add_epi16(
+
+			_mm_add_epi16( _mm_mullo_epi16( s, a ), _mm_mullo_epi16( d, _mm_sub_epi16( _mm_set1_epi16( 255 ), a ) ) ),
+			_mm_set1_epi16( 128 )
+		);
+
+		return _mm_srli_epi16( _mm_add_epi16( x, _mm_srli_epi16( x, 8 ) ), 8 );
+	}
+
+	// Each pixel's alpha in all four of its 16 bit lanes, for the low and high pixel pairs
+	static void Kernel_alphaSSE2 ( __m128i s, __m128i* pLo, __m128i* pHi )
+	{
+		__m128i a;
+
+		a = _mm_srli_epi32( s, 24 );
+		a = _mm_or_si128( a, _mm_slli_epi32( a, 16 ) );
+
+		*pLo = _mm_unpacklo_epi32( a, a );
+		*pHi = _mm_unpackhi_epi32( a, a );
+	}
+
+	static void Kernel_fillSSE2 ( Pixel* dst, Pixel p, int32_t n )
+	{
+		__m128i  v;
+		uint32_t q;
+		int32_t  i;
+
+		memcpy( &q, &p, 4 );
+
+		v = _mm_set1_epi32( ( int32_t ) q );
+
+		for ( i = 0; i + 4 <= n; i += 4 )
+		{
+			_mm_storeu_si128( ( __m128i* ) ( dst + i ), v );
+		}
+
+		Kernel_fillScalar( dst + i, p, n - i );
+	}
+
+	static void Kernel_blitSSE2 ( Pixel* dst, const Pixel* src, int32_t n )
+	{
+		__m128i amask;
+		__m128i s;
+		__m128i d;
+		__m128i m;
+		int32_t i;
+
+		amask = _mm_set1_epi32( ( int32_t ) 0xFF000000 );
+
+		for ( i = 0; i + 4 <= n; i += 4 )
+		{
+			s = _mm_loadu_si128( ( const __m128i* ) ( src + i ) );
+			d = _mm_loadu_si128( ( const __m128i* ) ( dst + i ) );
+			m = _mm_cmpeq_epi32( _mm_and_si128( s, amask ), amask );
+
+			_mm_storeu_si128( ( __m128i* ) ( dst + i ), _mm_or_si128( _mm_and_si128( m, s ), _mm_andnot_si128( m, d ) ) );
+		}
+
+		Kernel_blitScalar( dst + i, src + i, n - i );
+	}
+
+	static void Kernel_blendSSE2 ( Pixel* dst, const Pixel* src, int32_t n )
+	{
+		__m128i zero;
+		__m128i amask;
+		__m128i s;
+		__m128i d;
+		__m128i alo;
+		__m128i ahi;
+		__m128i lo;
+		__m128i hi;
+		int32_t i;
+
+		zero  = _mm_setzero_si128();
+		amask = _mm_set1_epi32( ( int32_t ) 0xFF000000 );
+
+		for ( i = 0; i + 4 <= n; i += 4 )
+		{
+			s = _mm_loadu_si128( ( const __m128i* ) ( src + i ) );
+			d = _mm_loadu_si128( ( const __m128i* ) ( dst + i ) );
+
+			Kernel_alphaSSE2( s, &alo, &ahi );
+
+			s = _mm_or_si128( s, amask );
+
+			lo = Kernel_blendHalfSSE2( _mm_unpacklo_epi8( s, zero ), _mm_unpacklo_epi8( d, zero ), alo );
+			hi = Kernel_blendHalfSSE2( _mm_unpackhi_epi8( s, zero ), _mm_unpackhi_epi8( d, zero ), ahi );
+
+			_mm_storeu_si128( ( __m128i* ) ( dst + i ), _mm_packus_epi16( lo, hi ) );
+		}
+
+		Kernel_blendScalar( dst + i, src + i, n - i );
+	}
+
+	// As blending with d as 0, then a saturating add; alpha again scales by 255, so adds unscaled
+	static void Kernel_addSSE2 ( Pixel* dst, const Pixel* src, int32_t n )
+	{
+		__m128i zero;
+		__m128i amask;
+		__m128i s;
+		__m128i alo;
+		__m128i ahi;
+		__m128i lo;
+		__m128i hi;
+		int32_t i;
+
+		zero  = _mm_setzero_si128();
+		amask = _mm_set1_epi32( ( int32_t ) 0xFF000000 );
+
+		for ( i = 0; i + 4 <= n; i += 4 )
+		{
+			s = _mm_loadu_si128( ( const __m128i* ) ( src + i ) );
+
+			Kernel_alphaSSE2( s, &alo, &ahi );
+
+			s = _mm_or_si128( s, amask );
+
+			lo = Kernel_blendHalfSSE2( _mm_unpacklo_epi8( s, zero ), _mm_set1_epi16( 0 ), alo );
+			hi = Kernel_blendHalfSSE2( _mm_unpackhi_epi8( s, zero ), _mm_set1_epi16( 0 ), ahi );
+
+			_mm_storeu_si128(
+
+				( __m128i* ) ( dst + i ),
+				_mm_adds_epu8( _mm_loadu_si128( ( const __m128i* ) ( dst + i ) ), _mm_packus_epi16( lo, hi ) )
+			);
+		}
+
+		Kernel_addScalar( dst + i, src + i, n - i );
+	}
+
+	// Low 32 bits of a * b per lane, as SSE2 only multiplies alternate lanes
+	static __m128i Kernel_mulloSSE2 ( __m128i a, __m128i b )
+	{
+		__m128i even;
+		__m128i odd;
+
+		even = _mm_mul_epu32( a, b );
+		odd  = _mm_mul_epu32( _mm_srli_epi64( a, 32 ), _mm_srli_epi64( b, 32 ) );
+
+		return _mm_unpacklo_epi32( _mm_shuffle_epi32( even, _MM_SHUFFLE( 0, 0, 2, 0 ) ), _mm_shuffle_epi32( odd, _MM_SHUFFLE( 0, 0, 2, 0 ) ) );
+	}
+
+	static __m128i Kernel_minSSE2 ( __m128i a, __m128i b )
+	{
+		__m128i m;
+
+		m = _mm_cmpgt_epi32( a, b );
+
+		return _mm_or_si128( _mm_and_si128( m, b ), _mm_andnot_si128( m, a ) );
+	}
+
+	// Four pixels by index, SSE2 has no gather
+	static __m128i Kernel_gatherSSE2 ( const Pixel* src, __m128i idx )
+	{
+		int32_t  k [ 4 ];
+		uint32_t q [ 4 ];
+		int32_t  j;
+
+		_mm_storeu_si128( ( __m128i* ) k, idx );
+
+		for ( j = 0; j < 4; j += 1 )
+		{
+			memcpy( q + j, src + k[ j ], 4 );
+		}
+
+		return _mm_loadu_si128( ( const __m128i* ) q );
+	}
+
+	/* ( a * g + b * f + 128 ) >> 8 in 16 bit lanes, where g = 256 - f.
+	   The sum stays below 65536, as in Pixel_bilinear.
+	*/
+	static __m128i Kernel_lerpSSE2 ( __m128i a, __m128i b, __m128i f, __m128i g )
+	{
+		return _mm_srli_epi16(
+
+			_mm_add_epi16( _mm_add_epi16( _mm_mullo_epi16( a, g ), _mm_mullo_epi16( b, f ) ), _mm_set1_epi16( 128 ) ),
+			8
+		);
+	}
+
+	// Filters a pair of pixels widened to 16 bits, fx and fy in all four lanes of each
+	static __m128i Kernel_bilerpSSE2 ( __m128i p00, __m128i p10, __m128i p01, __m128i p11, __m128i fx, __m128i fy )
+	{
+		__m128i gx;
+		__m128i gy;
+
+		gx = _mm_sub_epi16( _mm_set1_epi16( 256 ), fx );
+		gy = _mm_sub_epi16( _mm_set1_epi16( 256 ), fy );
+
+		return Kernel_lerpSSE2( Kernel_lerpSSE2( p00, p10, fx, gx ), Kernel_lerpSSE2( p01, p11, fx, gx ), fy, gy );
+	}
+
+	static void Kernel_nearestSSE2 ( Pixel* dst, const Sprite* sp, uint32_t u, uint32_t v, uint32_t du, uint32_t dv, int32_t n )
+	{
+		__m128i vu;
+		__m128i vv;
+		__m128i stepu;
+		__m128i stepv;
+		__m128i stride;
+		__m128i idx;
+		int32_t i;
+
+		vu     = _mm_setr_epi32( ( int32_t ) u, ( int32_t ) ( u + du ), ( int32_t ) ( u + du * 2 ), ( int32_t ) ( u + du * 3 ) );
+		vv     = _mm_setr_epi32( ( int32_t ) v, ( int32_t ) ( v + dv ), ( int32_t ) ( v + dv * 2 ), ( int32_t ) ( v + dv * 3 ) );
+		stepu  = _mm_set1_epi32( ( int32_t ) ( du * 4 ) );
+		stepv  = _mm_set1_epi32( ( int32_t ) ( dv * 4 ) );
+		stride = _mm_set1_epi32( sp->nStride );
+
+		for ( i = 0; i + 4 <= n; i += 4 )
+		{
+			idx = _mm_add_epi32( Kernel_mulloSSE2( _mm_srli_epi32( vv, 16 ), stride ), _mm_srli_epi32( vu, 16 ) );
+
+			_mm_storeu_si128( ( __m128i* ) ( dst + i ), Kernel_gatherSSE2( sp->pColData, idx ) );
+
+			vu = _mm_add_epi32( vu, stepu );
+			vv = _mm_add_epi32( vv, stepv );
+		}
+
+		Kernel_nearestScalar( dst + i, sp, u + du * ( uint32_t ) i, v + dv * ( uint32_t ) i, du, dv, n - i );
+	}
+
+	/* Tap positions and clamping follow Kernel_bilinearScalar lane by
+	   lane, four pixels a step, so results match it exactly.
+	*/
+	static void Kernel_bilinearSSE2 ( Pixel* dst, const Sprite* sp, uint32_t u, uint32_t v, uint32_t du, uint32_t dv, int32_t n )
+	{
+		__m128i zero;
+		__m128i one;
+		__m128i ff;
+		__m128i su;
+		__m128i sv;
+		__m128i stepu;
+		__m128i stepv;
+		__m128i stride;
+		__m128i maxx;
+		__m128i maxy;
+		__m128i x0;
+		__m128i y0;
+		__m128i x1;
+		__m128i y1;
+		__m128i p00;
+		__m128i p10;
+		__m128i p01;
+		__m128i p11;
+		__m128i fx;
+		__m128i fy;
+		__m128i lo;
+		__m128i hi;
+		int32_t i;
+
+		zero   = _mm_setzero_si128();
+		one    = _mm_set1_epi32( 1 );
+		ff     = _mm_set1_epi32( 0xFF );
+		su     = _mm_setr_epi32( ( int32_t ) u, ( int32_t ) ( u + du ), ( int32_t ) ( u + du * 2 ), ( int32_t ) ( u + du * 3 ) );
+		sv     = _mm_setr_epi32( ( int32_t ) v, ( int32_t ) ( v + dv ), ( int32_t ) ( v + dv * 2 ), ( int32_t ) ( v + dv * 3 ) );
+		su     = _mm_sub_epi32( su, _mm_set1_epi32( 32768 ) );
+		sv     = _mm_sub_epi32( sv, _mm_set1_epi32( 32768 ) );
+		stepu  = _mm_set1_epi32( ( int32_t ) ( du * 4 ) );
+		stepv  = _mm_set1_epi32( ( int32_t ) ( dv * 4 ) );
+		stride = _mm_set1_epi32( sp->nStride );
+		maxx   = _mm_set1_epi32( sp->width  - 1 );
+		maxy   = _mm_set1_epi32( sp->height - 1 );
+
+		for ( i = 0; i + 4 <= n; i += 4 )
+		{
+			x0 = _mm_srai_epi32( su, 16 );
+			y0 = _mm_srai_epi32( sv, 16 );
+			x1 = Kernel_minSSE2( _mm_add_epi32( x0, one ), maxx );
+			y1 = Kernel_minSSE2( _mm_add_epi32( y0, one ), maxy );
+			x0 = _mm_andnot_si128( _mm_srai_epi32( x0, 31 ), x0 );
+			y0 = _mm_andnot_si128( _mm_srai_epi32( y0, 31 ), y0 );
+			y0 = Kernel_mulloSSE2( y0, stride );
+			y1 = Kernel_mulloSSE2( y1, stride );
+
+			p00 = Kernel_gatherSSE2( sp->pColData, _mm_add_epi32( y0, x0 ) );
+			p10 = Kernel_gatherSSE2( sp->pColData, _mm_add_epi32( y0, x1 ) );
+			p01 = Kernel_gatherSSE2( sp->pColData, _mm_add_epi32( y1, x0 ) );
+			p11 = Kernel_gatherSSE2( sp->pColData, _mm_add_epi32( y1, x1 ) );
+
+			// Each pixel's weights in all four of its 16 bit lanes
+			fx = _mm_and_si128( _mm_srli_epi32( su, 8 ), ff );
+			fy = _mm_and_si128( _mm_srli_epi32( sv, 8 ), ff );
+			fx = _mm_or_si128( fx, _mm_slli_epi32( fx, 16 ) );
+			fy = _mm_or_si128( fy, _mm_slli_epi32( fy, 16 ) );
+
+			lo = Kernel_bilerpSSE2(
+
+				_mm_unpacklo_epi8( p00, zero ), _mm_unpacklo_epi8( p10, zero ),
+				_mm_unpacklo_epi8( p01, zero ), _mm_unpacklo_epi8( p11, zero ),
+				_mm_unpacklo_epi32( fx, fx ), _mm_unpacklo_epi32( fy, fy )
+			);
+
+			hi = Kernel_bilerpSSE2(
+
+				_mm_unpackhi_epi8( p00, zero ), _mm_unpackhi_epi8( p10, zero ),
+				_mm_unpackhi_epi8( p01, zero ), _mm_unpackhi_epi8( p11, zero ),
+				_mm_unpackhi_epi32( fx, fx ), _mm_unpackhi_epi32( fy, fy )
+			);
+
+			_mm_storeu_si128( ( __m128i* ) ( dst + i ), _mm_packus_epi16( lo, hi ) );
+
+			su = _mm_add_epi32( su, stepu );
+			sv = _mm_add_epi32( sv, stepv );
+		}
+
+		Kernel_bilinearScalar( dst + i, sp, u + du * ( uint32_t ) i, v + dv * ( uint32_t ) i, du, dv, n - i );
+	}
+
+#endif
+
+
+/* Wider variants are compiled for their instruction sets function by
+   function, so the rest of the file still runs on any x86-64 CPU.
+   AVX2 kernels clear the upper register halves before finishing on a
+   scalar loop: that call compiles to a jump past the compiler's own
+   vzeroupper, and the caller's SSE code would otherwise slow down.
+*/
+#ifdef PGE_AVX
+
+	PGE_TARGET_AVX2 static __m256i Kernel_blendHalfAVX2 ( __m256i s, __m256i d, __m256i a )
+	{
+		__m256i x;
+
+		x = _mm256_add_epi16(
+
+			_mm256_add_epi16( _mm256_mullo_epi16( s, a ), _mm256_mullo_epi16( d, _mm256_sub_epi16( _mm256_set1_epi16( 255 ), a ) ) ),
+			_mm256_set1_epi16( 128 )
+		);
+
+		return _mm256_srli_epi16( _mm256_add_epi16( x, _mm256_srli_epi16( x, 8 ) ), 8 );
+	}
+
+	// Unpacks work within 128 bit halves, so pair up as in Kernel_alphaSSE2, per half
+	PGE_TARGET_AVX2 static void Kernel_alphaAVX2 ( __m256i s, __m256i* pLo, __m256i* pHi )
+	{
+		__m256i a;
+
+		a = _mm256_srli_epi32( s, 24 );
+		a = _mm256_or_si256( a, _mm256_slli_epi32( a, 16 ) );
+
+		*pLo = _mm256_unpacklo_epi32( a, a );
+		*pHi = _mm256_unpackhi_epi32( a, a );
+	}
+
+	PGE_TARGET_AVX2 static void Kernel_fillAVX2 ( Pixel* dst, Pixel p, int32_t n )
+	{
+		__m256i  v;
+		uint32_t q;
+		int32_t  i;
+
+		memcpy( &q, &p, 4 );
+
+		v = _mm256_set1_epi32( ( int32_t ) q );
+
+		for ( i = 0; i + 8 <= n; i += 8 )
+		{
+			_mm256_storeu_si256( ( __m256i* ) ( dst + i ), v );
+		}
+
+		_mm256_zeroupper();
+
+		Kernel_fillScalar( dst + i, p, n - i );
+	}
+
+	PGE_TARGET_AVX2 static void Kernel_blitAVX2 ( Pixel* dst, const Pixel* src, int32_t n )
+	{
+		__m256i amask;
+		__m256i s;
+		__m256i m;
+		int32_t i;
+
+		amask = _mm256_set1_epi32( ( int32_t ) 0xFF000000 );
+
+		for ( i = 0; i + 8 <= n; i += 8 )
+		{
+			s = _mm256_loadu_si256( ( const __m256i* ) ( src + i ) );
+			m = _mm256_cmpeq_epi32( _mm256_and_si256( s, amask ), amask );
+
+			_mm256_maskstore_epi32( ( int* ) ( dst + i ), m, s );
+		}
+
+		_mm256_zeroupper();
+
+		Kernel_blitScalar( dst + i, src + i, n - i );
+	}
+
+	PGE_TARGET_AVX2 static void Kernel_blendAVX2 ( Pixel* dst, const Pixel* src, int32_t n )
+	{
+		__m256i zero;
+		__m256i amask;
+		__m256i s;
+		__m256i d;
+		__m256i alo;
+		__m256i ahi;
+		__m256i lo;
+		__m256i hi;
+		int32_t i;
+
+		zero  = _mm256_setzero_si256();
+		amask = _mm256_set1_epi32( ( int32_t ) 0xFF000000 );
+
+		for ( i = 0; i + 8 <= n; i += 8 )
+		{
+			s = _mm256_loadu_si256( ( const __m256i* ) ( src + i ) );
+			d = _mm256_loadu_si256( ( const __m256i* ) ( dst + i ) );
+
+			Kernel_alphaAVX2( s, &alo, &ahi );
+
+			s = _mm256_or_si256( s, amask );
+
+			lo = Kernel_blendHalfAVX2( _mm256_unpacklo_epi8( s, zero ), _mm256_unpacklo_epi8( d, zero ), alo );
+			hi = Kernel_blendHalfAVX2( _mm256_unpackhi_epi8( s, zero ), _mm256_unpackhi_epi8( d, zero ), ahi );
+
+			_mm256_storeu_si256( ( __m256i* ) ( dst + i ), _mm256_packus_epi16( lo, hi ) );
+		}
+
+		_mm256_zeroupper();
+
+		Kernel_blendScalar( dst + i, src + i, n - i );
+	}
+
+	PGE_TARGET_AVX2 static void Kernel_addAVX2 ( Pixel* dst, const Pixel* src, int32_t n )
+	{
+		__m256i zero;
+		__m256i amask;
+		__m256i s;
+		__m256i alo;
+		__m256i ahi;
+		__m256i lo;
+		__m256i hi;
+		int32_t i;
+
+		zero  = _mm256_setzero_si256();
+		amask = _mm256_set1_epi32( ( int32_t ) 0xFF000000 );
+
+		for ( i = 0; i + 8 <= n; i += 8 )
+		{
+			s = _mm256_loadu_si256( ( const __m256i* ) ( src + i ) );
+
+			Kernel_alphaAVX2( s, &alo, &ahi );
+
+			s = _mm256_or_si256( s, amask );
+
+			lo = Kernel_blendHalfAVX2( _mm256_unpacklo_epi8( s, zero ), zero, alo );
+			hi = Kernel_blendHalfAVX2( _mm256_unpackhi_epi8( s, zero ), zero, ahi );
+
+			_mm256_storeu_si256(
+
+				( __m256i* ) ( dst + i ),
+				_mm256_adds_epu8( _mm256_loadu_si256( ( const __m256i* ) ( dst + i ) ), _mm256_packus_epi16( lo, hi ) )
+			);
+		}
+
+		_mm256_zeroupper();
+
+		Kernel_addScalar( dst + i, src + i, n - i );
+	}
+
+	PGE_TARGET_AVX2 static void Kernel_expandAVX2 ( Pixel* dst, const uint8_t* idx, const Pixel* pal, int32_t n )
+	{
+		__m256i v;
+		int32_t i;
+
+		for ( i = 0; i + 8 <= n; i += 8 )
+		{
+			v = _mm256_cvtepu8_epi32( _mm_loadl_epi64( ( const __m128i* ) ( idx + i ) ) );
+
+			_mm256_storeu_si256( ( __m256i* ) ( dst + i ), _mm256_i32gather_epi32( ( const int* ) pal, v, 4 ) );
+		}
+
+		_mm256_zeroupper();
+
+		Kernel_expandScalar( dst + i, idx + i, pal, n - i );
+	}
+
+	PGE_TARGET_AVX2 static void Kernel_scaleAVX2 ( Pixel* dst, const Pixel* src, uint32_t u, uint32_t du, int32_t n )
+	{
+		__m256i vu;
+		__m256i vstep;
+		int32_t i;
+
+		vu    = _mm256_add_epi32( _mm256_set1_epi32( ( int32_t ) u ), _mm256_mullo_epi32( _mm256_set1_epi32( ( int32_t ) du ), _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) ) );
+		vstep = _mm256_set1_epi32( ( int32_t ) ( du * 8 ) );
+
+		for ( i = 0; i + 8 <= n; i += 8 )
+		{
+			_mm256_storeu_si256( ( __m256i* ) ( dst + i ), _mm256_i32gather_epi32( ( const int* ) src, _mm256_srli_epi32( vu, 16 ), 4 ) );
+
+			vu = _mm256_add_epi32( vu, vstep );
+		}
+
+		_mm256_zeroupper();
+
+		Kernel_scaleScalar( dst + i, src, u + du * ( uint32_t ) i, du, n - i );
+	}
+
+	PGE_TARGET_AVX2 static __m256i Kernel_lerpAVX2 ( __m256i a, __m256i b, __m256i f, __m256i g )
+	{
+		return _mm256_srli_epi16(
+
+			_mm256_add_epi16( _mm256_add_epi16( _mm256_mullo_epi16( a, g ), _mm256_mullo_epi16( b, f ) ), _mm256_set1_epi16( 128 ) ),
+			8
+		);
+	}
+
+	PGE_TARGET_AVX2 static __m256i Kernel_bilerpAVX2 ( __m256i p00, __m256i p10, __m256i p01, __m256i p11, __m256i fx, __m256i fy )
+	{
+		__m256i gx;
+		__m256i gy;
+
+		gx = _mm256_sub_epi16( _mm256_set1_epi16( 256 ), fx );
+		gy = _mm256_sub_epi16( _mm256_set1_epi16( 256 ), fy );
+
+		return Kernel_lerpAVX2( Kernel_lerpAVX2( p00, p10, fx, gx ), Kernel_lerpAVX2( p01, p11, fx, gx ), fy, gy );
+	}
+
+	PGE_TARGET_AVX2 static void Kernel_nearestAVX2 ( Pixel* dst, const Sprite* sp, uint32_t u, uint32_t v, uint32_t du, uint32_t dv, int32_t n )
+	{
+		__m256i lane;
+		__m256i vu;
+		__m256i vv;
+		__m256i stepu;
+		__m256i stepv;
+		__m256i stride;
+		__m256i idx;
+		int32_t i;
+
+		lane   = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+		vu     = _mm256_add_epi32( _mm256_set1_epi32( ( int32_t ) u ), _mm256_mullo_epi32( _mm256_set1_epi32( ( int32_t ) du ), lane ) );
+		vv     = _mm256_add_epi32( _mm256_set1_epi32( ( int32_t ) v ), _mm256_mullo_epi32( _mm256_set1_epi32( ( int32_t ) dv ), lane ) );
+		stepu  = _mm256_set1_epi32( ( int32_t ) ( du * 8 ) );
+		stepv  = _mm256_set1_epi32( ( int32_t ) ( dv * 8 ) );
+		stride = _mm256_set1_epi32( sp->nStride );
+
+		for ( i = 0; i + 8 <= n; i += 8 )
+		{
+			idx = _mm256_add_epi32( _mm256_mullo_epi32( _mm256_srli_epi32( vv, 16 ), stride ), _mm256_srli_epi32( vu, 16 ) );
+
+			_mm256_storeu_si256( ( __m256i* ) ( dst + i ), _mm256_i32gather_epi32( ( const int* ) sp->pColData, idx, 4 ) );
+
+			vu = _mm256_add_epi32( vu, stepu );
+			vv = _mm256_add_epi32( vv, stepv );
+		}
+
+		_mm256_zeroupper();
+
+		Kernel_nearestScalar( dst + i, sp, u + du * ( uint32_t ) i, v + dv * ( uint32_t ) i, du, dv, n - i );
+	}
+
+	// As Kernel_bilinearSSE2, eight pixels a step with gathered taps
+	PGE_TARGET_AVX2 static void Kernel_bilinearAVX2 ( Pixel* dst, const Sprite* sp, uint32_t u, uint32_t v, uint32_t du, uint32_t dv, int32_t n )
+	{
+		const int* src;
+		__m256i    zero;
+		__m256i    one;
+		__m256i    ff;
+		__m256i    lane;
+		__m256i    su;
+		__m256i    sv;
+		__m256i    stepu;
+		__m256i    stepv;
+		__m256i    stride;
+		__m256i    maxx;
+		__m256i    maxy;
+		__m256i    x0;
+		__m256i    y0;
+		__m256i    x1;
+		__m256i    y1;
+		__m256i    p00;
+		__m256i    p10;
+		__m256i    p01;
+		__m256i    p11;
+		__m256i    fx;
+		__m256i    fy;
+		__m256i    lo;
+		__m256i    hi;
+		int32_t    i;
+
+		src    = ( const int* ) sp->pColData;
+		zero   = _mm256_setzero_si256();
+		one    = _mm256_set1_epi32( 1 );
+		ff     = _mm256_set1_epi32( 0xFF );
+		lane   = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+		su     = _mm256_add_epi32( _mm256_set1_epi32( ( int32_t ) ( u - 32768 ) ), _mm256_mullo_epi32( _mm256_set1_epi32( ( int32_t ) du ), lane ) );
+		sv     = _mm256_add_epi32( _mm256_set1_epi32( ( int32_t ) ( v - 32768 ) ), _mm256_mullo_epi32( _mm256_set1_epi32( ( int32_t ) dv ), lane ) );
+		stepu  = _mm256_set1_epi32( ( int32_t ) ( du * 8 ) );
+		stepv  = _mm256_set1_epi32( ( int32_t ) ( dv * 8 ) );
+		stride = _mm256_set1_epi32( sp->nStride );
+		maxx   = _mm256_set1_epi32( sp->width  - 1 );
+		maxy   = _mm256_set1_epi32( sp->height - 1 );
+
+		for ( i = 0; i + 8 <= n; i += 8 )
+		{
+			x0 = _mm256_srai_epi32( su, 16 );
+			y0 = _mm256_srai_epi32( sv, 16 );
+			x1 = _mm256_min_epi32( _mm256_add_epi32( x0, one ), maxx );
+			y1 = _mm256_min_epi32( _mm256_add_epi32( y0, one ), maxy );
+			x0 = _mm256_max_epi32( x0, zero );
+			y0 = _mm256_max_epi32( y0, zero );
+			y0 = _mm256_mullo_epi32( y0, stride );
+			y1 = _mm256_mullo_epi32( y1, stride );
+
+			p00 = _mm256_i32gather_epi32( src, _mm256_add_epi32( y0, x0 ), 4 );
+			p10 = _mm256_i32gather_epi32( src, _mm256_add_epi32( y0, x1 ), 4 );
+			p01 = _mm256_i32gather_epi32( src, _mm256_add_epi32( y1, x0 ), 4 );
+			p11 = _mm256_i32gather_epi32( src, _mm256_add_epi32( y1, x1 ), 4 );
+
+			fx = _mm256_and_si256( _mm256_srli_epi32( su, 8 ), ff );
+			fy = _mm256_and_si256( _mm256_srli_epi32( sv, 8 ), ff );
+			fx = _mm256_or_si256( fx, _mm256_slli_epi32( fx, 16 ) );
+			fy = _mm256_or_si256( fy, _mm256_slli_epi32( fy, 16 ) );
+
+			// Unpacking and packing stay within 128 bit lanes, so pixels keep their order
+			lo = Kernel_bilerpAVX2(
+
+				_mm256_unpacklo_epi8( p00, zero ), _mm256_unpacklo_epi8( p10, zero ),
+				_mm256_unpacklo_epi8( p01, zero ), _mm256_unpacklo_epi8( p11, zero ),
+				_mm256_unpacklo_epi32( fx, fx ), _mm256_unpacklo_epi32( fy, fy )
+			);
+
+			hi = Kernel_bilerpAVX2(
+
+				_mm256_unpackhi_epi8( p00, zero ), _mm256_unpackhi_epi8( p10, zero ),
+				_mm256_unpackhi_epi8( p01, zero ), _mm256_unpackhi_epi8( p11, zero ),
+				_mm256_unpackhi_epi32( fx, fx ), _mm256_unpackhi_epi32( fy, fy )
+			);
+
+			_mm256_storeu_si256( ( __m256i* ) ( dst + i ), _mm256_packus_epi16( lo, hi ) );
+
+			su = _mm256_add_epi32( su, stepu );
+			sv = _mm256_add_epi32( sv, stepv );
+		}
+
+		_mm256_zeroupper();
+
+		Kernel_bilinearScalar( dst + i, sp, u + du * ( uint32_t ) i, v + dv * ( uint32_t ) i, du, dv, n - i );
+	}
+
+
+	// Tails use masked loads and stores rather than falling back
+	PGE_TARGET_AVX512 static __m512i Kernel_blendHalfAVX512 ( __m512i s, __m512i d, __m512i a )
+	{
+		__m512i x;
+
+		x = _mm512_add_epi16(
+
+			_mm512_add_epi16( _mm512_mullo_epi16( s, a ), _mm512_mullo_epi16( d, _mm512_sub_epi16( _mm512_set1_epi16( 255 ), a ) ) ),
+			_mm512_set1_epi16( 128 )
+		);
+
+		return _mm512_srli_epi16( _mm512_add_epi16( x, _mm512_srli_epi16( x, 8 ) ), 8 );
+	}
+
+	PGE_TARGET_AVX512 static void Kernel_alphaAVX512 ( __m512i s, __m512i* pLo, __m512i* pHi )
+	{
+		__m512i a;
+
+		a = _mm512_srli_epi32( s, 24 );
+		a = _mm512_or_si512( a, _mm512_slli_epi32( a, 16 ) );
+
+		*pLo = _mm512_unpacklo_epi32( a, a );
+		*pHi = _mm512_unpackhi_epi32( a, a );
+	}
+
+	PGE_TARGET_AVX512 static __mmask16 Kernel_tailAVX512 ( int32_t n )
+	{
+		return n >= 16 ? ( __mmask16 ) 0xFFFF : ( __mmask16 ) ( ( 1u << n ) - 1 );
+	}
+
+	PGE_TARGET_AVX512 static void Kernel_fillAVX512 ( Pixel* dst, Pixel p, int32_t n )
+	{
+		__m512i  v;
+		uint32_t q;
+		int32_t  i;
+
+		memcpy( &q, &p, 4 );
+
+		v = _mm512_set1_epi32( ( int32_t ) q );
+
+		for ( i = 0; i < n; i += 16 )
+		{
+			_mm512_mask_storeu_epi32( dst + i, Kernel_tailAVX512( n - i ), v );
+		}
+	}
+
+	PGE_TARGET_AVX512 static void Kernel_blitAVX512 ( Pixel* dst, const Pixel* src, int32_t n )
+	{
+		__m512i   amask;
+		__m512i   s;
+		__mmask16 k;
+		int32_t   i;
+
+		amask = _mm512_set1_epi32( ( int32_t ) 0xFF000000 );
+
+		for ( i = 0; i < n; i += 16 )
+		{
+			k = Kernel_tailAVX512( n - i );
+			s = _mm512_maskz_loadu_epi32( k, src + i );
+			k = _mm512_mask_cmpeq_epi32_mask( k, _mm512_and_si512( s, amask ), amask );
+
+			_mm512_mask_storeu_epi32( dst + i, k, s );
+		}
+	}
+
+	PGE_TARGET_AVX512 static void Kernel_blendAVX512 ( Pixel* dst, const Pixel* src, int32_t n )
+	{
+		__m512i   zero;
+		__m512i   amask;
+		__m512i   s;
+		__m512i   d;
+		__m512i   alo;
+		__m512i   ahi;
+		__m512i   lo;
+		__m512i   hi;
+		__mmask16 k;
+		int32_t   i;
+
+		zero  = _mm512_setzero_si512();
+		amask = _mm512_set1_epi32( ( int32_t ) 0xFF000000 );
+
+		for ( i = 0; i < n; i += 16 )
+		{
+			k = Kernel_tailAVX512( n - i );
+			s = _mm512_maskz_loadu_epi32( k, src + i );
+			d = _mm512_maskz_loadu_epi32( k, dst + i );
+
+			Kernel_alphaAVX512( s, &alo, &ahi );
+
+			s = _mm512_or_si512( s, amask );
+
+			lo = Kernel_blendHalfAVX512( _mm512_unpacklo_epi8( s, zero ), _mm512_unpacklo_epi8( d, zero ), alo );
+			hi = Kernel_blendHalfAVX512( _mm512_unpackhi_epi8( s, zero ), _mm512_unpackhi_epi8( d, zero ), ahi );
+
+			_mm512_mask_storeu_epi32( dst + i, k, _mm512_packus_epi16( lo, hi ) );
+		}
+	}
+
+	PGE_TARGET_AVX512 static void Kernel_addAVX512 ( Pixel* dst, const Pixel* src, int32_t n )
+	{
+		__m512i   zero;
+		__m512i   amask;
+		__m512i   s;
+		__m512i   alo;
+		__m512i   ahi;
+		__m512i   lo;
+		__m512i   hi;
+		__mmask16 k;
+		int32_t   i;
+
+		zero  = _mm512_setzero_si512();
+		amask = _mm512_set1_epi32( ( int32_t ) 0xFF000000 );
+
+		for ( i = 0; i < n; i += 16 )
+		{
+			k = Kernel_tailAVX512( n - i );
+			s = _mm512_maskz_loadu_epi32( k, src + i );
+
+			Kernel_alphaAVX512( s, &alo, &ahi );
+
+			s = _mm512_or_si512( s, amask );
+
+			lo = Kernel_blendHalfAVX512( _mm512_unpacklo_epi8( s, zero ), zero, alo );
+			hi = Kernel_blendHalfAVX512( _mm512_unpackhi_epi8( s, zero ), zero, ahi );
+
+			_mm512_mask_storeu_epi32(
+
+				dst + i, k,
+				_mm512_adds_epu8( _mm512_maskz_loadu_epi32( k, dst + i ), _mm512_packus_epi16( lo, hi ) )
+			);
+		}
+	}
+
+	PGE_TARGET_AVX512 static void Kernel_expandAVX512 ( Pixel* dst, const uint8_t* idx, const Pixel* pal, int32_t n )
+	{
+		__m512i v;
+		int32_t i;
+
+		for ( i = 0; i + 16 <= n; i += 16 )
+		{
+			v = _mm512_cvtepu8_epi32( _mm_loadu_si128( ( const __m128i* ) ( idx + i ) ) );
+
+			_mm512_storeu_si512( dst + i, _mm512_i32gather_epi32( v, pal, 4 ) );
+		}
+
+		Kernel_expandScalar( dst + i, idx + i, pal, n - i );
+	}
+
+	PGE_TARGET_AVX512 static void Kernel_scaleAVX512 ( Pixel* dst, const Pixel* src, uint32_t u, uint32_t du, int32_t n )
+	{
+		__m512i   vu;
+		__m512i   vstep;
+		__mmask16 k;
+		int32_t   i;
+
+		vu    = _mm512_add_epi32( _mm512_set1_epi32( ( int32_t ) u ), _mm512_mullo_epi32( _mm512_set1_epi32( ( int32_t ) du ), _mm512_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 ) ) );
+		vstep = _mm512_set1_epi32( ( int32_t ) ( du * 16 ) );
+
+		for ( i = 0; i < n; i += 16 )
+		{
+			k = Kernel_tailAVX512( n - i );
+
+			_mm512_mask_storeu_epi32( dst + i, k, _mm512_mask_i32gather_epi32( _mm512_setzero_si512(), k, _mm512_srli_epi32( vu, 16 ), src, 4 ) );
+
+			vu = _mm512_add_epi32( vu, vstep );
+		}
+	}
+
+	PGE_TARGET_AVX512 static void Kernel_nearestAVX512 ( Pixel* dst, const Sprite* sp, uint32_t u, uint32_t v, uint32_t du, uint32_t dv, int32_t n )
+	{
+		__m512i   lane;
+		__m512i   vu;
+		__m512i   vv;
+		__m512i   stepu;
+		__m512i   stepv;
+		__m512i   stride;
+		__m512i   idx;
+		__mmask16 k;
+		int32_t   i;
+
+		lane   = _mm512_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 );
+		vu     = _mm512_add_epi32( _mm512_set1_epi32( ( int32_t ) u ), _mm512_mullo_epi32( _mm512_set1_epi32( ( int32_t ) du ), lane ) );
+		vv     = _mm512_add_epi32( _mm512_set1_epi32( ( int32_t ) v ), _mm512_mullo_epi32( _mm512_set1_epi32( ( int32_t ) dv ), lane ) );
+		stepu  = _mm512_set1_epi32( ( int32_t ) ( du * 16 ) );
+		stepv  = _mm512_set1_epi32( ( int32_t ) ( dv * 16 ) );
+		stride = _mm512_set1_epi32( sp->nStride );
+
+		for ( i = 0; i < n; i += 16 )
+		{
+			k   = Kernel_tailAVX512( n - i );
+			idx = _mm512_add_epi32( _mm512_mullo_epi32( _mm512_srli_epi32( vv, 16 ), stride ), _mm512_srli_epi32( vu, 16 ) );
+
+			_mm512_mask_storeu_epi32( dst + i, k, _mm512_mask_i32gather_epi32( _mm512_setzero_si512(), k, idx, sp->pColData, 4 ) );
+
+			vu = _mm512_add_epi32( vu, stepu );
+			vv = _mm512_add_epi32( vv, stepv );
+		}
+	}
+
+#endif
+
+
+// Variants by CPU level, NULL where a level brings nothing for a kernel
+#ifdef PGE_SSE2
+	#define PGE_IF_SSE2( f ) f
+#else
+	#define PGE_IF_SSE2( f ) NULL
+#endif
+
+#ifdef PGE_AVX
+	#define PGE_IF_AVX( f ) f
+#else
+	#define PGE_IF_AVX( f ) NULL
+#endif
+
+static const PGE_FillFunc Kernel_fillVariants [ CPU_LEVELS ] = {
+
+	Kernel_fillScalar, PGE_IF_SSE2( Kernel_fillSSE2 ), PGE_IF_AVX( Kernel_fillAVX2 ), PGE_IF_AVX( Kernel_fillAVX512 )
+};
+
+static const PGE_SpanFunc Kernel_blitVariants [ CPU_LEVELS ] = {
+
+	Kernel_blitScalar, PGE_IF_SSE2( Kernel_blitSSE2 ), PGE_IF_AVX( Kernel_blitAVX2 ), PGE_IF_AVX( Kernel_blitAVX512 )
+};
+
+static const PGE_SpanFunc Kernel_blendVariants [ CPU_LEVELS ] = {
+
+	Kernel_blendScalar, PGE_IF_SSE2( Kernel_blendSSE2 ), PGE_IF_AVX( Kernel_blendAVX2 ), PGE_IF_AVX( Kernel_blendAVX512 )
+};
+
+static const PGE_SpanFunc Kernel_addVariants [ CPU_LEVELS ] = {
+
+	Kernel_addScalar, PGE_IF_SSE2( Kernel_addSSE2 ), PGE_IF_AVX( Kernel_addAVX2 ), PGE_IF_AVX( Kernel_addAVX512 )
+};
+
+// SSE2 has no gather, so has nothing over the scalar loops here
+static const PGE_ExpandFunc Kernel_expandVariants [ CPU_LEVELS ] = {
+
+	Kernel_expandScalar, NULL, PGE_IF_AVX( Kernel_expandAVX2 ), PGE_IF_AVX( Kernel_expandAVX512 )
+};
+
+static const PGE_ScaleFunc Kernel_scaleVariants [ CPU_LEVELS ] = {
+
+	Kernel_scaleScalar, NULL, PGE_IF_AVX( Kernel_scaleAVX2 ), PGE_IF_AVX( Kernel_scaleAVX512 )
+};
+
+static const PGE_AffineFunc Kernel_nearestVariants [ CPU_LEVELS ] = {
+
+	Kernel_nearestScalar, PGE_IF_SSE2( Kernel_nearestSSE2 ), PGE_IF_AVX( Kernel_nearestAVX2 ), PGE_IF_AVX( Kernel_nearestAVX512 )
+};
+
+// The AVX2 filter already outruns its gathers, so AVX-512 adds nothing
+static const PGE_AffineFunc Kernel_bilinearVariants [ CPU_LEVELS ] = {
+
+	Kernel_bilinearScalar, PGE_IF_SSE2( Kernel_bilinearSSE2 ), PGE_IF_AVX( Kernel_bilinearAVX2 ), NULL
+};
+
+// Scalar until PGE_resolveKernels runs
+static Kernels pgeKernels = {
+
+	.fill     = Kernel_fillScalar,
+	.blit     = Kernel_blitScalar,
+	.blend    = Kernel_blendScalar,
+	.add      = Kernel_addScalar,
+	.expand   = Kernel_expandScalar,
+	.scale    = Kernel_scaleScalar,
+	.nearest  = Kernel_nearestScalar,
+	.bilinear = Kernel_bilinearScalar,
+	.levels   = { CPU_SCALAR }
+};
+
+// 0 until resolved, 1 while a thread resolves, then 2, see PGE_resolveKernels
+static uint32_t nKernelsState = 0;
+
+// The highest level both the CPU and the OS, which must save the wider registers, support
+static int32_t PGE_getCpuLevel ( void )
+{
+	#if defined( PGE_AVX ) && defined( _MSC_VER )
+
+		int      regs [ 4 ];
+		uint64_t xcr0;
+		bool     bAVX2;
+		bool     bAVX512;
+
+		__cpuid( regs, 1 );
+
+		// OSXSAVE
+		if ( ! ( regs[ 2 ] & ( 1 << 27 ) ) )
+		{
+			return CPU_SSE2;
+		}
+
+		xcr0 = _xgetbv( 0 );
+
+		__cpuidex( regs, 7, 0 );
+
+		bAVX2   = ( regs[ 1 ] & ( 1 << 5 ) ) && ( xcr0 & 0x06 ) == 0x06;
+		bAVX512 = ( regs[ 1 ] & ( 1 << 16 ) ) && ( regs[ 1 ] & ( 1 << 30 ) ) && ( xcr0 & 0xE6 ) == 0xE6;
+
+		return bAVX512 && bAVX2 ? CPU_AVX512 : bAVX2 ? CPU_AVX2 : CPU_SSE2;
+
+	#elif defined( PGE_AVX )
+
+		__builtin_cpu_init();
+
+		if ( __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports( "avx512bw" ) && __builtin_cpu_supports( "avx2" ) )
+		{
+			return CPU_AVX512;
+		}
+
+		return __builtin_cpu_supports( "avx2" ) ? CPU_AVX2 : CPU_SSE2;
+
+	#elif defined( PGE_SSE2 )
+
+		return CPU_SSE2;
+
+	#else
+
+		return CPU_SCALAR;
+
+	#endif
+}
+
+// Index of the n character name s in names, or -1
+static int32_t PGE_findName ( const char* const* names, int32_t count, const char* s, size_t n )
+{
+	int32_t i;
+
+	for ( i = 0; i < count; i += 1 )
+	{
+		if ( strlen( names[ i ] ) == n && strncmp( names[ i ], s, n ) == 0 )
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/* PGE_KERNELS is a comma separated list. A bare level caps every
+   kernel, "kernel=level" caps one, and later entries win, so
+   "sse2,blend=avx512" runs blending at its best and the rest on SSE2.
+*/
+static void PGE_readKernelOverrides ( int32_t caps [ KERNEL_COUNT ] )
+{
+	const char* p;
+	const char* end;
+	const char* eq;
+	int32_t     nKernel;
+	int32_t     nLevel;
+	int32_t     i;
+
+	p = getenv( "PGE_KERNELS" );
+
+	while ( p && *p )
+	{
+		end = strchr( p, ',' );
+		end = end ? end : p + strlen( p );
+		eq  = memchr( p, '=', end - p );
+
+		if ( eq )
+		{
+			nKernel = PGE_findName( PGE_kernelNames, KERNEL_COUNT, p, eq - p );
+			nLevel  = PGE_findName( PGE_cpuLevelNames, CPU_LEVELS, eq + 1, end - eq - 1 );
+
+			if ( nKernel >= 0 && nLevel >= 0 )
+			{
+				caps[ nKernel ] = nLevel;
+			}
+		}
+		else
+		{
+			nLevel = PGE_findName( PGE_cpuLevelNames, CPU_LEVELS, p, end - p );
+
+			for ( i = 0; i < KERNEL_COUNT && nLevel >= 0; i += 1 )
+			{
+				caps[ i ] = nLevel;
+			}
+		}
+
+		p = *end ? end + 1 : end;
+	}
+}
+
+/* Runs once per process. Contexts may be constructed on several threads
+   at once, so the first to get here resolves, and the rest wait until the
+   table is published.
+*/
+static void PGE_resolveKernels ( void )
+{
+	Kernels k;
+	int32_t caps [ KERNEL_COUNT ];
+	bool    has  [ KERNEL_COUNT ][ CPU_LEVELS ];
+	int32_t nCpu;
+	int32_t i;
+	int32_t j;
+
+	if ( PGE_ATOMIC_LOAD( &nKernelsState ) == 2 )
+	{
+		return;
+	}
+
+	if ( ! PGE_ATOMIC_CAS( &nKernelsState, 0, 1 ) )
+	{
+		while ( PGE_ATOMIC_LOAD( &nKernelsState ) != 2 )
+		{
+			PGE_SLEEP_MS( 0 );
+		}
+
+		return;
+	}
+
+	nCpu = PGE_getCpuLevel();
+
+	for ( i = 0; i < KERNEL_COUNT; i += 1 )
+	{
+		caps[ i ] = CPU_LEVELS - 1;
+	}
+
+	PGE_readKernelOverrides( caps );
+
+	for ( j = 0; j < CPU_LEVELS; j += 1 )
+	{
+		has[ KERNEL_FILL     ][ j ] = Kernel_fillVariants    [ j ] != NULL;
+		has[ KERNEL_BLIT     ][ j ] = Kernel_blitVariants    [ j ] != NULL;
+		has[ KERNEL_BLEND    ][ j ] = Kernel_blendVariants   [ j ] != NULL;
+		has[ KERNEL_ADD      ][ j ] = Kernel_addVariants     [ j ] != NULL;
+		has[ KERNEL_EXPAND   ][ j ] = Kernel_expandVariants  [ j ] != NULL;
+		has[ KERNEL_SCALE    ][ j ] = Kernel_scaleVariants   [ j ] != NULL;
+		has[ KERNEL_NEAREST  ][ j ] = Kernel_nearestVariants [ j ] != NULL;
+		has[ KERNEL_BILINEAR ][ j ] = Kernel_bilinearVariants[ j ] != NULL;
+	}
+
+	// Best available at or below both the CPU's level and any cap
+	for ( i = 0; i < KERNEL_COUNT; i += 1 )
+	{
+		j = caps[ i ] < nCpu ? caps[ i ] : nCpu;
+
+		while ( j > 0 && ! has[ i ][ j ] )
+		{
+			j -= 1;
+		}
+
+		k.levels[ i ] = j;
+	}
+
+	k.fill     = Kernel_fillVariants    [ k.levels[ KERNEL_FILL     ] ];
+	k.blit     = Kernel_blitVariants    [ k.levels[ KERNEL_BLIT     ] ];
+	k.blend    = Kernel_blendVariants   [ k.levels[ KERNEL_BLEND    ] ];
+	k.add      = Kernel_addVariants     [ k.levels[ KERNEL_ADD      ] ];
+	k.expand   = Kernel_expandVariants  [ k.levels[ KERNEL_EXPAND   ] ];
+	k.scale    = Kernel_scaleVariants   [ k.levels[ KERNEL_SCALE    ] ];
+	k.nearest  = Kernel_nearestVariants [ k.levels[ KERNEL_NEAREST  ] ];
+	k.bilinear = Kernel_bilinearVariants[ k.levels[ KERNEL_BILINEAR ] ];
+
+	pgeKernels = k;
+
+	PGE_ATOMIC_STORE( &nKernelsState, 2 );
+}
+
+int32_t PGE_getKernelCount ( void )
+{
+	return KERNEL_COUNT;
+}
+
+const char* PGE_getKernelName ( int32_t i )
+{
+	return i >= 0 && i < KERNEL_COUNT ? PGE_kernelNames[ i ] : NULL;
+}
+
+const char* PGE_getKernelVariant ( int32_t i )
+{
+	return i >= 0 && i < KERNEL_COUNT ? PGE_cpuLevelNames[ pgeKernels.levels[ i ] ] : NULL;
+}
+
+
+//================================================================================
+
+// Pixels are left uninitialised, see Sprite_initPixels
+static Sprite* Sprite_alloc ( int32_t w, int32_t h )
+{
+	Sprite* sp;
+
+	sp = ( Sprite* ) malloc( sizeof( Sprite ) );
+
+	sp->width   = w;
+	sp->height  = h;
+	sp->nStride = w;
+
+	sp->pColData  = ( Pixel* ) malloc( w * h * sizeof( Pixel ) );
+	sp->bOwnsData = true;
+
+	return sp;
+}
+
+static void Sprite_initPixels ( Sprite* sp )
+{
+	Pixel p;
+
+	// Pixel_setRGB( &p, 0, 0, 0 );
+	Pixel_setRGB( &p, 0, 255, 0 );
+
+	pgeKernels.fill( sp->pColData, p, sp->width * sp->height );
+}
+
+Sprite* Sprite_new ( int32_t w, int32_t h )
+{
+	Sprite* sp;
+
+	sp = Sprite_alloc( w, h );
+
+	Sprite_initPixels( sp );
+
+	return sp;
+}
+
+Sprite* Sprite_newView ( Sprite* parent, int32_t x, int32_t y, int32_t w, int32_t h )
+{
+	Sprite* sp;
+
+	if ( ! parent )
+	{
+		return NULL;
+	}
+
+	if ( x < 0 ) { w += x; x = 0; }
+	if ( y < 0 ) { h += y; y = 0; }
+	if ( x + w > parent->width )  { w = parent->width  - x; }
+	if ( y + h > parent->height ) { h = parent->height - y; }
+
+	if ( w <= 0 || h <= 0 )
+	{
+		return NULL;
+	}
+
+	sp = ( Sprite* ) malloc( sizeof( Sprite ) );
+
+	sp->width     = w;
+	sp->height    = h;
+	sp->nStride   = parent->nStride;
+	sp->pColData  = parent->pColData + y * parent->nStride + x;
+	sp->bOwnsData = false;
+
+	return sp;
+}
+
+// Forgets the clip stack left on sp, before its address can be reused
+static void PGE_dropClipState ( Sprite* sp )
+{
+	int32_t i;
+
+	for ( i = 0; i < pCtx->nClipStates; i += 1 )
+	{
+		if ( pCtx->pClipStates[ i ].pTarget == sp )
+		{
+			free( pCtx->pClipStates[ i ].pClips );
+
+			pCtx->nClipStates -= 1;
+			pCtx->pClipStates[ i ] = pCtx->pClipStates[ pCtx->nClipStates ];
+
+			return;
+		}
+	}
+}
+
+void Sprite_free ( Sprite* sp )
+{
+	PGE_dropClipState( sp );
+
+	if ( sp->bOwnsData )
+	{
+		free( sp->pColData );
+	}
+
+	free( sp );
+
+	sp = NULL;
+}
+
+static Pixel* Sprite_getData ( Sprite* sp )
+{
+	return sp->pColData;
+}
+
+
+//================================================================================
+
+/* Image loading.
+   Decoders read through a small buffered reader and write straight
+   into the pColData of the sprite being loaded. Only a row or two of
+   scratch space is ever needed on top of the final pixels.
+*/
+
+#define FILEREADER_BUFSIZE 16384
+
+struct _FileReader
+{
+	FILE*    f;
+	uint8_t  buf [ FILEREADER_BUFSIZE ];
+	uint32_t nPos;
+	uint32_t nLen;
+};
+
+typedef struct _FileReader FileReader;
+
+static int FileReader_getByte ( FileReader* fr )
+{
+	if ( fr->nPos == fr->nLen )
+	{
+		fr->nLen = ( uint32_t ) fread( fr->buf, 1, FILEREADER_BUFSIZE, fr->f );
+		fr->nPos = 0;
+
+		if ( fr->nLen == 0 )
+		{
+			return - 1;
+		}
+	}
+
+	return fr->buf[ fr->nPos++ ];
+}
+
+static bool FileReader_read ( FileReader* fr, void* dst, uint32_t n )
+{
+	uint8_t* pDst;
+	uint32_t nAvail;
+
+	pDst   = ( uint8_t* ) dst;
+	nAvail = fr->nLen - fr->nPos;
+
+	if ( nAvail >= n )
+	{
+		memcpy( pDst, fr->buf + fr->nPos, n );
+
+		fr->nPos += n;
+
+		return true;
+	}
+
+	memcpy( pDst, fr->buf + fr->nPos, nAvail );
+
+	pDst    += nAvail;
+	n       -= nAvail;
+	fr->nPos = fr->nLen;
+
+	// Large reads bypass the buffer
+	if ( n >= FILEREADER_BUFSIZE )
+	{
+		return fread( pDst, 1, n, fr->f ) == n;
+	}
+
+	fr->nLen = ( uint32_t ) fread( fr->buf, 1, FILEREADER_BUFSIZE, fr->f );
+	fr->nPos = 0;
+
+	if ( fr->nLen < n )
+	{
+		return false;
+	}
+
+	memcpy( pDst, fr->buf, n );
+
+	fr->nPos = n;
+
+	return true;
+}
+
+static bool FileReader_skip ( FileReader* fr, uint32_t n )
+{
+	while ( n > 0 )
+	{
+		if ( FileReader_getByte( fr ) < 0 )
+		{
+			return false;
+		}
+
+		n -= 1;
+	}
+
+	return true;
+}
+
+static uint32_t readU32BE ( const uint8_t* p )
+{
+	return ( ( uint32_t ) p[ 0 ] << 24 ) | ( ( uint32_t ) p[ 1 ] << 16 ) |
+	       ( ( uint32_t ) p[ 2 ] <<  8 ) |   ( uint32_t ) p[ 3 ];
+}
+
+static uint32_t readU32LE ( const uint8_t* p )
+{
+	return ( ( uint32_t ) p[ 3 ] << 24 ) | ( ( uint32_t ) p[ 2 ] << 16 ) |
+	       ( ( uint32_t ) p[ 1 ] <<  8 ) |   ( uint32_t ) p[ 0 ];
+}
+
+static uint16_t readU16LE ( const uint8_t* p )
+{
+	return ( uint16_t ) ( p[ 0 ] | ( p[ 1 ] << 8 ) );
+}
+
+// Rejects sizes whose pixel buffer would not fit in memory
+static Pixel* allocPixels ( uint32_t w, uint32_t h )
+{
+	if ( w == 0 || h == 0 || w > 32768 || h > 32768 )
+	{
+		return NULL;
+	}
+
+	return ( Pixel* ) malloc( ( size_t ) w * h * sizeof( Pixel ) );
+}
+
+static void PGE_recordLoad ( const char* sName, int32_t w, int32_t h, double tStart )
+{
+	LoadStat* ls;
+
+	ls = ( LoadStat* ) malloc( sizeof( LoadStat ) );
+
+	ls->sName    = strdup( sName );
+	ls->width    = w;
+	ls->height   = h;
+	ls->fSeconds = ( float ) ( PGE_getTime() - tStart );
+
+	PGE_lockLoadStats( pCtx, true );
+
+	// Entries are allocated one by one so pointers handed out stay valid
+	if ( pCtx->nLoadStats == pCtx->nLoadStatsCap )
+	{
+		pCtx->nLoadStatsCap = pCtx->nLoadStatsCap ? pCtx->nLoadStatsCap * 2 : 64;
+		pCtx->ppLoadStats   = ( LoadStat** ) realloc( pCtx->ppLoadStats, pCtx->nLoadStatsCap * sizeof( LoadStat* ) );
+	}
+
+	pCtx->ppLoadStats[ pCtx->nLoadStats ] = ls;
+	pCtx->nLoadStats += 1;
+
+	PGE_lockLoadStats( pCtx, false );
+}
+
+int32_t PGE_getLoadStatCount ( void )
+{
+	int32_t n;
+
+	PGE_lockLoadStats( pCtx, true );
+	n = pCtx->nLoadStats;
+	PGE_lockLoadStats( pCtx, false );
+
+	return n;
+}
+
+const LoadStat* PGE_getLoadStat ( int32_t i )
+{
+	const LoadStat* ls;
+
+	PGE_lockLoadStats( pCtx, true );
+	ls = i >= 0 && i < pCtx->nLoadStats ? pCtx->ppLoadStats[ i ] : NULL;
+	PGE_lockLoadStats( pCtx, false );
+
+	return ls;
+}
+
+void PGE_clearLoadStats ( void )
+{
+	int32_t i;
+
+	PGE_lockLoadStats( pCtx, true );
+
+	for ( i = 0; i < pCtx->nLoadStats; i += 1 )
+	{
+		free( ( char* ) pCtx->ppLoadStats[ i ]->sName );
+		free( pCtx->ppLoadStats[ i ] );
+	}
+
+	free( pCtx->ppLoadStats );
+
+	pCtx->ppLoadStats   = NULL;
+	pCtx->nLoadStats    = 0;
+	pCtx->nLoadStatsCap = 0;
+
+	PGE_lockLoadStats( pCtx, false );
+}
+
+
+// BMP ---------------------------------------------------------------------------
+
+/* Supports uncompressed 8 bit (palettised), 24 bit and 32 bit images.
+   Each row is read into the start of its destination row and
+   expanded in place, backwards when the source is narrower.
+   Bit field images must use the usual BGRA masks, and take their alpha
+   from the fourth byte unless the header gives an alpha mask of 0.
+*/
+static Pixel* BMP_decode ( FileReader* fr, uint32_t* pw, uint32_t* ph )
+{
+	uint8_t  hdr [ 70 ];
+	uint8_t  pal [ 256 * 4 ];
+	uint8_t  pad [ 4 ];
+	uint32_t dataOffset;
+	uint32_t dibSize;
+	int32_t  w;
+	int32_t  h;
+	uint16_t bpp;
+	uint32_t compression;
+	uint32_t nColours;
+	uint32_t nRowBytes;
+	uint32_t nPad;
+	uint32_t nRead;
+	uint32_t nMasks;
+	bool     bTopDown;
+	bool     bAlpha;
+	Pixel*   pixels;
+	uint8_t* row;
+	int32_t  x;
+	int32_t  y;
+
+	// Magic ("BM") has already been consumed
+	if ( ! FileReader_read( fr, hdr + 2, 52 ) )
+	{
+		return NULL;
+	}
+
+	dataOffset  = readU32LE( hdr + 10 );
+	dibSize     = readU32LE( hdr + 14 );
+	w           = ( int32_t ) readU32LE( hdr + 18 );
+	h           = ( int32_t ) readU32LE( hdr + 22 );
+	bpp         = readU16LE( hdr + 28 );
+	compression = readU32LE( hdr + 30 );
+	nColours    = readU32LE( hdr + 46 );
+
+	bTopDown = h < 0;
+	bAlpha   = compression == 3;
+
+	// Negating INT32_MIN would overflow, and no such image fits anyway
+	if ( h == INT32_MIN )
+	{
+		return NULL;
+	}
+
+	if ( bTopDown )
+	{
+		h = - h;
+	}
+
+	// Only BI_RGB, or BI_BITFIELDS, with the pixels after the headers
+	if ( dibSize < 40 || dibSize > dataOffset || dataOffset - dibSize < 14 || w <= 0 ||
+	     ( bpp != 8 && bpp != 24 && bpp != 32 ) ||
+	     ! ( compression == 0 || ( compression == 3 && bpp == 32 ) ) )
+	{
+		return NULL;
+	}
+
+	nRead = 54;
+
+	// Red, green and blue masks follow a 40 byte header, and are part of larger ones, which add alpha
+	if ( compression == 3 )
+	{
+		nMasks = dibSize >= 56 ? 4 : 3;
+
+		if ( ! FileReader_read( fr, hdr + 54, nMasks * 4 ) ||
+		     readU32LE( hdr + 54 ) != 0x00FF0000 ||
+		     readU32LE( hdr + 58 ) != 0x0000FF00 ||
+		     readU32LE( hdr + 62 ) != 0x000000FF ||
+		     ( nMasks == 4 && readU32LE( hdr + 66 ) != 0xFF000000 && readU32LE( hdr + 66 ) != 0 ) )
+		{
+			return NULL;
+		}
+
+		bAlpha = nMasks == 3 || readU32LE( hdr + 66 ) != 0;
+		nRead += nMasks * 4;
+	}
+
+	if ( bpp == 8 )
+	{
+		if ( nColours == 0 || nColours > 256 )
+		{
+			nColours = 256;
+		}
+
+		// The palette lies between the headers and the pixels
+		if ( dataOffset - 14 - dibSize < nColours * 4 )
+		{
+			return NULL;
+		}
+
+		// Indices past the palette read as transparent black
+		memset( pal, 0, sizeof( pal ) );
+
+		if ( ! FileReader_skip( fr, 14 + dibSize - nRead ) ||
+		     ! FileReader_read( fr, pal, nColours * 4 ) )
+		{
+			return NULL;
+		}
+
+		nRead = 14 + dibSize + nColours * 4;
+	}
+
+	if ( dataOffset < nRead || ! FileReader_skip( fr, dataOffset - nRead ) )
+	{
+		return NULL;
+	}
+
+	pixels = allocPixels( w, h );
+
+	if ( ! pixels )
+	{
+		return NULL;
+	}
+
+	nRowBytes = w * ( bpp / 8 );
+	nPad      = ( 4 - ( nRowBytes & 3 ) ) & 3;
+
+	for ( y = 0; y < h; y += 1 )
+	{
+		Pixel* dst;
+
+		dst = pixels + ( bTopDown ? y : h - 1 - y ) * w;
+		row = ( uint8_t* ) dst;
+
+		if ( ! FileReader_read( fr, row, nRowBytes ) ||
+		     ! FileReader_read( fr, pad, nPad ) )
+		{
+			free( pixels );
+
+			return NULL;
+		}
+
+		if ( bpp == 32 )
+		{
+			for ( x = 0; x < w; x += 1 )
+			{
+				uint8_t* s = row + x * 4;
+				uint8_t  b = s[ 0 ];
+				uint8_t  r = s[ 2 ];
+
+				dst[ x ].r = r;
+				dst[ x ].b = b;
+				dst[ x ].a = bAlpha ? s[ 3 ] : 255;
+			}
+		}
+		else if ( bpp == 24 )
+		{
+			// Backwards, so no source byte is overwritten before it is read
+			for ( x = w - 1; x >= 0; x -= 1 )
+			{
+				uint8_t* s = row + x * 3;
+				uint8_t  r = s[ 2 ];
+				uint8_t  g = s[ 1 ];
+				uint8_t  b = s[ 0 ];
+
+				dst[ x ].r = r;
+				dst[ x ].g = g;
+				dst[ x ].b = b;
+				dst[ x ].a = 255;
+			}
+		}
+		else
+		{
+			for ( x = w - 1; x >= 0; x -= 1 )
+			{
+				uint8_t* c = pal + row[ x ] * 4;
+
+				dst[ x ].r = c[ 2 ];
+				dst[ x ].g = c[ 1 ];
+				dst[ x ].b = c[ 0 ];
+				dst[ x ].a = 255;
+			}
+		}
+	}
+
+	*pw = w;
+	*ph = h;
+
+	return pixels;
+}
+
+
+// QOI ---------------------------------------------------------------------------
+
+/* https://qoiformat.org/qoi-specification.pdf
+   Files that end early, or without the end marker, are rejected.
+*/
+static Pixel* QOI_decode ( FileReader* fr, uint32_t* pw, uint32_t* ph )
+{
+	static const uint8_t endMarker [ 8 ] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+	uint8_t  hdr [ 10 ];
+	uint8_t  bytes [ 8 ];
+	Pixel    index [ 64 ];
+	Pixel    px;
+	Pixel*   pixels;
+	uint32_t w;
+	uint32_t h;
+	uint32_t i;
+	uint32_t nPixels;
+	int      run;
+	int      b1;
+	int      b2;
+	int      vg;
+
+	// Magic ("qoif") has already been consumed
+	if ( ! FileReader_read( fr, hdr, 10 ) )
+	{
+		return NULL;
+	}
+
+	w = readU32BE( hdr + 0 );
+	h = readU32BE( hdr + 4 );
+
+	pixels = allocPixels( w, h );
+
+	if ( ! pixels )
+	{
+		return NULL;
+	}
+
+	memset( index, 0, sizeof( index ) );
+
+	px.r = 0;
+	px.g = 0;
+	px.b = 0;
+	px.a = 255;
+
+	run     = 0;
+	nPixels = w * h;
+
+	for ( i = 0; i < nPixels; i += 1 )
+	{
+		if ( run > 0 )
+		{
+			run -= 1;
+		}
+		else
+		{
+			b1 = FileReader_getByte( fr );
+
+			if ( b1 < 0 ||
+			     ( b1 == 0xFE && ! FileReader_read( fr, bytes, 3 ) ) ||
+			     ( b1 == 0xFF && ! FileReader_read( fr, bytes, 4 ) ) )
+			{
+				free( pixels );
+
+				return NULL;
+			}
+
+			if ( b1 == 0xFE )  // QOI_OP_RGB
+			{
+				px.r = bytes[ 0 ];
+				px.g = bytes[ 1 ];
+				px.b = bytes[ 2 ];
+			}
+			else if ( b1 == 0xFF )  // QOI_OP_RGBA
+			{
+				px.r = bytes[ 0 ];
+				px.g = bytes[ 1 ];
+				px.b = bytes[ 2 ];
+				px.a = bytes[ 3 ];
+			}
+			else if ( ( b1 & 0xC0 ) == 0x00 )  // QOI_OP_INDEX
+			{
+				px = index[ b1 ];
+			}
+			else if ( ( b1 & 0xC0 ) == 0x40 )  // QOI_OP_DIFF
+			{
+				px.r += ( ( b1 >> 4 ) & 0x03 ) - 2;
+				px.g += ( ( b1 >> 2 ) & 0x03 ) - 2;
+				px.b += (   b1        & 0x03 ) - 2;
+			}
+			else if ( ( b1 & 0xC0 ) == 0x80 )  // QOI_OP_LUMA
+			{
+				b2 = FileReader_getByte( fr );
+				vg = ( b1 & 0x3F ) - 32;
+
+				if ( b2 < 0 )
+				{
+					free( pixels );
+
+					return NULL;
+				}
+
+				px.r += vg - 8 + ( ( b2 >> 4 ) & 0x0F );
+				px.g += vg;
+				px.b += vg - 8 + (   b2        & 0x0F );
+			}
+			else  // QOI_OP_RUN
+			{
+				run = b1 & 0x3F;
+			}
+
+			index[ ( px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11 ) % 64 ] = px;
+		}
+
+		pixels[ i ] = px;
+	}
+
+	if ( ! FileReader_read( fr, bytes, 8 ) || memcmp( bytes, endMarker, 8 ) != 0 )
+	{
+		free( pixels );
+
+		return NULL;
+	}
+
+	*pw = w;
+	*ph = h;
+
+	return pixels;
+}
+
+
+// PNG ---------------------------------------------------------------------------
+
+/* Non-interlaced images of every colour type and bit depth.
+   IDAT data is inflated as it is read from the file, and every
+   completed scanline is unfiltered and converted into its row of
+   pixels. Sixteen bit samples keep their high byte.
+*/
+
+#define PNG_FAST_BITS 9
+
+struct _Huffman
+{
+	uint16_t fast    [ 1 << PNG_FAST_BITS ];  // ( length << 9 ) | symbol, 0 for longer codes
+	uint16_t counts  [ 16 ];                  // number of codes of each length
+	uint16_t symbols [ 288 ];                 // symbols in canonical code order
+};
+
+typedef struct _Huffman Huffman;
+
+struct _PngDecoder
+{
+	FileReader* fr;
+	uint32_t    nChunkLeft;  // IDAT bytes left in the current chunk
+	bool        bIdatDone;
+
+	// Inflate
+	uint32_t bitBuf;
+	int32_t  nBits;
+	int32_t  nOverrun;  // zero bytes fed past the end of the stream
+	uint8_t  window [ 32768 ];
+	uint32_t nOut;
+	Huffman  lit;
+	Huffman  dist;
+
+	// Scanlines
+	uint32_t width;
+	uint32_t height;
+	uint8_t  bitDepth;
+	uint8_t  colourType;
+	uint32_t nChannels;
+	uint32_t nRowBytes;
+	uint32_t nBpp;       // bytes per complete pixel, at least 1
+	uint8_t* pCurRow;    // filter type byte followed by nRowBytes
+	uint8_t* pPrevRow;
+	uint32_t nRowPos;
+	uint32_t y;
+	Pixel    palette [ 256 ];
+	Pixel*   pixels;
+};
+
+typedef struct _PngDecoder PngDecoder;
+
+static const uint16_t pngLengthBase  [ 29 ] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t  pngLengthExtra [ 29 ] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t pngDistBase    [ 30 ] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t  pngDistExtra   [ 30 ] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Next byte of zlib data, moving across IDAT chunk boundaries as needed
+static int PNG_nextByte ( PngDecoder* png )
+{
+	uint8_t hdr [ 12 ];
+
+	while ( png->nChunkLeft == 0 )
+	{
+		// CRC of the previous chunk, then the next chunk's length and type
+		if ( png->bIdatDone || ! FileReader_read( png->fr, hdr, 12 ) ||
+		     memcmp( hdr + 8, "IDAT", 4 ) != 0 )
+		{
+			png->bIdatDone = true;
+
+			return - 1;
+		}
+
+		png->nChunkLeft = readU32BE( hdr + 4 );
+	}
+
+	png->nChunkLeft -= 1;
+
+	return FileReader_getByte( png->fr );
+}
+
+static uint32_t PNG_getBits ( PngDecoder* png, int32_t n )
+{
+	uint32_t v;
+	int      b;
+
+	while ( png->nBits < n )
+	{
+		b = PNG_nextByte( png );
+
+		if ( b < 0 )
+		{
+			b = 0;
+
+			png->nOverrun += 1;
+		}
+
+		png->bitBuf |= ( uint32_t ) b << png->nBits;
+		png->nBits  += 8;
+	}
+
+	v = png->bitBuf & ( ( 1u << n ) - 1 );
+
+	png->bitBuf >>= n;
+	png->nBits   -= n;
+
+	return v;
+}
+
+static bool Huffman_build ( Huffman* h, const uint8_t* lengths, int32_t n )
+{
+	uint16_t offsets [ 16 ];
+	uint32_t code;
+	uint32_t rev;
+	int32_t  len;
+	int32_t  i;
+	int32_t  k;
+	int32_t  sym;
+
+	memset( h->fast,   0, sizeof( h->fast ) );
+	memset( h->counts, 0, sizeof( h->counts ) );
+
+	for ( i = 0; i < n; i += 1 )
+	{
+		h->counts[ lengths[ i ] ] += 1;
+	}
+
+	h->counts[ 0 ] = 0;
+
+	offsets[ 1 ] = 0;
+
+	for ( len = 1; len < 15; len += 1 )
+	{
+		offsets[ len + 1 ] = offsets[ len ] + h->counts[ len ];
+	}
+
+	for ( i = 0; i < n; i += 1 )
+	{
+		if ( lengths[ i ] )
+		{
+			h->symbols[ offsets[ lengths[ i ] ] ] = i;
+
+			offsets[ lengths[ i ] ] += 1;
+		}
+	}
+
+	// Codes no longer than PNG_FAST_BITS get a direct lookup entry
+	code = 0;
+	k    = 0;
+
+	for ( len = 1; len <= 15; len += 1 )
+	{
+		for ( i = 0; i < h->counts[ len ]; i += 1 )
+		{
+			sym = h->symbols[ k ];
+			k  += 1;
+
+			if ( code >= ( 1u << len ) )
+			{
+				return false;  // over-subscribed
+			}
+
+			if ( len <= PNG_FAST_BITS )
+			{
+				uint32_t j;
+
+				// Deflate packs codes most significant bit first
+				rev = 0;
+
+				for ( j = 0; j < ( uint32_t ) len; j += 1 )
+				{
+					rev |= ( ( code >> j ) & 1 ) << ( len - 1 - j );
+				}
+
+				for ( j = rev; j < ( 1u << PNG_FAST_BITS ); j += 1u << len )
+				{
+					h->fast[ j ] = ( uint16_t ) ( ( len << 9 ) | sym );
+				}
+			}
+
+			code += 1;
+		}
+
+		code <<= 1;
+	}
+
+	return true;
+}
+
+static int32_t PNG_decodeSymbol ( PngDecoder* png, Huffman* h )
+{
+	uint16_t entry;
+	int32_t  code;
+	int32_t  first;
+	int32_t  index;
+	int32_t  len;
+
+	if ( png->nBits < PNG_FAST_BITS )
+	{
+		// Top up without consuming anything
+		while ( png->nBits <= 24 )
+		{
+			int b = PNG_nextByte( png );
+
+			if ( b < 0 )
+			{
+				b = 0;
+
+				png->nOverrun += 1;
+			}
+
+			png->bitBuf |= ( uint32_t ) b << png->nBits;
+			png->nBits  += 8;
+		}
+	}
+
+	entry = h->fast[ png->bitBuf & ( ( 1 << PNG_FAST_BITS ) - 1 ) ];
+
+	if ( entry )
+	{
+		png->bitBuf >>= entry >> 9;
+		png->nBits   -= entry >> 9;
+
+		return entry & 0x1FF;
+	}
+
+	// Slow path, one bit at a time
+	code  = 0;
+	first = 0;
+	index = 0;
+
+	for ( len = 1; len <= 15; len += 1 )
+	{
+		code |= PNG_getBits( png, 1 );
+
+		if ( code - first < h->counts[ len ] )
+		{
+			return h->symbols[ index + ( code - first ) ];
+		}
+
+		index += h->counts[ len ];
+		first += h->counts[ len ];
+		first <<= 1;
+		code  <<= 1;
+	}
+
+	return - 1;
+}
+
+static uint8_t PNG_paeth ( uint8_t a, uint8_t b, uint8_t c )
+{
+	int p  = a + b - c;
+	int pa = abs( p - a );
+	int pb = abs( p - b );
+	int pc = abs( p - c );
+
+	if ( pa <= pb && pa <= pc )
+	{
+		return a;
+	}
+	else if ( pb <= pc )
+	{
+		return b;
+	}
+	else
+	{
+		return c;
+	}
+}
+
+static uint8_t PNG_sample ( const uint8_t* row, uint32_t i, uint8_t depth )
+{
+	uint32_t bit;
+
+	if ( depth == 8 )
+	{
+		return row[ i ];
+	}
+	else if ( depth == 16 )
+	{
+		return row[ i * 2 ];
+	}
+
+	bit = i * depth;
+
+	return ( row[ bit >> 3 ] >> ( 8 - depth - ( bit & 7 ) ) ) & ( ( 1 << depth ) - 1 );
+}
+
+static void PNG_emitRow ( PngDecoder* png )
+{
+	uint8_t* row;
+	uint8_t* prev;
+	uint8_t  filter;
+	uint32_t bpp;
+	uint32_t i;
+	Pixel*   dst;
+	uint8_t  v;
+	uint8_t  scale;
+
+	filter = png->pCurRow[ 0 ];
+	row    = png->pCurRow  + 1;
+	prev   = png->pPrevRow + 1;
+	bpp    = png->nBpp;
+
+	switch ( filter )
+	{
+		case 1:  // Sub
+
+			for ( i = bpp; i < png->nRowBytes; i += 1 )
+			{
+				row[ i ] += row[ i - bpp ];
+			}
+			break;
+
+		case 2:  // Up
+
+			for ( i = 0; i < png->nRowBytes; i += 1 )
+			{
+				row[ i ] += prev[ i ];
+			}
+			break;
+
+		case 3:  // Average
+
+			for ( i = 0; i < png->nRowBytes; i += 1 )
+			{
+				row[ i ] += ( ( i >= bpp ? row[ i - bpp ] : 0 ) + prev[ i ] ) >> 1;
+			}
+			break;
+
+		case 4:  // Paeth
+
+			for ( i = 0; i < png->nRowBytes; i += 1 )
+			{
+				row[ i ] += PNG_paeth(
+
+					i >= bpp ? row[ i - bpp ]  : 0,
+					prev[ i ],
+					i >= bpp ? prev[ i - bpp ] : 0
+				);
+			}
+			break;
+
+		default:
+
+			break;
+	}
+
+
+	// Convert into the sprite's row
+	dst   = png->pixels + png->y * png->width;
+	scale = png->bitDepth < 8 ? 255 / ( ( 1 << png->bitDepth ) - 1 ) : 1;
+
+	if ( png->colourType == 3 && png->bitDepth == 8 )
+	{
+		pgeKernels.expand( dst, row, png->palette, png->width );
+	}
+
+	for ( i = 0; i < png->width; i += 1 )
+	{
+		uint32_t s = i * png->nChannels;
+
+		switch ( png->colourType )
+		{
+			case 0:  // Greyscale
+
+				v = PNG_sample( row, s, png->bitDepth ) * scale;
+
+				dst[ i ].r = v;
+				dst[ i ].g = v;
+				dst[ i ].b = v;
+				dst[ i ].a = 255;
+				break;
+
+			case 2:  // RGB
+
+				dst[ i ].r = PNG_sample( row, s + 0, png->bitDepth );
+				dst[ i ].g = PNG_sample( row, s + 1, png->bitDepth );
+				dst[ i ].b = PNG_sample( row, s + 2, png->bitDepth );
+				dst[ i ].a = 255;
+				break;
+
+			case 3:  // Palette, 8 bit rows are expanded above
+
+				if ( png->bitDepth < 8 )
+				{
+					dst[ i ] = png->palette[ PNG_sample( row, s, png->bitDepth ) ];
+				}
+				break;
+
+			case 4:  // Greyscale and alpha
+
+				v = PNG_sample( row, s, png->bitDepth );
+
+				dst[ i ].r = v;
+				dst[ i ].g = v;
+				dst[ i ].b = v;
+				dst[ i ].a = PNG_sample( row, s + 1, png->bitDepth );
+				break;
+
+			case 6:  // RGBA
+
+				dst[ i ].r = PNG_sample( row, s + 0, png->bitDepth );
+				dst[ i ].g = PNG_sample( row, s + 1, png->bitDepth );
+				dst[ i ].b = PNG_sample( row, s + 2, png->bitDepth );
+				dst[ i ].a = PNG_sample( row, s + 3, png->bitDepth );
+				break;
+		}
+	}
+
+
+	// This row is the next row's predecessor
+	row           = png->pPrevRow;
+	png->pPrevRow = png->pCurRow;
+	png->pCurRow  = row;
+	png->nRowPos  = 0;
+	png->y       += 1;
+}
+
+static void PNG_put ( PngDecoder* png, uint8_t b )
+{
+	png->window[ png->nOut & 32767 ] = b;
+	png->nOut += 1;
+
+	if ( png->y < png->height )
+	{
+		png->pCurRow[ png->nRowPos ] = b;
+		png->nRowPos += 1;
+
+		if ( png->nRowPos == png->nRowBytes + 1 )
+		{
+			PNG_emitRow( png );
+		}
+	}
+}
+
+static bool PNG_inflateBlock ( PngDecoder* png )
+{
+	int32_t  sym;
+	uint32_t len;
+	uint32_t dist;
+
+	while ( png->nOverrun <= 8 )
+	{
+		sym = PNG_decodeSymbol( png, &png->lit );
+
+		if ( sym < 0 )
+		{
+			return false;
+		}
+		else if ( sym < 256 )
+		{
+			PNG_put( png, ( uint8_t ) sym );
+		}
+		else if ( sym == 256 )
+		{
+			return true;
+		}
+		else
+		{
+			sym -= 257;
+
+			if ( sym >= 29 )
+			{
+				return false;
+			}
+
+			len = pngLengthBase[ sym ] + PNG_getBits( png, pngLengthExtra[ sym ] );
+			sym = PNG_decodeSymbol( png, &png->dist );
+
+			if ( sym < 0 || sym >= 30 )
+			{
+				return false;
+			}
+
+			dist = pngDistBase[ sym ] + PNG_getBits( png, pngDistExtra[ sym ] );
+
+			if ( dist > png->nOut )
+			{
+				return false;
+			}
+
+			while ( len > 0 )
+			{
+				PNG_put( png, png->window[ ( png->nOut - dist ) & 32767 ] );
+
+				len -= 1;
+			}
+		}
+	}
+
+	return false;
+}
+
+static bool PNG_inflateDynamicTables ( PngDecoder* png )
+{
+	static const uint8_t order [ 19 ] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	uint8_t  lengths [ 286 + 30 ];
+	uint8_t  clens   [ 19 ];
+	uint32_t hlit;
+	uint32_t hdist;
+	uint32_t hclen;
+	uint32_t i;
+	uint32_t n;
+	int32_t  sym;
+	uint8_t  prev;
+
+	hlit  = PNG_getBits( png, 5 ) + 257;
+	hdist = PNG_getBits( png, 5 ) + 1;
+	hclen = PNG_getBits( png, 4 ) + 4;
+
+	if ( hlit > 286 || hdist > 30 )
+	{
+		return false;
+	}
+
+	memset( clens, 0, sizeof( clens ) );
+
+	for ( i = 0; i < hclen; i += 1 )
+	{
+		clens[ order[ i ] ] = ( uint8_t ) PNG_getBits( png, 3 );
+	}
+
+	// Code length codes are decoded with the distance table as scratch
+	if ( ! Huffman_build( &png->dist, clens, 19 ) )
+	{
+		return false;
+	}
+
+	i = 0;
+
+	while ( i < hlit + hdist )
+	{
+		sym = PNG_decodeSymbol( png, &png->dist );
+
+		if ( sym < 0 )
+		{
+			return false;
+		}
+		else if ( sym < 16 )
+		{
+			lengths[ i ] = ( uint8_t ) sym;
+			i += 1;
+			continue;
+		}
+
+		if ( sym == 16 )
+		{
+			if ( i == 0 )
+			{
+				return false;
+			}
+
+			prev = lengths[ i - 1 ];
+			n    = PNG_getBits( png, 2 ) + 3;
+		}
+		else if ( sym == 17 )
+		{
+			prev = 0;
+			n    = PNG_getBits( png, 3 ) + 3;
+		}
+		else
+		{
+			prev = 0;
+			n    = PNG_getBits( png, 7 ) + 11;
+		}
+
+		if ( i + n > hlit + hdist )
+		{
+			return false;
+		}
+
+		memset( lengths + i, prev, n );
+
+		i += n;
+	}
+
+	return Huffman_build( &png->lit,  lengths,        hlit ) &&
+	       Huffman_build( &png->dist, lengths + hlit, hdist );
+}
+
+static bool PNG_inflate ( PngDecoder* png )
+{
+	uint8_t  lengths [ 288 ];
+	uint32_t bFinal;
+	uint32_t type;
+	uint32_t len;
+	uint32_t nlen;
+	int      cmf;
+	int      flg;
+
+	// zlib header, no preset dictionary
+	cmf = PNG_nextByte( png );
+	flg = PNG_nextByte( png );
+
+	if ( cmf < 0 || flg < 0 || ( cmf & 0x0F ) != 8 || ( flg & 0x20 ) ||
+	     ( ( cmf << 8 ) | flg ) % 31 != 0 )
+	{
+		return false;
+	}
+
+	do
+	{
+		bFinal = PNG_getBits( png, 1 );
+		type   = PNG_getBits( png, 2 );
+
+		if ( type == 0 )  // Stored
+		{
+			png->bitBuf >>= png->nBits & 7;
+			png->nBits   -= png->nBits & 7;
+
+			len  = PNG_getBits( png, 16 );
+			nlen = PNG_getBits( png, 16 );
+
+			if ( ( len ^ 0xFFFF ) != nlen )
+			{
+				return false;
+			}
+
+			while ( len > 0 )
+			{
+				PNG_put( png, ( uint8_t ) PNG_getBits( png, 8 ) );
+
+				len -= 1;
+			}
+		}
+		else if ( type == 1 )  // Fixed Huffman
+		{
+			memset( lengths +   0, 8, 144 );
+			memset( lengths + 144, 9, 112 );
+			memset( lengths + 256, 7,  24 );
+			memset( lengths + 280, 8,   8 );
+
+			Huffman_build( &png->lit, lengths, 288 );
+
+			memset( lengths, 5, 30 );
+
+			Huffman_build( &png->dist, lengths, 30 );
+
+			if ( ! PNG_inflateBlock( png ) )
+			{
+				return false;
+			}
+		}
+		else if ( type == 2 )  // Dynamic Huffman
+		{
+			if ( ! PNG_inflateDynamicTables( png ) || ! PNG_inflateBlock( png ) )
+			{
+				return false;
+			}
+		}
+		else
+		{
+			return false;
+		}
+
+		if ( png->nOverrun > 8 )
+		{
+			return false;
+		}
+	}
+	while ( ! bFinal && png->y < png->height );
+
+	return png->y == png->height;
+}
+
+static Pixel* PNG_decode ( FileReader* fr, uint32_t* pw, uint32_t* ph )
+{
+	static const uint8_t channels [ 7 ] = { 1, 0, 3, 1, 2, 0, 4 };
+
+	PngDecoder* png;
+	Pixel*      pixels;
+	uint8_t     hdr [ 8 ];
+	uint8_t     ihdr [ 13 ];
+	uint8_t     entry [ 3 ];
+	uint8_t     alpha [ 256 ];
+	uint32_t    len;
+	uint32_t    i;
+	bool        bOk;
+
+	// Remainder of the signature; "\x89PNG" has already been consumed
+	if ( ! FileReader_read( fr, hdr, 4 ) || memcmp( hdr, "\r\n\x1A\n", 4 ) != 0 )
+	{
+		return NULL;
+	}
+
+	// IHDR must come first
+	if ( ! FileReader_read( fr, hdr, 8 ) || memcmp( hdr + 4, "IHDR", 4 ) != 0 ||
+	     readU32BE( hdr ) != 13 || ! FileReader_read( fr, ihdr, 13 ) )
+	{
+		return NULL;
+	}
+
+	png = ( PngDecoder* ) calloc( 1, sizeof( PngDecoder ) );
+
+	png->fr         = fr;
+	png->width      = readU32BE( ihdr + 0 );
+	png->height     = readU32BE( ihdr + 4 );
+	png->bitDepth   = ihdr[ 8 ];
+	png->colourType = ihdr[ 9 ];
+
+	// Unknown colour type or depth, or interlaced
+	if ( png->colourType > 6 || channels[ png->colourType ] == 0 || ihdr[ 12 ] != 0 ||
+	     ( png->bitDepth != 1 && png->bitDepth != 2 && png->bitDepth != 4 &&
+	       png->bitDepth != 8 && png->bitDepth != 16 ) ||
+	     ( png->bitDepth < 8 && png->colourType != 0 && png->colourType != 3 ) ||
+	     ( png->bitDepth == 16 && png->colourType == 3 ) )
+	{
+		free( png );
+
+		return NULL;
+	}
+
+	png->nChannels = channels[ png->colourType ];
+	png->nRowBytes = ( png->width * png->nChannels * png->bitDepth + 7 ) / 8;
+	png->nBpp      = ( png->nChannels * png->bitDepth + 7 ) / 8;
+
+	for ( i = 0; i < 256; i += 1 )
+	{
+		Pixel_setRGB( png->palette + i, 0, 0, 0 );
+	}
+
+	pixels = NULL;
+	bOk    = false;
+
+	// Skip IHDR CRC, then walk chunks up to the first IDAT
+	if ( ! FileReader_skip( fr, 4 ) )
+	{
+		free( png );
+
+		return NULL;
+	}
+
+	while ( FileReader_read( fr, hdr, 8 ) )
+	{
+		len = readU32BE( hdr );
+
+		if ( memcmp( hdr + 4, "PLTE", 4 ) == 0 && len <= 256 * 3 )
+		{
+			for ( i = 0; i < len / 3 && FileReader_read( fr, entry, 3 ); i += 1 )
+			{
+				Pixel_setRGB( png->palette + i, entry[ 0 ], entry[ 1 ], entry[ 2 ] );
+			}
+
+			if ( i < len / 3 || ! FileReader_skip( fr, len % 3 + 4 ) )
+			{
+				break;
+			}
+		}
+		else if ( memcmp( hdr + 4, "tRNS", 4 ) == 0 && png->colourType == 3 && len <= 256 )
+		{
+			if ( ! FileReader_read( fr, alpha, len ) || ! FileReader_skip( fr, 4 ) )
+			{
+				break;
+			}
+
+			for ( i = 0; i < len; i += 1 )
+			{
+				png->palette[ i ].a = alpha[ i ];
+			}
+		}
+		else if ( memcmp( hdr + 4, "IDAT", 4 ) == 0 )
+		{
+			pixels = allocPixels( png->width, png->height );
+
+			if ( pixels )
+			{
+				png->pixels     = pixels;
+				png->nChunkLeft = len;
+				png->pCurRow    = ( uint8_t* ) malloc( png->nRowBytes + 1 );
+				png->pPrevRow   = ( uint8_t* ) calloc( png->nRowBytes + 1, 1 );
+
+				bOk = PNG_inflate( png );
+
+				free( png->pCurRow );
+				free( png->pPrevRow );
+			}
+
+			break;
+		}
+		else if ( memcmp( hdr + 4, "IEND", 4 ) == 0 ||
+		          ! FileReader_skip( fr, len + 4 ) )
+		{
+			break;
+		}
+	}
+
+	if ( bOk )
+	{
+		*pw = png->width;
+		*ph = png->height;
+	}
+	else
+	{
+		free( pixels );
+
+		pixels = NULL;
+	}
+
+	free( png );
+
+	return pixels;
+}
+
+
+// Sprites from files ------------------------------------------------------------
+
+enum rcode Sprite_loadFromFile ( Sprite* sp, const char* sImageFile )
+{
+	FileReader* fr;
+	Pixel*      pixels;
+	uint8_t     magic [ 4 ];
+	uint32_t    w;
+	uint32_t    h;
+	double      tStart;
+
+	tStart = PGE_getTime();
+
+	fr = ( FileReader* ) malloc( sizeof( FileReader ) );
+
+	fr->f    = fopen( sImageFile, "rb" );
+	fr->nPos = 0;
+	fr->nLen = 0;
+
+	if ( ! fr->f )
+	{
+		free( fr );
+
+		return NO_FILE;
+	}
+
+	pixels = NULL;
+
+	if ( FileReader_read( fr, magic, 2 ) && magic[ 0 ] == 'B' && magic[ 1 ] == 'M' )
+	{
+		pixels = BMP_decode( fr, &w, &h );
+	}
+	else if ( FileReader_read( fr, magic + 2, 2 ) )
+	{
+		if ( memcmp( magic, "\x89PNG", 4 ) == 0 )
+		{
+			pixels = PNG_decode( fr, &w, &h );
+		}
+		else if ( memcmp( magic, "qoif", 4 ) == 0 )
+		{
+			pixels = QOI_decode( fr, &w, &h );
+		}
+	}
+
+	fclose( fr->f );
+	free( fr );
+
+	if ( ! pixels )
+	{
+		return FAIL;
+	}
+
+	if ( sp->bOwnsData )
+	{
+		free( sp->pColData );
+	}
+
+	sp->width     = w;
+	sp->height    = h;
+	sp->nStride   = w;
+	sp->pColData  = pixels;
+	sp->bOwnsData = true;
+
+	PGE_recordLoad( sImageFile, w, h, tStart );
+
+	return OK;
+}
+
+Sprite* Sprite_newFromFile ( const char* sImageFile )
+{
+	Sprite* sp;
+
+	sp = ( Sprite* ) malloc( sizeof( Sprite ) );
+
+	sp->width     = 0;
+	sp->height    = 0;
+	sp->nStride   = 0;
+	sp->pColData  = NULL;
+	sp->bOwnsData = false;
+
+	if ( Sprite_loadFromFile( sp, sImageFile ) != OK )
+	{
+		free( sp );
+
+		return NULL;
+	}
+
+	return sp;
+}
+
+
+// Sprite packs ------------------------------------------------------------------
+
+/* Layout, all values little endian:
+
+     header   "olcSPAK\0", u32 version, u32 count, u32 page size, u32 reserved
+     entries  count x { char name[ 48 ], u32 width, u32 height, u64 offset }
+     payloads width * height RGBA pixels each, starting on a page boundary
+
+   Mapping is private and copy-on-write, so sprites can be drawn into
+   without touching the file. Pages are only read when first used.
+*/
+
+#define SPRITEPACK_VERSION  1
+#define SPRITEPACK_PAGESIZE 4096
+#define SPRITEPACK_NAMELEN  48
+
+struct _SpritePack
+{
+	uint8_t* pBase;
+	size_t   nSize;
+	int32_t  nSprites;
+	Sprite*  pSprites;
+	char*    pNames;  // nSprites x SPRITEPACK_NAMELEN
+
+	#ifdef _WIN32
+
+		HANDLE hFile;
+		HANDLE hMapping;
+
+	#endif
+};
+
+static uint64_t readU64LE ( const uint8_t* p )
+{
+	return ( uint64_t ) readU32LE( p ) | ( ( uint64_t ) readU32LE( p + 4 ) << 32 );
+}
+
+static void writeU32LE ( uint8_t* p, uint32_t v )
+{
+	p[ 0 ] = ( uint8_t ) ( v       );
+	p[ 1 ] = ( uint8_t ) ( v >>  8 );
+	p[ 2 ] = ( uint8_t ) ( v >> 16 );
+	p[ 3 ] = ( uint8_t ) ( v >> 24 );
+}
+
+static void SpritePack_unmap ( SpritePack* pack )
+{
+	#ifdef _WIN32
+
+		if ( pack->pBase )
+		{
+			UnmapViewOfFile( pack->pBase );
+		}
+		if ( pack->hMapping )
+		{
+			CloseHandle( pack->hMapping );
+		}
+		if ( pack->hFile != INVALID_HANDLE_VALUE )
+		{
+			CloseHandle( pack->hFile );
+		}
+
+	#else
+
+		if ( pack->pBase )
+		{
+			munmap( pack->pBase, pack->nSize );
+		}
+
+	#endif
+}
+
+SpritePack* SpritePack_load ( const char* sPackFile )
+{
+	SpritePack* pack;
+	uint8_t*    e;
+	uint32_t    w;
+	uint32_t    h;
+	uint64_t    offset;
+	int32_t     i;
+	double      tStart;
+	double      tEntry;
+	char        sName [ SPRITEPACK_NAMELEN + 8 ];
+
+	tStart = PGE_getTime();
+
+	pack = ( SpritePack* ) calloc( 1, sizeof( SpritePack ) );
+
+	#ifdef _WIN32
+
+		LARGE_INTEGER size;
+
+		pack->hFile = CreateFileA( sPackFile, GENERIC_READ, FILE_SHARE_READ, NULL,
+		                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+
+		if ( pack->hFile == INVALID_HANDLE_VALUE || ! GetFileSizeEx( pack->hFile, &size ) )
+		{
+			SpritePack_unmap( pack );
+			free( pack );
+
+			return NULL;
+		}
+
+		pack->nSize    = ( size_t ) size.QuadPart;
+		pack->hMapping = CreateFileMapping( pack->hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+
+		if ( pack->hMapping )
+		{
+			pack->pBase = ( uint8_t* ) MapViewOfFile( pack->hMapping, FILE_MAP_COPY, 0, 0, 0 );
+		}
+
+	#else
+
+		struct stat st;
+		int         fd;
+
+		fd = open( sPackFile, O_RDONLY );
+
+		if ( fd < 0 || fstat( fd, &st ) != 0 || st.st_size == 0 )
+		{
+			if ( fd >= 0 )
+			{
+				close( fd );
+			}
+
+			free( pack );
+
+			return NULL;
+		}
+
+		pack->nSize = ( size_t ) st.st_size;
+		pack->pBase = ( uint8_t* ) mmap( NULL, pack->nSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+
+		// The mapping keeps its own reference to the file
+		close( fd );
+
+		if ( pack->pBase == MAP_FAILED )
+		{
+			pack->pBase = NULL;
+		}
+
+	#endif
+
+	if ( ! pack->pBase || pack->nSize < 24 ||
+	     memcmp( pack->pBase, "olcSPAK\0", 8 ) != 0 ||
+	     readU32LE( pack->pBase + 8 ) != SPRITEPACK_VERSION )
+	{
+		SpritePack_unmap( pack );
+		free( pack );
+
+		return NULL;
+	}
+
+	pack->nSprites = ( int32_t ) readU32LE( pack->pBase + 12 );
+
+	if ( pack->nSprites < 0 ||
+	     24 + ( uint64_t ) pack->nSprites * ( SPRITEPACK_NAMELEN + 16 ) > pack->nSize )
+	{
+		SpritePack_unmap( pack );
+		free( pack );
+
+		return NULL;
+	}
+
+	pack->pSprites = ( Sprite* ) calloc( pack->nSprites + 1, sizeof( Sprite ) );
+	pack->pNames   = ( char* ) calloc( pack->nSprites + 1, SPRITEPACK_NAMELEN );
+
+	PGE_recordLoad( sPackFile, 0, 0, tStart );
+
+	for ( i = 0; i < pack->nSprites; i += 1 )
+	{
+		tEntry = PGE_getTime();
+
+		e      = pack->pBase + 24 + i * ( SPRITEPACK_NAMELEN + 16 );
+		w      = readU32LE( e + SPRITEPACK_NAMELEN + 0 );
+		h      = readU32LE( e + SPRITEPACK_NAMELEN + 4 );
+		offset = readU64LE( e + SPRITEPACK_NAMELEN + 8 );
+
+		if ( w > 32768 || h > 32768 || offset % SPRITEPACK_PAGESIZE != 0 ||
+		     offset + ( uint64_t ) w * h * sizeof( Pixel ) > pack->nSize )
+		{
+			SpritePack_free( pack );
+
+			return NULL;
+		}
+
+		memcpy( pack->pNames + i * SPRITEPACK_NAMELEN, e, SPRITEPACK_NAMELEN - 1 );
+
+		pack->pSprites[ i ].width     = w;
+		pack->pSprites[ i ].height    = h;
+		pack->pSprites[ i ].nStride   = w;
+		pack->pSprites[ i ].pColData  = ( Pixel* ) ( pack->pBase + offset );
+		pack->pSprites[ i ].bOwnsData = false;
+
+		snprintf( sName, sizeof( sName ), "pack:%s", pack->pNames + i * SPRITEPACK_NAMELEN );
+
+		PGE_recordLoad( sName, w, h, tEntry );
+	}
+
+	return pack;
+}
+
+void SpritePack_free ( SpritePack* pack )
+{
+	SpritePack_unmap( pack );
+
+	free( pack->pSprites );
+	free( pack->pNames );
+	free( pack );
+}
+
+int32_t SpritePack_getCount ( SpritePack* pack )
+{
+	return pack->nSprites;
+}
+
+Sprite* SpritePack_getSprite ( SpritePack* pack, int32_t i )
+{
+	if ( i < 0 || i >= pack->nSprites )
+	{
+		return NULL;
+	}
+
+	return pack->pSprites + i;
+}
+
+Sprite* SpritePack_find ( SpritePack* pack, const char* sName )
+{
+	int32_t i;
+
+	for ( i = 0; i < pack->nSprites; i += 1 )
+	{
+		if ( strcmp( pack->pNames + i * SPRITEPACK_NAMELEN, sName ) == 0 )
+		{
+			return pack->pSprites + i;
+		}
+	}
+
+	return NULL;
+}
+
+enum rcode SpritePack_save ( const char* sPackFile, Sprite** sprites, const char** names, int32_t count )
+{
+	FILE*    f;
+	uint8_t  hdr [ 24 ];
+	uint8_t  e [ SPRITEPACK_NAMELEN + 16 ];
+	uint8_t  zeros [ 256 ];
+	uint64_t offset;
+	uint64_t nPad;
+	int32_t  i;
+	int32_t  j;
+	bool     bOk;
+
+	f = fopen( sPackFile, "wb" );
+
+	if ( ! f )
+	{
+		return NO_FILE;
+	}
+
+	memset( hdr, 0, sizeof( hdr ) );
+	memcpy( hdr, "olcSPAK\0", 8 );
+	writeU32LE( hdr +  8, SPRITEPACK_VERSION );
+	writeU32LE( hdr + 12, count );
+	writeU32LE( hdr + 16, SPRITEPACK_PAGESIZE );
+
+	bOk = fwrite( hdr, 1, 24, f ) == 24;
+
+
+	// Entry table, with payload offsets rounded up to whole pages
+	offset = 24 + ( uint64_t ) count * sizeof( e );
+
+	for ( i = 0; i < count; i += 1 )
+	{
+		offset = ( offset + SPRITEPACK_PAGESIZE - 1 ) & ~( uint64_t ) ( SPRITEPACK_PAGESIZE - 1 );
+
+		memset( e, 0, sizeof( e ) );
+		strncpy( ( char* ) e, names[ i ], SPRITEPACK_NAMELEN - 1 );
+		writeU32LE( e + SPRITEPACK_NAMELEN + 0,  sprites[ i ]->width );
+		writeU32LE( e + SPRITEPACK_NAMELEN + 4,  sprites[ i ]->height );
+		writeU32LE( e + SPRITEPACK_NAMELEN + 8,  ( uint32_t ) offset );
+		writeU32LE( e + SPRITEPACK_NAMELEN + 12, ( uint32_t ) ( offset >> 32 ) );
+
+		bOk = bOk && fwrite( e, 1, sizeof( e ), f ) == sizeof( e );
+
+		offset += ( uint64_t ) sprites[ i ]->width * sprites[ i ]->height * sizeof( Pixel );
+	}
+
+
+	// Payloads
+	memset( zeros, 0, sizeof( zeros ) );
+
+	offset = 24 + ( uint64_t ) count * sizeof( e );
+
+	for ( i = 0; i < count && bOk; i += 1 )
+	{
+		nPad = ( ( offset + SPRITEPACK_PAGESIZE - 1 ) & ~( uint64_t ) ( SPRITEPACK_PAGESIZE - 1 ) ) - offset;
+
+		offset += nPad;
+
+		while ( nPad > 0 )
+		{
+			uint32_t n = nPad > sizeof( zeros ) ? sizeof( zeros ) : ( uint32_t ) nPad;
+
+			bOk   = bOk && fwrite( zeros, 1, n, f ) == n;
+			nPad -= n;
+		}
+
+		offset += ( uint64_t ) sprites[ i ]->width * sprites[ i ]->height * sizeof( Pixel );
+
+		// Views are written a row at a time, packed
+		for ( j = 0; j < sprites[ i ]->height && bOk; j += 1 )
+		{
+			bOk = fwrite(
+
+				sprites[ i ]->pColData + ( size_t ) j * sprites[ i ]->nStride,
+				sizeof( Pixel ),
+				( size_t ) sprites[ i ]->width,
+				f
+
+			) == ( size_t ) sprites[ i ]->width;
+		}
+	}
+
+	fclose( f );
+
+	return bOk ? OK : FAIL;
+}
+
+
+//================================================================================
+
+static void PGE_setClip ( Rect r )
+{
+	pCtx->clip = r;
+	pgeClip    = r;
+}
+
+/* Clips belong to the target they were pushed on. Leaving a target
+   puts its stack aside, and coming back to it picks the stack up again.
+   A target without one starts unclipped.
+*/
+void PGE_setDrawTarget ( Sprite* target )
+{
+	ClipState* cs;
+	Rect       r;
+	int32_t    i;
+
+	if ( ! target )
+	{
+		target = pCtx->pDefaultDrawTarget;
+	}
+
+	if ( target != pCtx->pDrawTarget )
+	{
+		// Put the stack of the target being left aside
+		if ( pCtx->nClips > 0 && pCtx->pDrawTarget )
+		{
+			if ( pCtx->nClipStates == pCtx->nClipStateCap )
+			{
+				pCtx->nClipStateCap = pCtx->nClipStateCap ? pCtx->nClipStateCap * 2 : 8;
+				pCtx->pClipStates   = ( ClipState* ) realloc( pCtx->pClipStates, pCtx->nClipStateCap * sizeof( ClipState ) );
+			}
+
+			cs = pCtx->pClipStates + pCtx->nClipStates;
+
+			cs->pTarget  = pCtx->pDrawTarget;
+			cs->clip     = pCtx->clip;
+			cs->pClips   = pCtx->pClips;
+			cs->nClips   = pCtx->nClips;
+			cs->nClipCap = pCtx->nClipCap;
+
+			pCtx->nClipStates += 1;
+
+			pCtx->pClips   = NULL;
+			pCtx->nClips   = 0;
+			pCtx->nClipCap = 0;
+		}
+
+		pCtx->pDrawTarget = target;
+
+		r.x = 0;
+		r.y = 0;
+		r.w = target ? target->width  : 0;
+		r.h = target ? target->height : 0;
+
+		pCtx->nClips = 0;
+
+		// Pick up the entered target's own stack, if it left one
+		for ( i = 0; i < pCtx->nClipStates; i += 1 )
+		{
+			cs = pCtx->pClipStates + i;
+
+			if ( cs->pTarget == target )
+			{
+				free( pCtx->pClips );
+
+				r              = cs->clip;
+				pCtx->pClips   = cs->pClips;
+				pCtx->nClips   = cs->nClips;
+				pCtx->nClipCap = cs->nClipCap;
+
+				pCtx->nClipStates -= 1;
+				*cs = pCtx->pClipStates[ pCtx->nClipStates ];
+
+				break;
+			}
+		}
+
+		pCtx->clip = r;
+	}
+
+	PGE_setClip( pCtx->clip );
+
+	PGE_syncInlineTarget();
+}
+
+void PGE_pushClip ( int32_t x, int32_t y, int32_t w, int32_t h )
+{
+	Rect    c;
+	Rect    r;
+	int32_t x1;
+	int32_t y1;
+
+	if ( pCtx->nClips == pCtx->nClipCap )
+	{
+		pCtx->nClipCap = pCtx->nClipCap ? pCtx->nClipCap * 2 : 8;
+		pCtx->pClips   = ( Rect* ) realloc( pCtx->pClips, pCtx->nClipCap * sizeof( Rect ) );
+	}
+
+	c = pCtx->clip;
+
+	pCtx->pClips[ pCtx->nClips ] = c;
+	pCtx->nClips += 1;
+
+	// Intersect with the current clip, in 64 bits as x + w may overflow
+	r.x = x > c.x ? x : c.x;
+	r.y = y > c.y ? y : c.y;
+	x1  = ( int32_t ) ( ( int64_t ) x + w < ( int64_t ) c.x + c.w ? ( int64_t ) x + w : ( int64_t ) c.x + c.w );
+	y1  = ( int32_t ) ( ( int64_t ) y + h < ( int64_t ) c.y + c.h ? ( int64_t ) y + h : ( int64_t ) c.y + c.h );
+	r.w = x1 > r.x ? x1 - r.x : 0;
+	r.h = y1 > r.y ? y1 - r.y : 0;
+
+	PGE_setClip( r );
+}
+
+void PGE_popClip ( void )
+{
+	if ( pCtx->nClips > 0 )
+	{
+		pCtx->nClips -= 1;
+
+		PGE_setClip( pCtx->pClips[ pCtx->nClips ] );
+	}
+}
+
+Rect PGE_getClip ( void )
+{
+	return pCtx->clip;
+}
+
+/* PGE_construct leaves the default target's pixels for PGE_start to
+   initialise. Anything that reads or writes them before then finishes
+   that first, so it is done once and never over what was drawn. The
+   inline mirrors, left empty meanwhile, are then filled in.
+*/
+static void PGE_finishTargetInit ( void )
+{
+	if ( pCtx->bTargetInitPending )
+	{
+		pCtx->bTargetInitPending = false;
+
+		Sprite_initPixels( pCtx->pDefaultDrawTarget );
+
+		PGE_syncInlineTarget();
+	}
+}
+
+Sprite* PGE_getDrawTarget ( void )
+{
+	if ( pCtx->pDrawTarget == pCtx->pDefaultDrawTarget )
+	{
+		PGE_finishTargetInit();
+	}
+
+	// First use on this thread, or of a newly filled default target
+	if ( pgeDrawTarget != pCtx->pDrawTarget )
+	{
+		PGE_syncInlineTarget();
+	}
+
+	return pCtx->pDrawTarget;
+}
+
+int32_t PGE_getDrawTargetWidth ( void )
+{
+	if ( pCtx->pDrawTarget )
+	{
+		return pCtx->pDrawTarget->width;
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+int32_t PGE_getDrawTargetHeight ( void )
+{
+	if ( pCtx->pDrawTarget )
+	{
+		return pCtx->pDrawTarget->height;
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+bool PGE_drawRGB ( int32_t x, int32_t y, uint8_t r, uint8_t g, uint8_t b )
+{
+	Sprite* sp;
+	Rect*   c;
+
+	// One branch per pixel, taken at most once per engine
+	if ( pCtx->bTargetInitPending )
+	{
+		PGE_finishTargetInit();
+	}
+
+	sp = pCtx->pDrawTarget;
+
+	if ( ! sp )
+	{
+		return false;
+	}
+
+	#ifdef PGE_FIXED_SCREEN
+
+		// Bounds and stride are constants for the unclipped default target
+		if ( sp == pCtx->pDefaultDrawTarget && pCtx->nClips == 0 )
+		{
+			if ( ( uint32_t ) x >= PGE_SCREEN_W || ( uint32_t ) y >= PGE_SCREEN_H )
+			{
+				return false;
+			}
+
+			Pixel_setRGB( sp->pColData + ( y * PGE_SCREEN_W + x ), r, g, b );
+
+			return true;
+		}
+
+	#endif
+
+	// The clip lies within the target, so is its bounds check too
+	c = &pCtx->clip;
+
+	if ( ( uint32_t ) ( x - c->x ) >= ( uint32_t ) c->w || ( uint32_t ) ( y - c->y ) >= ( uint32_t ) c->h )
+	{
+		return false;
+	}
+
+	// Assume Pixel::NORMAL
+	Pixel_setRGB( sp->pColData + ( y * sp->nStride + x ), r, g, b );
+
+	return true;
+}
+
+void PGE_clearRGB ( uint8_t r, uint8_t g, uint8_t b )
+{
+	Pixel p;
+
+	Pixel_setRGB( &p, r, g, b );
+
+	PGE_clear( p );
+}
+
+void PGE_clear ( Pixel p )
+{
+	Sprite* sp;
+	Rect    c;
+	int     nPixels;
+	int     j;
+
+	sp = PGE_getDrawTarget();
+
+	if ( ! sp )
+	{
+		return;
+	}
+
+	nPixels = sp->width * sp->height;
+	c       = pCtx->clip;
+
+	#ifdef PGE_FIXED_SCREEN
+
+		if ( sp == pCtx->pDefaultDrawTarget )
+		{
+			nPixels = PGE_SCREEN_W * PGE_SCREEN_H;
+		}
+
+	#endif
+
+	// Unclipped and contiguous, as all but views are
+	if ( pCtx->nClips == 0 && sp->nStride == sp->width )
+	{
+		pgeKernels.fill( sp->pColData, p, nPixels );
+
+		return;
+	}
+
+	// Otherwise a row at a time
+	for ( j = 0; j < c.h; j += 1 )
+	{
+		pgeKernels.fill( sp->pColData + ( c.y + j ) * sp->nStride + c.x, p, c.w );
+	}
+}
+
+
+/* Flood fill.
+   The span based seed fill from Graphics Gems (Heckbert). Each stack
+   entry is a span [ x1, x2 ] of row y already filled, and the row
+   y + dy next to it still to be explored. Pixels are compared packed
+   as 32 bit words.
+*/
+
+struct _FillSpan
+{
+	int32_t y;
+	int32_t x1;
+	int32_t x2;
+	int32_t dy;
+};
+
+typedef struct _FillSpan FillSpan;
+
+struct _FillStack
+{
+	FillSpan* pSpans;
+	int32_t   nCount;
+	int32_t   nCapacity;
+	int32_t   y0;  // rows that may be explored, from the clip
+	int32_t   y1;
+};
+
+typedef struct _FillStack FillStack;
+
+static void FillStack_push ( FillStack* st, int32_t y, int32_t x1, int32_t x2, int32_t dy )
+{
+	if ( y + dy < st->y0 || y + dy >= st->y1 )
+	{
+		return;
+	}
+
+	if ( st->nCount == st->nCapacity )
+	{
+		st->nCapacity = st->nCapacity ? st->nCapacity * 2 : 256;
+		st->pSpans    = ( FillSpan* ) realloc( st->pSpans, st->nCapacity * sizeof( FillSpan ) );
+	}
+
+	st->pSpans[ st->nCount ].y  = y;
+	st->pSpans[ st->nCount ].x1 = x1;
+	st->pSpans[ st->nCount ].x2 = x2;
+	st->pSpans[ st->nCount ].dy = dy;
+
+	st->nCount += 1;
+}
+
+static uint32_t PGE_packPixel ( const Pixel* p )
+{
+	uint32_t u;
+
+	memcpy( &u, p, 4 );
+
+	return u;
+}
+
+void PGE_floodFill ( int32_t x, int32_t y, Pixel col )
+{
+	Sprite*   sp;
+	Pixel*    row;
+	FillStack st;
+	FillSpan  s;
+	Rect      c;
+	uint32_t  old;
+	int32_t   xEnd;
+	int32_t   l;
+
+	sp = PGE_getDrawTarget();
+	c  = pCtx->clip;
+
+	if ( ! sp || ( uint32_t ) ( x - c.x ) >= ( uint32_t ) c.w || ( uint32_t ) ( y - c.y ) >= ( uint32_t ) c.h )
+	{
+		return;
+	}
+
+	old = PGE_packPixel( sp->pColData + y * sp->nStride + x );
+
+	// Already that colour, and the loop below would never end
+	if ( old == PGE_packPixel( &col ) )
+	{
+		return;
+	}
+
+	xEnd = c.x + c.w;
+
+	memset( &st, 0, sizeof( st ) );
+
+	st.y0 = c.y;
+	st.y1 = c.y + c.h;
+
+	FillStack_push( &st, y,     x, x,  1 );
+	FillStack_push( &st, y + 1, x, x, -1 );
+
+	while ( st.nCount > 0 )
+	{
+		st.nCount -= 1;
+
+		s   = st.pSpans[ st.nCount ];
+		y   = s.y + s.dy;
+		row = sp->pColData + y * sp->nStride;
+
+		// Extend left from x1
+		for ( x = s.x1; x >= c.x && PGE_packPixel( row + x ) == old; x -= 1 )
+		{
+			row[ x ] = col;
+		}
+
+		if ( x < s.x1 )
+		{
+			l = x + 1;
+
+			// Leaked past the parent span's left end, so back the other way too
+			if ( l < s.x1 )
+			{
+				FillStack_push( &st, y, l, s.x1 - 1, - s.dy );
+			}
+
+			for ( x = s.x1 + 1; x < xEnd && PGE_packPixel( row + x ) == old; x += 1 )
+			{
+				row[ x ] = col;
+			}
+
+			FillStack_push( &st, y, l, x - 1, s.dy );
+
+			if ( x > s.x2 + 1 )
+			{
+				FillStack_push( &st, y, s.x2 + 1, x - 1, - s.dy );
+			}
+		}
+
+		// Further spans starting under the rest of the parent span
+		for ( ;; )
+		{
+			x += 1;
+
+			while ( x <= s.x2 && PGE_packPixel( row + x ) != old )
+			{
+				x += 1;
+			}
+
+			if ( x > s.x2 )
+			{
+				break;
+			}
+
+			for ( l = x; x < xEnd && PGE_packPixel( row + x ) == old; x += 1 )
+			{
+				row[ x ] = col;
+			}
+
+			FillStack_push( &st, y, l, x - 1, s.dy );
+
+			if ( x > s.x2 + 1 )
+			{
+				FillStack_push( &st, y, s.x2 + 1, x - 1, - s.dy );
+			}
+		}
+	}
+
+	free( st.pSpans );
+}
+
+
+//================================================================================
+
+/* Sprite drawing.
+   Source pixels are gathered a chunk of a row at a time, then written
+   to the target in one pass per chunk for the current pixel mode. The
+   inner loops carry no bounds checks, as each row is first cut down to
+   the span whose samples fall inside the sprite.
+*/
+
+#define PGE_SPAN_CHUNK 64
+
+void PGE_setPixelMode ( enum PixelMode mode )
+{
+	pCtx->pixelMode = mode;
+}
+
+enum PixelMode PGE_getPixelMode ( void )
+{
+	return pCtx->pixelMode;
+}
+
+// Writes n source pixels over dst in the current pixel mode
+static void PGE_blendSpan ( Pixel* dst, const Pixel* src, int32_t n )
+{
+	switch ( pCtx->pixelMode )
+	{
+		case PIXEL_NORMAL:
+
+			memcpy( dst, src, n * sizeof( Pixel ) );
+			break;
+
+		case PIXEL_MASK:
+
+			pgeKernels.blit( dst, src, n );
+			break;
+
+		case PIXEL_ALPHA:
+
+			pgeKernels.blend( dst, src, n );
+			break;
+
+		case PIXEL_ADD:
+
+			pgeKernels.add( dst, src, n );
+			break;
+	}
+}
+
+static int64_t PGE_floorDiv ( int64_t a, int64_t b )
+{
+	int64_t q;
+
+	q = a / b;
+
+	if ( ( a % b != 0 ) && ( ( a < 0 ) != ( b < 0 ) ) )
+	{
+		q -= 1;
+	}
+
+	return q;
+}
+
+// Well inside int64_t after 16.16 steps are added, and false for NaN
+static bool PGE_isConvertible ( double f )
+{
+	return f > - 140737488355328.0 && f < 140737488355328.0;  // 2^47
+}
+
+static int64_t PGE_floorToInt ( double f )
+{
+	int64_t i;
+
+	i = ( int64_t ) f;
+
+	if ( ( double ) i > f )
+	{
+		i -= 1;
+	}
+
+	return i;
+}
+
+/* Narrows [ *xs, *xe ] to the steps x for which 0 <= p + dp * x < lim,
+   with p and dp in 16.16 fixed point. Returns false if none remain.
+*/
+static bool PGE_clipSpan ( int64_t p, int64_t dp, int64_t lim, int64_t* xs, int64_t* xe )
+{
+	int64_t lo;
+	int64_t hi;
+
+	if ( dp == 0 )
+	{
+		return p >= 0 && p < lim;
+	}
+
+	if ( dp > 0 )
+	{
+		lo = - PGE_floorDiv( p, dp );
+		hi = PGE_floorDiv( lim - 1 - p, dp );
+	}
+	else
+	{
+		lo = - PGE_floorDiv( p - ( lim - 1 ), dp );
+		hi = PGE_floorDiv( - p, dp );
+	}
+
+	if ( lo > *xs ) { *xs = lo; }
+	if ( hi < *xe ) { *xe = hi; }
+
+	return *xs <= *xe;
+}
+
+// Nearest samples, along a row as the scale kernel when only scaling
+static void PGE_sampleNearest ( Pixel* out, const Sprite* sp, uint32_t u, uint32_t v, uint32_t du, uint32_t dv, int32_t n )
+{
+	if ( dv == 0 )
+	{
+		pgeKernels.scale( out, sp->pColData + ( v >> 16 ) * sp->nStride, u, du, n );
+
+		return;
+	}
+
+	pgeKernels.nearest( out, sp, u, v, du, dv, n );
+}
+
+static void PGE_sampleBilinear ( Pixel* out, const Sprite* sp, uint32_t u, uint32_t v, uint32_t du, uint32_t dv, int32_t n )
+{
+	pgeKernels.bilinear( out, sp, u, v, du, dv, n );
+}
+
+void PGE_drawSpriteTransformed ( Sprite* sp, const float m [ 6 ], bool bBilinear )
+{
+	Sprite* dst;
+	Rect    c;
+	Pixel   chunk [ PGE_SPAN_CHUNK ];
+	double  det;
+	double  inv [ 6 ];
+	double  sx;
+	double  sy;
+	double  cx;
+	double  cy;
+	double  minX;
+	double  minY;
+	double  maxX;
+	double  maxY;
+	double  fu;
+	double  fv;
+	int64_t ax;
+	int64_t x0;
+	int64_t y0;
+	int64_t x1;
+	int64_t y1;
+	int64_t y;
+	int64_t u;
+	int64_t v;
+	int64_t du;
+	int64_t dv;
+	int64_t xs;
+	int64_t xe;
+	int32_t n;
+	int32_t i;
+
+	dst = PGE_getDrawTarget();
+
+	if ( ! dst || ! sp || sp->width <= 0 || sp->height <= 0 )
+	{
+		return;
+	}
+
+	/* Everything converted to an integer below must be in range first,
+	   which rules out infinities and NaNs, and near singular matrices
+	   whose inverse steps are huge
+	*/
+	for ( i = 0; i < 6; i += 1 )
+	{
+		if ( ! PGE_isConvertible( m[ i ] ) )
+		{
+			return;
+		}
+	}
+
+	det = ( double ) m[ 0 ] * m[ 4 ] - ( double ) m[ 1 ] * m[ 3 ];
+
+	if ( det == 0.0 )
+	{
+		return;
+	}
+
+	// Target to sprite
+	inv[ 0 ] =   m[ 4 ] / det;
+	inv[ 1 ] = - m[ 1 ] / det;
+	inv[ 2 ] = ( ( double ) m[ 1 ] * m[ 5 ] - ( double ) m[ 4 ] * m[ 2 ] ) / det;
+	inv[ 3 ] = - m[ 3 ] / det;
+	inv[ 4 ] =   m[ 0 ] / det;
+	inv[ 5 ] = ( ( double ) m[ 3 ] * m[ 2 ] - ( double ) m[ 0 ] * m[ 5 ] ) / det;
+
+	for ( i = 0; i < 6; i += 1 )
+	{
+		if ( ! PGE_isConvertible( inv[ i ] * 65536.0 ) )
+		{
+			return;
+		}
+	}
+
+
+	// Bounding box of the transformed corners, clipped
+	minX = maxX = m[ 2 ];
+	minY = maxY = m[ 5 ];
+
+	for ( i = 1; i < 4; i += 1 )
+	{
+		sx = ( i & 1 ) ? sp->width  : 0;
+		sy = ( i & 2 ) ? sp->height : 0;
+
+		cx = m[ 0 ] * sx + m[ 1 ] * sy + m[ 2 ];
+		cy = m[ 3 ] * sx + m[ 4 ] * sy + m[ 5 ];
+
+		if ( cx < minX ) { minX = cx; }
+		if ( cx > maxX ) { maxX = cx; }
+		if ( cy < minY ) { minY = cy; }
+		if ( cy > maxY ) { maxY = cy; }
+	}
+
+	if ( ! PGE_isConvertible( minX ) || ! PGE_isConvertible( maxX ) ||
+	     ! PGE_isConvertible( minY ) || ! PGE_isConvertible( maxY ) )
+	{
+		return;
+	}
+
+	/* Rows are stepped from the unclipped left edge, so the fixed point
+	   samples, and so the pixels drawn, do not depend on the clip
+	*/
+	ax = PGE_floorToInt( minX );
+
+	c = pCtx->clip;
+
+	if ( minX < c.x )       { minX = c.x; }
+	if ( minY < c.y )       { minY = c.y; }
+	if ( maxX > c.x + c.w ) { maxX = c.x + c.w; }
+	if ( maxY > c.y + c.h ) { maxY = c.y + c.h; }
+
+	if ( minX >= maxX || minY >= maxY )
+	{
+		return;
+	}
+
+	x0 = PGE_floorToInt( minX );
+	y0 = PGE_floorToInt( minY );
+	x1 = - PGE_floorToInt( - maxX );  // exclusive
+	y1 = - PGE_floorToInt( - maxY );
+
+
+	// Source steps per target pixel, in 16.16 fixed point
+	du = PGE_floorToInt( inv[ 0 ] * 65536.0 + 0.5 );
+	dv = PGE_floorToInt( inv[ 3 ] * 65536.0 + 0.5 );
+
+	for ( y = y0; y < y1; y += 1 )
+	{
+		// Sample at pixel centres
+		fu = ( inv[ 0 ] * ( ax + 0.5 ) + inv[ 1 ] * ( y + 0.5 ) + inv[ 2 ] ) * 65536.0 + 0.5;
+		fv = ( inv[ 3 ] * ( ax + 0.5 ) + inv[ 4 ] * ( y + 0.5 ) + inv[ 5 ] ) * 65536.0 + 0.5;
+
+		// Only for extreme shears or scales, whose rows are skipped rather than wrapped
+		if ( ! PGE_isConvertible( fu ) || ! PGE_isConvertible( fv ) )
+		{
+			continue;
+		}
+
+		u = PGE_floorToInt( fu );
+		v = PGE_floorToInt( fv );
+
+		xs = x0 - ax;
+		xe = x1 - 1 - ax;
+
+		if ( ! PGE_clipSpan( u, du, ( int64_t ) sp->width  << 16, &xs, &xe ) ||
+		     ! PGE_clipSpan( v, dv, ( int64_t ) sp->height << 16, &xs, &xe ) )
+		{
+			continue;
+		}
+
+		u += du * xs;
+		v += dv * xs;
+
+		for ( ; xs <= xe; xs += n )
+		{
+			n = ( int32_t ) ( xe - xs + 1 );
+
+			if ( n > PGE_SPAN_CHUNK )
+			{
+				n = PGE_SPAN_CHUNK;
+			}
+
+			if ( bBilinear )
+			{
+				PGE_sampleBilinear( chunk, sp, ( uint32_t ) u, ( uint32_t ) v, ( uint32_t ) du, ( uint32_t ) dv, n );
+			}
+			else
+			{
+				PGE_sampleNearest( chunk, sp, ( uint32_t ) u, ( uint32_t ) v, ( uint32_t ) du, ( uint32_t ) dv, n );
+			}
+
+			PGE_blendSpan( dst->pColData + y * dst->nStride + ax + xs, chunk, n );
+
+			u += du * n;
+			v += dv * n;
+		}
+	}
+}
+
+
+/* Draws a block onto an overlapping one in the same pixels, in
+   memmove's order: backwards when the destination lies above the
+   source in memory. Each chunk is copied out before any of it is
+   written, as the kernels assume separate spans.
+*/
+static void PGE_blendOverlapping ( Pixel* dst, const Pixel* src, int32_t nStride, int32_t w, int32_t h )
+{
+	Pixel   chunk [ PGE_SPAN_CHUNK ];
+	bool    bBackward;
+	int32_t j;
+	int32_t i;
+	int32_t k;
+	int32_t n;
+	int32_t r;
+
+	bBackward = ( uintptr_t ) dst > ( uintptr_t ) src;
+
+	for ( r = 0; r < h; r += 1 )
+	{
+		j = bBackward ? h - 1 - r : r;
+
+		for ( i = 0; i < w; i += n )
+		{
+			n = w - i < PGE_SPAN_CHUNK ? w - i : PGE_SPAN_CHUNK;
+			k = bBackward ? w - i - n : i;
+
+			memcpy( chunk, src + j * nStride + k, n * sizeof( Pixel ) );
+
+			PGE_blendSpan( dst + j * nStride + k, chunk, n );
+		}
+	}
+}
+
+void PGE_drawPartialSprite ( int32_t x, int32_t y, Sprite* sp, int32_t ox, int32_t oy, int32_t w, int32_t h )
+{
+	Sprite* dst;
+	Pixel*  out;
+	Pixel*  src;
+	Rect    c;
+	int32_t j;
+
+	dst = PGE_getDrawTarget();
+
+	if ( ! dst || ! sp )
+	{
+		return;
+	}
+
+	c = pCtx->clip;
+
+	// Clip to the source sprite, then to the clip rectangle
+	if ( ox < 0 ) { w += ox; x -= ox; ox = 0; }
+	if ( oy < 0 ) { h += oy; y -= oy; oy = 0; }
+	if ( ox + w > sp->width )  { w = sp->width  - ox; }
+	if ( oy + h > sp->height ) { h = sp->height - oy; }
+
+	if ( x < c.x ) { w -= c.x - x; ox += c.x - x; x = c.x; }
+	if ( y < c.y ) { h -= c.y - y; oy += c.y - y; y = c.y; }
+	if ( x + w > c.x + c.w ) { w = c.x + c.w - x; }
+	if ( y + h > c.y + c.h ) { h = c.y + c.h - y; }
+
+	if ( w <= 0 || h <= 0 )
+	{
+		return;
+	}
+
+	out = dst->pColData + y * dst->nStride + x;
+	src = sp->pColData + oy * sp->nStride + ox;
+
+	// Only a sprite sharing the target's pixels, so its stride too, can overlap it
+	if ( sp->nStride == dst->nStride &&
+	     ( uintptr_t ) out < ( uintptr_t ) ( src + ( h - 1 ) * sp->nStride + w ) &&
+	     ( uintptr_t ) src < ( uintptr_t ) ( out + ( h - 1 ) * dst->nStride + w ) )
+	{
+		PGE_blendOverlapping( out, src, dst->nStride, w, h );
+
+		return;
+	}
+
+	for ( j = 0; j < h; j += 1 )
+	{
+		PGE_blendSpan( out + j * dst->nStride, src + j * sp->nStride, w );
+	}
+}
+
+void PGE_drawSprite ( int32_t x, int32_t y, Sprite* sp )
+{
+	if ( sp )
+	{
+		PGE_drawPartialSprite( x, y, sp, 0, 0, sp->width, sp->height );
+	}
+}
+
+
+//================================================================================
+
+/* Run length encoded sprites.
+   Each row's runs are a contiguous slice of pRuns, from pRows[ y ] to
+   pRows[ y + 1 ], in increasing x. A run's pixels are stored packed in
+   pPixels at nOffset, so a run clipped on the left starts further in.
+*/
+
+struct _SpriteRLERun
+{
+	int32_t x;
+	int32_t n;
+	int32_t nOffset;
+	bool    bOpaque;  // every pixel has alpha 255
+};
+
+typedef struct _SpriteRLERun SpriteRLERun;
+
+struct _SpriteRLE
+{
+	int32_t width;
+	int32_t height;
+
+	int32_t*      pRows;  // height + 1 run indices
+	SpriteRLERun* pRuns;
+	Pixel*        pPixels;
+};
+
+// End of the run starting at row[ x ], which is all opaque or all partly transparent
+static int32_t SpriteRLE_runEnd ( const Pixel* row, int32_t x, int32_t w )
+{
+	bool bOpaque;
+
+	bOpaque = row[ x ].a == 255;
+
+	while ( x < w && row[ x ].a != 0 && ( row[ x ].a == 255 ) == bOpaque )
+	{
+		x += 1;
+	}
+
+	return x;
+}
+
+SpriteRLE* SpriteRLE_new ( Sprite* sp )
+{
+	SpriteRLE*   rle;
+	const Pixel* row;
+	int32_t      nRuns;
+	int32_t      nPixels;
+	int32_t      x;
+	int32_t      y;
+	int32_t      x0;
+
+	if ( ! sp || sp->width <= 0 || sp->height <= 0 )
+	{
+		return NULL;
+	}
+
+	// Count first, so each array is allocated once
+	nRuns   = 0;
+	nPixels = 0;
+
+	for ( y = 0; y < sp->height; y += 1 )
+	{
+		row = sp->pColData + y * sp->nStride;
+
+		for ( x = 0; x < sp->width; )
+		{
+			if ( row[ x ].a == 0 )
+			{
+				x += 1;
+
+				continue;
+			}
+
+			x0 = x;
+			x  = SpriteRLE_runEnd( row, x, sp->width );
+
+			nRuns   += 1;
+			nPixels += x - x0;
+		}
+	}
+
+	rle = ( SpriteRLE* ) malloc( sizeof( SpriteRLE ) );
+
+	rle->width   = sp->width;
+	rle->height  = sp->height;
+	rle->pRows   = ( int32_t* ) malloc( ( sp->height + 1 ) * sizeof( int32_t ) );
+	rle->pRuns   = ( SpriteRLERun* ) malloc( ( nRuns ? nRuns : 1 ) * sizeof( SpriteRLERun ) );
+	rle->pPixels = ( Pixel* ) malloc( ( nPixels ? nPixels : 1 ) * sizeof( Pixel ) );
+
+	nRuns   = 0;
+	nPixels = 0;
+
+	for ( y = 0; y < sp->height; y += 1 )
+	{
+		row = sp->pColData + y * sp->nStride;
+
+		rle->pRows[ y ] = nRuns;
+
+		for ( x = 0; x < sp->width; )
+		{
+			if ( row[ x ].a == 0 )
+			{
+				x += 1;
+
+				continue;
+			}
+
+			x0 = x;
+			x  = SpriteRLE_runEnd( row, x, sp->width );
+
+			rle->pRuns[ nRuns ].x       = x0;
+			rle->pRuns[ nRuns ].n       = x - x0;
+			rle->pRuns[ nRuns ].nOffset = nPixels;
+			rle->pRuns[ nRuns ].bOpaque = row[ x0 ].a == 255;
+
+			memcpy( rle->pPixels + nPixels, row + x0, ( x - x0 ) * sizeof( Pixel ) );
+
+			nRuns   += 1;
+			nPixels += x - x0;
+		}
+	}
+
+	rle->pRows[ sp->height ] = nRuns;
+
+	return rle;
+}
+
+void SpriteRLE_free ( SpriteRLE* rle )
+{
+	if ( ! rle )
+	{
+		return;
+	}
+
+	free( rle->pRows );
+	free( rle->pRuns );
+	free( rle->pPixels );
+	free( rle );
+}
+
+void PGE_drawSpriteRLE ( int32_t x, int32_t y, SpriteRLE* rle )
+{
+	Sprite*             dst;
+	Pixel*              out;
+	const SpriteRLERun* r;
+	const SpriteRLERun* rEnd;
+	const Pixel*        src;
+	enum PixelMode      mode;
+	Rect                c;
+	int32_t             x0;
+	int32_t             x1;
+	int32_t             y0;
+	int32_t             y1;
+	int32_t             j;
+	int32_t             a;
+	int32_t             b;
+
+	dst = PGE_getDrawTarget();
+
+	if ( ! dst || ! rle )
+	{
+		return;
+	}
+
+	// Clip rectangle in sprite coordinates
+	c = pCtx->clip;
+
+	x0 = c.x - x > 0 ? c.x - x : 0;
+	y0 = c.y - y > 0 ? c.y - y : 0;
+	x1 = c.x + c.w - x < rle->width  ? c.x + c.w - x : rle->width;
+	y1 = c.y + c.h - y < rle->height ? c.y + c.h - y : rle->height;
+
+	if ( x0 >= x1 || y0 >= y1 )
+	{
+		return;
+	}
+
+	mode = pCtx->pixelMode;
+
+	for ( j = y0; j < y1; j += 1 )
+	{
+		out  = dst->pColData + ( y + j ) * dst->nStride + x;
+		r    = rle->pRuns + rle->pRows[ j ];
+		rEnd = rle->pRuns + rle->pRows[ j + 1 ];
+
+		// Runs wholly left of the clip
+		while ( r < rEnd && r->x + r->n <= x0 )
+		{
+			r += 1;
+		}
+
+		for ( ; r < rEnd && r->x < x1; r += 1 )
+		{
+			a   = r->x > x0 ? r->x : x0;
+			b   = r->x + r->n < x1 ? r->x + r->n : x1;
+			src = rle->pPixels + r->nOffset + ( a - r->x );
+
+			if ( mode == PIXEL_ADD )
+			{
+				pgeKernels.add( out + a, src, b - a );
+			}
+			else if ( r->bOpaque || mode == PIXEL_NORMAL )
+			{
+				memcpy( out + a, src, ( b - a ) * sizeof( Pixel ) );
+			}
+			else if ( mode == PIXEL_ALPHA )
+			{
+				pgeKernels.blend( out + a, src, b - a );
+			}
+
+			// Partly transparent runs are not drawn in PIXEL_MASK
+		}
+	}
+}
+
+
+//================================================================================
+
+/* Collision masks.
+   Pixel x of a row is bit x % 64 of word x / 64, and bits past the
+   width are clear. The box is kept tight around the set bits, so that
+   any bit outside one mask's box is clear and whole words can be
+   ANDed without masking off their ends.
+*/
+
+struct _SpriteMask
+{
+	int32_t width;
+	int32_t height;
+	int32_t nWords;  // per row
+
+	Rect      box;  // empty when no bit is set
+	uint64_t* pBits;
+};
+
+SpriteMask* SpriteMask_new ( Sprite* sp, uint8_t nAlphaMin )
+{
+	SpriteMask*  m;
+	const Pixel* row;
+	uint64_t*    bits;
+	int32_t      x0;
+	int32_t      y0;
+	int32_t      x1;
+	int32_t      y1;
+	int32_t      x;
+	int32_t      y;
+
+	if ( ! sp || sp->width <= 0 || sp->height <= 0 )
+	{
+		return NULL;
+	}
+
+	m = ( SpriteMask* ) malloc( sizeof( SpriteMask ) );
+
+	m->width  = sp->width;
+	m->height = sp->height;
+	m->nWords = ( sp->width + 63 ) / 64;
+	m->pBits  = ( uint64_t* ) calloc( ( size_t ) m->nWords * sp->height, sizeof( uint64_t ) );
+
+	x0 = sp->width;
+	y0 = sp->height;
+	x1 = 0;
+	y1 = 0;
+
+	for ( y = 0; y < sp->height; y += 1 )
+	{
+		row  = sp->pColData + y * sp->nStride;
+		bits = m->pBits + y * m->nWords;
+
+		for ( x = 0; x < sp->width; x += 1 )
+		{
+			if ( row[ x ].a >= nAlphaMin )
+			{
+				bits[ x >> 6 ] |= ( uint64_t ) 1 << ( x & 63 );
+
+				if ( x < x0 )      { x0 = x; }
+				if ( x + 1 > x1 )  { x1 = x + 1; }
+				if ( y < y0 )      { y0 = y; }
+				y1 = y + 1;
+			}
+		}
+	}
+
+	m->box.x = x0;
+	m->box.y = y0;
+	m->box.w = x1 > x0 ? x1 - x0 : 0;
+	m->box.h = y1 > y0 ? y1 - y0 : 0;
+
+	return m;
+}
+
+void SpriteMask_free ( SpriteMask* m )
+{
+	if ( ! m )
+	{
+		return;
+	}
+
+	free( m->pBits );
+	free( m );
+}
+
+bool SpriteMask_get ( const SpriteMask* m, int32_t x, int32_t y )
+{
+	if ( ( uint32_t ) x >= ( uint32_t ) m->width || ( uint32_t ) y >= ( uint32_t ) m->height )
+	{
+		return false;
+	}
+
+	return ( m->pBits[ y * m->nWords + ( x >> 6 ) ] >> ( x & 63 ) ) & 1;
+}
+
+// The 64 bits of a row starting at bit s, which may lie partly or wholly outside it
+static uint64_t SpriteMask_bits ( const uint64_t* row, int32_t nWords, int32_t s )
+{
+	int32_t  k;
+	int32_t  sh;
+	uint64_t lo;
+	uint64_t hi;
+
+	k  = s >> 6;  // arithmetic, so rounds towards minus infinity
+	sh = s & 63;
+
+	lo = k     >= 0 && k     < nWords ? row[ k ]     : 0;
+	hi = k + 1 >= 0 && k + 1 < nWords ? row[ k + 1 ] : 0;
+
+	return sh ? ( lo >> sh ) | ( hi << ( 64 - sh ) ) : lo;
+}
+
+bool SpriteMask_overlap ( const SpriteMask* a, int32_t ax, int32_t ay, const SpriteMask* b, int32_t bx, int32_t by )
+{
+	const uint64_t* ra;
+	const uint64_t* rb;
+	int32_t         dx;
+	int32_t         dy;
+	int32_t         x0;
+	int32_t         y0;
+	int32_t         x1;
+	int32_t         y1;
+	int32_t         k0;
+	int32_t         k1;
+	int32_t         k;
+	int32_t         y;
+
+	if ( ! a || ! b )
+	{
+		return false;
+	}
+
+	// b's position relative to a
+	dx = bx - ax;
+	dy = by - ay;
+
+	// Overlap of the boxes, in a's coordinates
+	x0 = a->box.x > b->box.x + dx ? a->box.x : b->box.x + dx;
+	y0 = a->box.y > b->box.y + dy ? a->box.y : b->box.y + dy;
+	x1 = a->box.x + a->box.w < b->box.x + b->box.w + dx ? a->box.x + a->box.w : b->box.x + b->box.w + dx;
+	y1 = a->box.y + a->box.h < b->box.y + b->box.h + dy ? a->box.y + a->box.h : b->box.y + b->box.h + dy;
+
+	if ( x0 >= x1 || y0 >= y1 )
+	{
+		return false;
+	}
+
+	k0 = x0 >> 6;
+	k1 = ( x1 - 1 ) >> 6;
+
+	for ( y = y0; y < y1; y += 1 )
+	{
+		ra = a->pBits + y * a->nWords;
+		rb = b->pBits + ( y - dy ) * b->nWords;
+
+		for ( k = k0; k <= k1; k += 1 )
+		{
+			if ( ra[ k ] & SpriteMask_bits( rb, b->nWords, k * 64 - dx ) )
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+//================================================================================
+
+/* Scrolling.
+   Copies go row by row with memmove, from the far side of the move
+   inwards so each source row is read before it is overwritten.
+*/
+
+static int32_t PGE_wrap ( int32_t v, int32_t n )
+{
+	v %= n;
+
+	return v < 0 ? v + n : v;
+}
+
+// Splits r, in screen coordinates, into up to four pieces of the ring buffer
+static int32_t PGE_wrapRect ( Rect r, int32_t ox, int32_t oy, int32_t w, int32_t h, Rect* out )
+{
+	Rect    xs [ 2 ];
+	int32_t nx;
+	int32_t ny;
+	int32_t i;
+	int32_t y0;
+	int32_t y1;
+
+	nx = 0;
+
+	if ( r.w == w )
+	{
+		xs[ nx ].x = 0;  xs[ nx ].w = w;  nx += 1;
+	}
+	else
+	{
+		xs[ nx ].x = PGE_wrap( r.x + ox, w );
+		xs[ nx ].w = r.w;
+
+		if ( xs[ nx ].x + r.w > w )
+		{
+			xs[ nx ].w = w - xs[ nx ].x;
+
+			nx += 1;
+
+			xs[ nx ].x = 0;
+			xs[ nx ].w = r.w - xs[ nx - 1 ].w;
+		}
+
+		nx += 1;
+	}
+
+	ny = 0;
+
+	y0 = r.h == h ? 0 : PGE_wrap( r.y + oy, h );
+	y1 = y0 + r.h;
+
+	for ( i = 0; i < nx; i += 1 )
+	{
+		out[ ny ].x = xs[ i ].x;
+		out[ ny ].w = xs[ i ].w;
+		out[ ny ].y = y0;
+		out[ ny ].h = ( y1 > h ? h : y1 ) - y0;
+
+		ny += 1;
+
+		if ( y1 > h )
+		{
+			out[ ny ].x = xs[ i ].x;
+			out[ ny ].w = xs[ i ].w;
+			out[ ny ].y = 0;
+			out[ ny ].h = y1 - h;
+
+			ny += 1;
+		}
+	}
+
+	return ny;
+}
+
+int32_t PGE_scroll ( int32_t dx, int32_t dy, Rect* pExposed )
+{
+	Sprite* sp;
+	Rect    rects   [ 2 ];
+	Rect    wrapped [ PGE_MAX_EXPOSED ];
+	int32_t nRects;
+	bool    bRing;
+	int32_t w;
+	int32_t h;
+	int32_t s;
+	int32_t ax;
+	int32_t n;
+	int32_t y;
+	int32_t i;
+
+	sp = PGE_getDrawTarget();
+
+	if ( ! sp || ( dx == 0 && dy == 0 ) )
+	{
+		return 0;
+	}
+
+	w  = sp->width;
+	h  = sp->height;
+	s  = sp->nStride;
+	ax = dx < 0 ? - dx : dx;
+
+
+	bRing = pCtx->bScrollRing && sp == pCtx->pDefaultDrawTarget;
+
+	if ( bRing )
+	{
+		// Content moving right means showing what is further left
+		pCtx->nScrollOriginX = PGE_wrap( pCtx->nScrollOriginX - dx, w );
+		pCtx->nScrollOriginY = PGE_wrap( pCtx->nScrollOriginY - dy, h );
+	}
+
+
+	// Everything moved out of view
+	if ( ax >= w || dy >= h || - dy >= h )
+	{
+		if ( pExposed )
+		{
+			pExposed[ 0 ].x = 0;
+			pExposed[ 0 ].y = 0;
+			pExposed[ 0 ].w = w;
+			pExposed[ 0 ].h = h;
+		}
+
+		return 1;
+	}
+
+
+	// Uncovered column, then the rest of the uncovered rows
+	nRects = 0;
+
+	if ( dx != 0 )
+	{
+		rects[ nRects ].x = dx > 0 ? 0 : w + dx;
+		rects[ nRects ].y = 0;
+		rects[ nRects ].w = ax;
+		rects[ nRects ].h = h;
+
+		nRects += 1;
+	}
+
+	if ( dy != 0 )
+	{
+		rects[ nRects ].x = dx > 0 ? dx : 0;
+		rects[ nRects ].y = dy > 0 ? 0 : h + dy;
+		rects[ nRects ].w = w - ax;
+		rects[ nRects ].h = dy > 0 ? dy : - dy;
+
+		nRects += 1;
+	}
+
+
+	if ( bRing )
+	{
+		n = 0;
+
+		for ( i = 0; i < nRects; i += 1 )
+		{
+			n += PGE_wrapRect( rects[ i ], pCtx->nScrollOriginX, pCtx->nScrollOriginY, w, h, wrapped + n );
+		}
+
+		if ( pExposed )
+		{
+			memcpy( pExposed, wrapped, n * sizeof( Rect ) );
+		}
+
+		return n;
+	}
+
+
+	if ( dy > 0 )
+	{
+		for ( y = h - 1; y >= dy; y -= 1 )
+		{
+			memmove(
+
+				sp->pColData + y * s + ( dx > 0 ? dx : 0 ),
+				sp->pColData + ( y - dy ) * s + ( dx < 0 ? ax : 0 ),
+				( w - ax ) * sizeof( Pixel )
+			);
+		}
+	}
+	else
+	{
+		for ( y = 0; y < h + dy; y += 1 )
+		{
+			memmove(
+
+				sp->pColData + y * s + ( dx > 0 ? dx : 0 ),
+				sp->pColData + ( y - dy ) * s + ( dx < 0 ? ax : 0 ),
+				( w - ax ) * sizeof( Pixel )
+			);
+		}
+	}
+
+	if ( pExposed )
+	{
+		memcpy( pExposed, rects, nRects * sizeof( Rect ) );
+	}
+
+	return nRects;
+}
+
+enum rcode PGE_setScrollRing ( bool b )
+{
+	Sprite* sp;
+	Pixel*  tmp;
+	Pixel*  row;
+	int32_t w;
+	int32_t h;
+	int32_t s;
+	int32_t ox;
+	int32_t y;
+
+	// Already in that mode, so the origin and pixels stay as they are
+	if ( b == pCtx->bScrollRing )
+	{
+		return OK;
+	}
+
+	PGE_finishTargetInit();
+
+	sp = pCtx->pDefaultDrawTarget;
+
+	// Rotate the pixels back so the origin is at ( 0, 0 )
+	if ( ! b && sp && ( pCtx->nScrollOriginX || pCtx->nScrollOriginY ) )
+	{
+		w  = sp->width;
+		h  = sp->height;
+		s  = sp->nStride;
+		ox = pCtx->nScrollOriginX;
+
+		tmp = ( Pixel* ) malloc( ( size_t ) w * h * sizeof( Pixel ) );
+
+		// Still in ring mode, with nothing moved
+		if ( ! tmp )
+		{
+			return FAIL;
+		}
+
+		for ( y = 0; y < h; y += 1 )
+		{
+			row = sp->pColData + PGE_wrap( y + pCtx->nScrollOriginY, h ) * s;
+
+			memcpy( tmp + y * w, row + ox, ( w - ox ) * sizeof( Pixel ) );
+			memcpy( tmp + y * w + w - ox, row, ox * sizeof( Pixel ) );
+		}
+
+		for ( y = 0; y < h; y += 1 )
+		{
+			memcpy( sp->pColData + y * s, tmp + y * w, w * sizeof( Pixel ) );
+		}
+
+		free( tmp );
+	}
+
+	pCtx->bScrollRing    = b;
+	pCtx->nScrollOriginX = 0;
+	pCtx->nScrollOriginY = 0;
+
+	return OK;
+}
+
+void PGE_getScrollOrigin ( int32_t* ox, int32_t* oy )
+{
+	*ox = pCtx->nScrollOriginX;
+	*oy = pCtx->nScrollOriginY;
+}
+
+
+//================================================================================
+
+/* Layers.
+   Each layer is a sprite with its own texture. Layer 0 wraps the
+   default draw target and is uploaded every frame as before; other
+   layers are only uploaded when marked dirty, and are otherwise
+   composited from their cached textures.
+*/
+
+struct _Layer
+{
+	Sprite* pSprite;
+	GLuint  glTexture;  // 0 until first presented
+	bool    bEnabled;
+	bool    bDirty;
+};
+
+typedef struct _Layer Layer;
+
+static int32_t PGE_addLayer ( Sprite* sp )
+{
+	Layer* layer;
+
+	if ( pCtx->nLayers == pCtx->nLayerCap )
+	{
+		pCtx->nLayerCap = pCtx->nLayerCap ? pCtx->nLayerCap * 2 : 4;
+		pCtx->pLayers   = ( Layer* ) realloc( pCtx->pLayers, pCtx->nLayerCap * sizeof( Layer ) );
+	}
+
+	layer = pCtx->pLayers + pCtx->nLayers;
+
+	layer->pSprite   = sp;
+	layer->glTexture = 0;
+	layer->bEnabled  = true;
+	layer->bDirty    = true;
+
+	pCtx->nLayers += 1;
+
+	return pCtx->nLayers - 1;
+}
+
+int32_t PGE_createLayer ( void )
+{
+	Sprite* sp;
+
+	sp = Sprite_new( PGE_SCREEN_WIDTH, PGE_SCREEN_HEIGHT );
+
+	// Fully transparent, so layers behind show through
+	memset( sp->pColData, 0, PGE_SCREEN_WIDTH * PGE_SCREEN_HEIGHT * sizeof( Pixel ) );
+
+	return PGE_addLayer( sp );
+}
+
+void PGE_enableLayer ( int32_t layer, bool b )
+{
+	if ( layer >= 0 && layer < pCtx->nLayers )
+	{
+		pCtx->pLayers[ layer ].bEnabled = b;
+	}
+}
+
+void PGE_setDrawTargetLayer ( int32_t layer )
+{
+	if ( layer >= 0 && layer < pCtx->nLayers )
+	{
+		pCtx->pLayers[ layer ].bDirty = true;
+
+		PGE_setDrawTarget( pCtx->pLayers[ layer ].pSprite );
+	}
+}
+
+void PGE_setLayerDirty ( int32_t layer )
+{
+	if ( layer >= 0 && layer < pCtx->nLayers )
+	{
+		pCtx->pLayers[ layer ].bDirty = true;
+	}
+}
+
+Sprite* PGE_getLayerSprite ( int32_t layer )
+{
+	if ( layer >= 0 && layer < pCtx->nLayers )
+	{
+		if ( pCtx->pLayers[ layer ].pSprite == pCtx->pDefaultDrawTarget )
+		{
+			PGE_finishTargetInit();
+		}
+
+		return pCtx->pLayers[ layer ].pSprite;
+	}
+
+	return NULL;
+}
+
+int32_t PGE_getLayerCount ( void )
+{
+	return pCtx->nLayers;
+}
+
+// Needs a current OpenGL context
+static GLuint PGE_createTexture ( Sprite* sp )
+{
+	GLuint tex;
+
+	// Disable filtering
+	glGenTextures( 1, &tex );
+	glBindTexture( GL_TEXTURE_2D, tex );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+
+	// Rows are nStride apart in views
+	glPixelStorei( GL_UNPACK_ROW_LENGTH, sp->nStride );
+
+	glTexImage2D(
+
+		GL_TEXTURE_2D,
+		0,
+		GL_RGBA,
+		sp->width, sp->height,
+		0,
+		GL_RGBA,
+		GL_UNSIGNED_BYTE,
+		Sprite_getData( sp )
+	);
+
+	glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+
+	return tex;
+}
+
+
+//================================================================================
+
+/* Decals.
+   Quads are queued with their corners already in normalised device
+   coordinates, and drawn from client side vertex arrays after the
+   layers. Consecutive quads using the same texture share a run, and
+   each run is a single draw call.
+*/
+
+struct _Decal
+{
+	Sprite* pSprite;
+	GLuint  glTexture;  // 0 when headless
+};
+
+struct _DecalVertex
+{
+	float x;
+	float y;
+	float u;
+	float v;
+	Pixel col;
+};
+
+struct _DecalRun
+{
+	GLuint  glTexture;
+	int32_t nFirst;
+	int32_t nCount;
+};
+
+typedef struct _DecalVertex DecalVertex;
+typedef struct _DecalRun    DecalRun;
+
+Decal* Decal_new ( Sprite* sp )
+{
+	Decal* d;
+
+	d = ( Decal* ) malloc( sizeof( Decal ) );
+
+	d->pSprite   = sp;
+	d->glTexture = pCtx->bHeadless ? 0 : PGE_createTexture( sp );
+
+	return d;
+}
+
+void Decal_update ( Decal* d )
+{
+	if ( ! d->glTexture )
+	{
+		return;
+	}
+
+	glBindTexture( GL_TEXTURE_2D, d->glTexture );
+	glPixelStorei( GL_UNPACK_ROW_LENGTH, d->pSprite->nStride );
+
+	glTexSubImage2D(
+
+		GL_TEXTURE_2D,
+		0, 0, 0,
+		d->pSprite->width, d->pSprite->height,
+		GL_RGBA,
+		GL_UNSIGNED_BYTE,
+		Sprite_getData( d->pSprite )
+	);
+
+	glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+}
+
+/* Drops the quads queued this frame that use texture tex, keeping the
+   rest of the batch, and its order, intact.
+*/
+static void PGE_dropDecalRuns ( GLuint tex )
+{
+	DecalRun  run;
+	DecalRun* last;
+	int32_t   nRuns;
+	int32_t   nVerts;
+	int32_t   i;
+
+	nRuns  = 0;
+	nVerts = 0;
+
+	for ( i = 0; i < pCtx->nDecalRuns; i += 1 )
+	{
+		run = pCtx->pDecalRuns[ i ];
+
+		if ( run.glTexture == tex )
+		{
+			continue;
+		}
+
+		memmove( pCtx->pDecalVerts + nVerts, pCtx->pDecalVerts + run.nFirst, run.nCount * sizeof( DecalVertex ) );
+
+		last = nRuns ? pCtx->pDecalRuns + nRuns - 1 : NULL;
+
+		// Runs either side of a dropped one may now join up
+		if ( last && last->glTexture == run.glTexture )
+		{
+			last->nCount += run.nCount;
+		}
+		else
+		{
+			run.nFirst = nVerts;
+
+			pCtx->pDecalRuns[ nRuns ] = run;
+
+			nRuns += 1;
+		}
+
+		nVerts += run.nCount;
+	}
+
+	pCtx->nDecalRuns  = nRuns;
+	pCtx->nDecalVerts = nVerts;
+}
+
+void Decal_free ( Decal* d )
+{
+	if ( d->glTexture )
+	{
+		// Quads queued this frame must not draw with a deleted texture
+		PGE_dropDecalRuns( d->glTexture );
+
+		glDeleteTextures( 1, &d->glTexture );
+	}
+
+	free( d );
+}
+
+/* Queues a quad with corners pos[ 0..7 ], in screen pixels and in the
+   order top left, top right, bottom right, bottom left of the source
+   rectangle ( u0, v0 ) to ( u1, v1 ).
+*/
+static void PGE_queueDecalQuad ( Decal* d, const float pos [ 8 ], float u0, float v0, float u1, float v1, Pixel tint )
+{
+	DecalVertex* vtx;
+	DecalRun*    run;
+	float        sx;
+	float        sy;
+	int32_t      i;
+
+	if ( ! d || ! d->glTexture )
+	{
+		return;
+	}
+
+	if ( pCtx->nDecalVerts + 4 > pCtx->nDecalVertCap )
+	{
+		pCtx->nDecalVertCap = pCtx->nDecalVertCap ? pCtx->nDecalVertCap * 2 : 1024;
+		pCtx->pDecalVerts   = ( DecalVertex* ) realloc( pCtx->pDecalVerts, pCtx->nDecalVertCap * sizeof( DecalVertex ) );
+	}
+
+	run = pCtx->nDecalRuns ? pCtx->pDecalRuns + pCtx->nDecalRuns - 1 : NULL;
+
+	if ( ! run || run->glTexture != d->glTexture )
+	{
+		if ( pCtx->nDecalRuns == pCtx->nDecalRunCap )
+		{
+			pCtx->nDecalRunCap = pCtx->nDecalRunCap ? pCtx->nDecalRunCap * 2 : 64;
+			pCtx->pDecalRuns   = ( DecalRun* ) realloc( pCtx->pDecalRuns, pCtx->nDecalRunCap * sizeof( DecalRun ) );
+		}
+
+		run = pCtx->pDecalRuns + pCtx->nDecalRuns;
+
+		run->glTexture = d->glTexture;
+		run->nFirst    = pCtx->nDecalVerts;
+		run->nCount    = 0;
+
+		pCtx->nDecalRuns += 1;
+	}
+
+	sx = 2.0f / PGE_SCREEN_WIDTH;
+	sy = 2.0f / PGE_SCREEN_HEIGHT;
+
+	vtx = pCtx->pDecalVerts + pCtx->nDecalVerts;
+
+	for ( i = 0; i < 4; i += 1 )
+	{
+		vtx[ i ].x   = pos[ i * 2 + 0 ] * sx - 1.0f;
+		vtx[ i ].y   = 1.0f - pos[ i * 2 + 1 ] * sy;
+		vtx[ i ].col = tint;
+	}
+
+	vtx[ 0 ].u = u0;  vtx[ 0 ].v = v0;
+	vtx[ 1 ].u = u1;  vtx[ 1 ].v = v0;
+	vtx[ 2 ].u = u1;  vtx[ 2 ].v = v1;
+	vtx[ 3 ].u = u0;  vtx[ 3 ].v = v1;
+
+	pCtx->nDecalVerts += 4;
+	run->nCount       += 4;
+}
+
+void PGE_drawPartialDecal ( float x, float y, Decal* d, float sx, float sy, float sw, float sh, float fScaleX, float fScaleY, Pixel tint )
+{
+	float pos [ 8 ];
+	float w;
+	float h;
+
+	if ( ! d )
+	{
+		return;
+	}
+
+	w = sw * fScaleX;
+	h = sh * fScaleY;
+
+	pos[ 0 ] = x;      pos[ 1 ] = y;
+	pos[ 2 ] = x + w;  pos[ 3 ] = y;
+	pos[ 4 ] = x + w;  pos[ 5 ] = y + h;
+	pos[ 6 ] = x;      pos[ 7 ] = y + h;
+
+	PGE_queueDecalQuad(
+
+		d, pos,
+		sx / d->pSprite->width,
+		sy / d->pSprite->height,
+		( sx + sw ) / d->pSprite->width,
+		( sy + sh ) / d->pSprite->height,
+		tint
+	);
+}
+
+void PGE_drawDecal ( float x, float y, Decal* d, float fScaleX, float fScaleY, Pixel tint )
+{
+	if ( ! d )
+	{
+		return;
+	}
+
+	PGE_drawPartialDecal( x, y, d, 0, 0, d->pSprite->width, d->pSprite->height, fScaleX, fScaleY, tint );
+}
+
+void PGE_drawDecalTransformed ( Decal* d, const float m [ 6 ], Pixel tint )
+{
+	float   pos [ 8 ];
+	float   w;
+	float   h;
+	int32_t i;
+
+	if ( ! d )
+	{
+		return;
+	}
+
+	w = d->pSprite->width;
+	h = d->pSprite->height;
+
+	pos[ 0 ] = 0;  pos[ 1 ] = 0;
+	pos[ 2 ] = w;  pos[ 3 ] = 0;
+	pos[ 4 ] = w;  pos[ 5 ] = h;
+	pos[ 6 ] = 0;  pos[ 7 ] = h;
+
+	for ( i = 0; i < 8; i += 2 )
+	{
+		w = pos[ i ];
+		h = pos[ i + 1 ];
+
+		pos[ i ]     = m[ 0 ] * w + m[ 1 ] * h + m[ 2 ];
+		pos[ i + 1 ] = m[ 3 ] * w + m[ 4 ] * h + m[ 5 ];
+	}
+
+	PGE_queueDecalQuad( d, pos, 0.0f, 0.0f, 1.0f, 1.0f, tint );
+}
+
+// Draws and empties the frame's batch, the GL context must be current
+static void PGE_drawDecals ( void )
+{
+	DecalRun* run;
+	int32_t   i;
+
+	if ( pCtx->nDecalVerts == 0 )
+	{
+		return;
+	}
+
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+	glEnableClientState( GL_COLOR_ARRAY );
+
+	glVertexPointer( 2, GL_FLOAT, sizeof( DecalVertex ), &pCtx->pDecalVerts[ 0 ].x );
+	glTexCoordPointer( 2, GL_FLOAT, sizeof( DecalVertex ), &pCtx->pDecalVerts[ 0 ].u );
+	glColorPointer( 4, GL_UNSIGNED_BYTE, sizeof( DecalVertex ), &pCtx->pDecalVerts[ 0 ].col );
+
+	for ( i = 0; i < pCtx->nDecalRuns; i += 1 )
+	{
+		run = pCtx->pDecalRuns + i;
+
+		glBindTexture( GL_TEXTURE_2D, run->glTexture );
+		glDrawArrays( GL_QUADS, run->nFirst, run->nCount );
+	}
+
+	glDisableClientState( GL_VERTEX_ARRAY );
+	glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+	glDisableClientState( GL_COLOR_ARRAY );
+
+	// Drawing with a colour array leaves the current colour undefined
+	glColor4ub( 255, 255, 255, 255 );
+
+	pCtx->nDecalVerts = 0;
+	pCtx->nDecalRuns  = 0;
+}
+
+
+//================================================================================
+
+/* Atlases.
+   Each page keeps a skyline, the outline of the tops of what has been
+   placed so far, as runs of x positions with a height each. A sprite
+   goes where it sits lowest on the skyline, ties going to the run
+   whose width it fills most closely, and the runs it covers merge into
+   one. A new page is started when none of the existing ones fit.
+*/
+
+struct _SkylineNode
+{
+	int32_t x;
+	int32_t y;
+	int32_t width;
+};
+
+struct _AtlasPage
+{
+	Sprite* pSprite;
+	Decal*  pDecal;
+	bool    bDirty;  // sprites added since the decal was uploaded
+
+	struct _SkylineNode* pNodes;
+	int32_t              nNodes;
+};
+
+struct _Atlas
+{
+	int32_t nPageWidth;
+	int32_t nPageHeight;
+	int32_t nPadding;
+
+	struct _AtlasPage* pPages;
+	int32_t            nPages;
+
+	AtlasEntry* pEntries;
+	int32_t     nEntries;
+	int32_t     nEntryCap;
+};
+
+typedef struct _SkylineNode SkylineNode;
+typedef struct _AtlasPage   AtlasPage;
+
+Atlas* Atlas_new ( int32_t nPageWidth, int32_t nPageHeight, int32_t nPadding )
+{
+	Atlas* at;
+
+	if ( nPageWidth <= 0 || nPageHeight <= 0 || nPadding < 0 )
+	{
+		return NULL;
+	}
+
+	at = ( Atlas* ) calloc( 1, sizeof( Atlas ) );
+
+	at->nPageWidth  = nPageWidth;
+	at->nPageHeight = nPageHeight;
+	at->nPadding    = nPadding;
+
+	return at;
+}
+
+void Atlas_free ( Atlas* at )
+{
+	int32_t i;
+
+	if ( ! at )
+	{
+		return;
+	}
+
+	for ( i = 0; i < at->nPages; i += 1 )
+	{
+		if ( at->pPages[ i ].pDecal )
+		{
+			Decal_free( at->pPages[ i ].pDecal );
+		}
+
+		Sprite_free( at->pPages[ i ].pSprite );
+		free( at->pPages[ i ].pNodes );
+	}
+
+	free( at->pPages );
+	free( at->pEntries );
+	free( at );
+}
+
+static AtlasPage* Atlas_addPage ( Atlas* at )
+{
+	AtlasPage* page;
+
+	at->pPages = ( AtlasPage* ) realloc( at->pPages, ( at->nPages + 1 ) * sizeof( AtlasPage ) );
+
+	page = at->pPages + at->nPages;
+
+	page->pSprite = Sprite_alloc( at->nPageWidth, at->nPageHeight );
+	page->pDecal  = NULL;
+	page->bDirty  = true;
+
+	memset( page->pSprite->pColData, 0, at->nPageWidth * at->nPageHeight * sizeof( Pixel ) );
+
+	// A run is at least a pixel wide, so there are never more runs than columns, plus one mid insert
+	page->pNodes = ( SkylineNode* ) malloc( ( at->nPageWidth + 1 ) * sizeof( SkylineNode ) );
+	page->nNodes = 1;
+
+	page->pNodes[ 0 ].x     = 0;
+	page->pNodes[ 0 ].y     = 0;
+	page->pNodes[ 0 ].width = at->nPageWidth;
+
+	at->nPages += 1;
+
+	return page;
+}
+
+// Height at which a w x h rectangle fits starting at run i, or -1
+static int32_t Skyline_fit ( Atlas* at, AtlasPage* page, int32_t i, int32_t w, int32_t h )
+{
+	int32_t x;
+	int32_t y;
+	int32_t left;
+
+	x = page->pNodes[ i ].x;
+
+	if ( x + w > at->nPageWidth )
+	{
+		return -1;
+	}
+
+	y    = 0;
+	left = w;
+
+	for ( ; left > 0; i += 1 )
+	{
+		if ( page->pNodes[ i ].y > y )
+		{
+			y = page->pNodes[ i ].y;
+		}
+
+		if ( y + h > at->nPageHeight )
+		{
+			return -1;
+		}
+
+		left -= page->pNodes[ i ].width;
+	}
+
+	return y;
+}
+
+// Places a w x h rectangle, returns false if the page is too full
+static bool Skyline_insert ( Atlas* at, AtlasPage* page, int32_t w, int32_t h, int32_t* px, int32_t* py )
+{
+	SkylineNode* node;
+	int32_t      best;
+	int32_t      bestY;
+	int32_t      bestWidth;
+	int32_t      shrink;
+	int32_t      y;
+	int32_t      i;
+
+	best      = -1;
+	bestY     = 0;
+	bestWidth = 0;
+
+	for ( i = 0; i < page->nNodes; i += 1 )
+	{
+		y = Skyline_fit( at, page, i, w, h );
+
+		if ( y < 0 )
+		{
+			continue;
+		}
+
+		if ( best < 0 || y < bestY || ( y == bestY && page->pNodes[ i ].width < bestWidth ) )
+		{
+			best      = i;
+			bestY     = y;
+			bestWidth = page->pNodes[ i ].width;
+		}
+	}
+
+	if ( best < 0 )
+	{
+		return false;
+	}
+
+	*px = page->pNodes[ best ].x;
+	*py = bestY;
+
+
+	// New run on top of the rectangle
+	memmove( page->pNodes + best + 1, page->pNodes + best, ( page->nNodes - best ) * sizeof( SkylineNode ) );
+
+	page->pNodes[ best ].x     = *px;
+	page->pNodes[ best ].y     = bestY + h;
+	page->pNodes[ best ].width = w;
+
+	page->nNodes += 1;
+
+
+	// Runs it covers shrink or go
+	i = best + 1;
+
+	while ( i < page->nNodes )
+	{
+		node   = page->pNodes + i;
+		shrink = *px + w - node->x;
+
+		if ( shrink <= 0 )
+		{
+			break;
+		}
+
+		if ( shrink < node->width )
+		{
+			node->x     += shrink;
+			node->width -= shrink;
+
+			break;
+		}
+
+		memmove( node, node + 1, ( page->nNodes - i - 1 ) * sizeof( SkylineNode ) );
+
+		page->nNodes -= 1;
+	}
+
+
+	// Neighbouring runs at the same height merge
+	for ( i = 0; i + 1 < page->nNodes; )
+	{
+		if ( page->pNodes[ i ].y == page->pNodes[ i + 1 ].y )
+		{
+			page->pNodes[ i ].width += page->pNodes[ i + 1 ].width;
+
+			memmove( page->pNodes + i + 1, page->pNodes + i + 2, ( page->nNodes - i - 2 ) * sizeof( SkylineNode ) );
+
+			page->nNodes -= 1;
+		}
+		else
+		{
+			i += 1;
+		}
+	}
+
+	return true;
+}
+
+int32_t Atlas_add ( Atlas* at, Sprite* sp )
+{
+	AtlasPage*  page;
+	AtlasEntry* e;
+	int32_t     w;
+	int32_t     h;
+	int32_t     x;
+	int32_t     y;
+	int32_t     i;
+
+	if ( ! at || ! sp )
+	{
+		return -1;
+	}
+
+	// Padding goes to the right of and below each sprite
+	w = sp->width  + at->nPadding;
+	h = sp->height + at->nPadding;
+
+	if ( w > at->nPageWidth || h > at->nPageHeight || sp->width <= 0 || sp->height <= 0 )
+	{
+		return -1;
+	}
+
+	page = NULL;
+
+	for ( i = 0; i < at->nPages; i += 1 )
+	{
+		if ( Skyline_insert( at, at->pPages + i, w, h, &x, &y ) )
+		{
+			page = at->pPages + i;
+
+			break;
+		}
+	}
+
+	if ( ! page )
+	{
+		page = Atlas_addPage( at );
+
+		Skyline_insert( at, page, w, h, &x, &y );
+	}
+
+	for ( i = 0; i < sp->height; i += 1 )
+	{
+		memcpy(
+
+			page->pSprite->pColData + ( y + i ) * at->nPageWidth + x,
+			sp->pColData + i * sp->nStride,
+			sp->width * sizeof( Pixel )
+		);
+	}
+
+	page->bDirty = true;
+
+
+	if ( at->nEntries == at->nEntryCap )
+	{
+		at->nEntryCap = at->nEntryCap ? at->nEntryCap * 2 : 64;
+		at->pEntries  = ( AtlasEntry* ) realloc( at->pEntries, at->nEntryCap * sizeof( AtlasEntry ) );
+	}
+
+	e = at->pEntries + at->nEntries;
+
+	e->nPage  = ( int32_t ) ( page - at->pPages );
+	e->x      = x;
+	e->y      = y;
+	e->width  = sp->width;
+	e->height = sp->height;
+	e->u0     = ( float ) x / at->nPageWidth;
+	e->v0     = ( float ) y / at->nPageHeight;
+	e->u1     = ( float ) ( x + sp->width )  / at->nPageWidth;
+	e->v1     = ( float ) ( y + sp->height ) / at->nPageHeight;
+
+	at->nEntries += 1;
+
+	return at->nEntries - 1;
+}
+
+// qsort takes no context, so the sprites being sorted are passed aside
+static PGE_THREAD_LOCAL Sprite** Atlas_sortSprites;
+
+// Tallest first, then widest, missing sprites last
+static int Atlas_compareHeight ( const void* a, const void* b )
+{
+	Sprite* sa;
+	Sprite* sb;
+	int32_t ha;
+	int32_t hb;
+
+	sa = Atlas_sortSprites[ *( const int32_t* ) a ];
+	sb = Atlas_sortSprites[ *( const int32_t* ) b ];
+
+	ha = sa ? sa->height : -1;
+	hb = sb ? sb->height : -1;
+
+	if ( ha != hb || ! sa || ! sb )
+	{
+		return hb - ha;
+	}
+
+	return sb->width - sa->width;
+}
+
+bool Atlas_addMany ( Atlas* at, Sprite** sprites, int32_t count, int32_t* handles )
+{
+	int32_t* order;
+	int32_t  i;
+	bool     bOk;
+
+	order = ( int32_t* ) malloc( count * sizeof( int32_t ) );
+
+	for ( i = 0; i < count; i += 1 )
+	{
+		order[ i ] = i;
+	}
+
+	Atlas_sortSprites = sprites;
+
+	qsort( order, count, sizeof( int32_t ), Atlas_compareHeight );
+
+	bOk = true;
+
+	for ( i = 0; i < count; i += 1 )
+	{
+		handles[ order[ i ] ] = Atlas_add( at, sprites[ order[ i ] ] );
+
+		bOk = bOk && handles[ order[ i ] ] >= 0;
+	}
+
+	free( order );
+
+	return bOk;
+}
+
+const AtlasEntry* Atlas_getEntry ( Atlas* at, int32_t handle )
+{
+	if ( ! at || handle < 0 || handle >= at->nEntries )
+	{
+		return NULL;
+	}
+
+	return at->pEntries + handle;
+}
+
+int32_t Atlas_getPageCount ( Atlas* at )
+{
+	return at ? at->nPages : 0;
+}
+
+Sprite* Atlas_getPage ( Atlas* at, int32_t page )
+{
+	if ( ! at || page < 0 || page >= at->nPages )
+	{
+		return NULL;
+	}
+
+	return at->pPages[ page ].pSprite;
+}
+
+Decal* Atlas_getDecal ( Atlas* at, int32_t page )
+{
+	AtlasPage* p;
+
+	if ( ! at || page < 0 || page >= at->nPages )
+	{
+		return NULL;
+	}
+
+	p = at->pPages + page;
+
+	if ( ! p->pDecal )
+	{
+		p->pDecal = Decal_new( p->pSprite );
+	}
+	else if ( p->bDirty )
+	{
+		Decal_update( p->pDecal );
+	}
+
+	p->bDirty = false;
+
+	return p->pDecal;
+}
+
+void PGE_drawAtlasSprite ( int32_t x, int32_t y, Atlas* at, int32_t handle )
+{
+	const AtlasEntry* e;
+
+	e = Atlas_getEntry( at, handle );
+
+	if ( e )
+	{
+		PGE_drawPartialSprite( x, y, at->pPages[ e->nPage ].pSprite, e->x, e->y, e->width, e->height );
+	}
+}
+
+void PGE_drawAtlasDecal ( float x, float y, Atlas* at, int32_t handle, float fScaleX, float fScaleY, Pixel tint )
+{
+	const AtlasEntry* e;
+
+	e = Atlas_getEntry( at, handle );
+
+	if ( e )
+	{
+		PGE_drawPartialDecal(
+
+			x, y,
+			Atlas_getDecal( at, e->nPage ),
+			e->x, e->y, e->width, e->height,
+			fScaleX, fScaleY,
+			tint
+		);
+	}
+}
+
+
+//================================================================================
+
+/* Tile maps.
+   Chunk sprites are created lazily, so only the parts of a map that
+   have been on screen take memory. A chunk at the map's right or
+   bottom edge is cut down to the tiles it has. Each chunk counts its
+   drawn tiles when rendered: a full chunk is drawn whole, and one with
+   empty tiles only along its runs of drawn tiles.
+*/
+
+#define TILEMAP_CHUNK 16
+
+struct _TileMap
+{
+	int32_t  nWidth;   // in tiles
+	int32_t  nHeight;
+	int32_t  nTileWidth;
+	int32_t  nTileHeight;
+	int32_t* pTiles;
+	Sprite*  pTileSheet;
+
+	int32_t  nChunksX;
+	int32_t  nChunksY;
+	Sprite** ppChunks;
+	bool*    pChunkDirty;
+	int32_t* pChunkTiles;  // tiles drawn into each chunk when last rendered
+};
+
+TileMap* TileMap_new ( int32_t w, int32_t h, int32_t nTileWidth, int32_t nTileHeight, Sprite* pTileSheet )
+{
+	TileMap* tm;
+	int32_t  i;
+
+	if ( w <= 0 || h <= 0 || nTileWidth <= 0 || nTileHeight <= 0 || ! pTileSheet )
+	{
+		return NULL;
+	}
+
+	tm = ( TileMap* ) calloc( 1, sizeof( TileMap ) );
+
+	tm->nWidth      = w;
+	tm->nHeight     = h;
+	tm->nTileWidth  = nTileWidth;
+	tm->nTileHeight = nTileHeight;
+	tm->pTileSheet  = pTileSheet;
+
+	tm->pTiles = ( int32_t* ) malloc( w * h * sizeof( int32_t ) );
+
+	for ( i = 0; i < w * h; i += 1 )
+	{
+		tm->pTiles[ i ] = -1;
+	}
+
+	tm->nChunksX = ( w + TILEMAP_CHUNK - 1 ) / TILEMAP_CHUNK;
+	tm->nChunksY = ( h + TILEMAP_CHUNK - 1 ) / TILEMAP_CHUNK;
+
+	tm->ppChunks    = ( Sprite** ) calloc( tm->nChunksX * tm->nChunksY, sizeof( Sprite* ) );
+	tm->pChunkDirty = ( bool* ) calloc( tm->nChunksX * tm->nChunksY, sizeof( bool ) );
+	tm->pChunkTiles = ( int32_t* ) calloc( tm->nChunksX * tm->nChunksY, sizeof( int32_t ) );
+
+	return tm;
+}
+
+void TileMap_free ( TileMap* tm )
+{
+	int32_t i;
+
+	if ( ! tm )
+	{
+		return;
+	}
+
+	for ( i = 0; i < tm->nChunksX * tm->nChunksY; i += 1 )
+	{
+		if ( tm->ppChunks[ i ] )
+		{
+			Sprite_free( tm->ppChunks[ i ] );
+		}
+	}
+
+	free( tm->ppChunks );
+	free( tm->pChunkDirty );
+	free( tm->pChunkTiles );
+	free( tm->pTiles );
+	free( tm );
+}
+
+void TileMap_setTile ( TileMap* tm, int32_t x, int32_t y, int32_t tile )
+{
+	int32_t* t;
+
+	if ( x < 0 || y < 0 || x >= tm->nWidth || y >= tm->nHeight )
+	{
+		return;
+	}
+
+	t = tm->pTiles + y * tm->nWidth + x;
+
+	if ( *t != tile )
+	{
+		*t = tile;
+
+		tm->pChunkDirty[ ( y / TILEMAP_CHUNK ) * tm->nChunksX + x / TILEMAP_CHUNK ] = true;
+	}
+}
+
+int32_t TileMap_getTile ( TileMap* tm, int32_t x, int32_t y )
+{
+	if ( x < 0 || y < 0 || x >= tm->nWidth || y >= tm->nHeight )
+	{
+		return -1;
+	}
+
+	return tm->pTiles[ y * tm->nWidth + x ];
+}
+
+void TileMap_refresh ( TileMap* tm )
+{
+	int32_t i;
+
+	for ( i = 0; i < tm->nChunksX * tm->nChunksY; i += 1 )
+	{
+		tm->pChunkDirty[ i ] = true;
+	}
+}
+
+// Tiles past these, like empty ones, are not drawn
+static int32_t TileMap_sheetTiles ( TileMap* tm )
+{
+	return ( tm->pTileSheet->width / tm->nTileWidth ) * ( tm->pTileSheet->height / tm->nTileHeight );
+}
+
+// Copies each tile's rows into the chunk, empty and unknown tiles are left transparent
+static void TileMap_renderChunk ( TileMap* tm, int32_t cx, int32_t cy )
+{
+	Sprite*  chunk;
+	Sprite*  sheet;
+	int32_t  nTilesX;
+	int32_t  nTilesY;
+	int32_t  nSheetCols;
+	int32_t  nSheetTiles;
+	int32_t  nDrawn;
+	int32_t  tile;
+	int32_t  tx;
+	int32_t  ty;
+	int32_t  j;
+	Pixel*   src;
+	Pixel*   dst;
+
+	nTilesX = tm->nWidth  - cx * TILEMAP_CHUNK;
+	nTilesY = tm->nHeight - cy * TILEMAP_CHUNK;
+
+	if ( nTilesX > TILEMAP_CHUNK ) { nTilesX = TILEMAP_CHUNK; }
+	if ( nTilesY > TILEMAP_CHUNK ) { nTilesY = TILEMAP_CHUNK; }
+
+	chunk = tm->ppChunks[ cy * tm->nChunksX + cx ];
+
+	if ( ! chunk )
+	{
+		chunk = Sprite_alloc( nTilesX * tm->nTileWidth, nTilesY * tm->nTileHeight );
+
+		tm->ppChunks[ cy * tm->nChunksX + cx ] = chunk;
+	}
+
+	memset( chunk->pColData, 0, chunk->width * chunk->height * sizeof( Pixel ) );
+
+	sheet       = tm->pTileSheet;
+	nSheetCols  = sheet->width / tm->nTileWidth;
+	nSheetTiles = TileMap_sheetTiles( tm );
+	nDrawn      = 0;
+
+	for ( ty = 0; ty < nTilesY; ty += 1 )
+	{
+		for ( tx = 0; tx < nTilesX; tx += 1 )
+		{
+			tile = tm->pTiles[ ( cy * TILEMAP_CHUNK + ty ) * tm->nWidth + cx * TILEMAP_CHUNK + tx ];
+
+			if ( tile < 0 || tile >= nSheetTiles )
+			{
+				continue;
+			}
+
+			nDrawn += 1;
+
+			src = sheet->pColData + ( tile / nSheetCols ) * tm->nTileHeight * sheet->nStride + ( tile % nSheetCols ) * tm->nTileWidth;
+			dst = chunk->pColData + ty * tm->nTileHeight * chunk->width + tx * tm->nTileWidth;
+
+			for ( j = 0; j < tm->nTileHeight; j += 1 )
+			{
+				memcpy( dst + j * chunk->width, src + j * sheet->nStride, tm->nTileWidth * sizeof( Pixel ) );
+			}
+		}
+	}
+
+	tm->pChunkDirty[ cy * tm->nChunksX + cx ] = false;
+	tm->pChunkTiles[ cy * tm->nChunksX + cx ] = nDrawn;
+}
+
+// Draws each row's runs of drawn tiles, so empty tiles leave the target as it was in any pixel mode
+static void TileMap_drawChunkTiles ( TileMap* tm, int32_t cx, int32_t cy, int32_t x, int32_t y )
+{
+	Sprite*  chunk;
+	int32_t* row;
+	int32_t  nTilesX;
+	int32_t  nTilesY;
+	int32_t  nSheetTiles;
+	int32_t  tx;
+	int32_t  ty;
+	int32_t  n;
+
+	chunk       = tm->ppChunks[ cy * tm->nChunksX + cx ];
+	nTilesX     = chunk->width  / tm->nTileWidth;
+	nTilesY     = chunk->height / tm->nTileHeight;
+	nSheetTiles = TileMap_sheetTiles( tm );
+
+	for ( ty = 0; ty < nTilesY; ty += 1 )
+	{
+		row = tm->pTiles + ( cy * TILEMAP_CHUNK + ty ) * tm->nWidth + cx * TILEMAP_CHUNK;
+		tx  = 0;
+
+		while ( tx < nTilesX )
+		{
+			if ( row[ tx ] < 0 || row[ tx ] >= nSheetTiles )
+			{
+				tx += 1;
+
+				continue;
+			}
+
+			n = tx + 1;
+
+			while ( n < nTilesX && row[ n ] >= 0 && row[ n ] < nSheetTiles )
+			{
+				n += 1;
+			}
+
+			PGE_drawPartialSprite(
+
+				x + tx * tm->nTileWidth, y + ty * tm->nTileHeight,
+				chunk,
+				tx * tm->nTileWidth, ty * tm->nTileHeight,
+				( n - tx ) * tm->nTileWidth, tm->nTileHeight
+			);
+
+			tx = n;
+		}
+	}
+}
+
+void PGE_drawTileMap ( TileMap* tm, int32_t nScrollX, int32_t nScrollY )
+{
+	int32_t nChunkW;
+	int32_t nChunkH;
+	int32_t cx0;
+	int32_t cy0;
+	int32_t cx1;
+	int32_t cy1;
+	int32_t cx;
+	int32_t cy;
+	int32_t vx;
+	int32_t vy;
+	int32_t i;
+	Sprite* chunk;
+	Rect    c;
+
+	if ( ! tm || ! pCtx->pDrawTarget )
+	{
+		return;
+	}
+
+	nChunkW = TILEMAP_CHUNK * tm->nTileWidth;
+	nChunkH = TILEMAP_CHUNK * tm->nTileHeight;
+
+	// The clip rectangle's top left, in map pixels
+	c  = pCtx->clip;
+	vx = nScrollX + c.x;
+	vy = nScrollY + c.y;
+
+	if ( c.w <= 0 || c.h <= 0 || vx + c.w <= 0 || vy + c.h <= 0 )
+	{
+		return;
+	}
+
+
+	// Chunks overlapping the view, rounding down towards minus infinity
+	cx0 = vx >= 0 ? vx / nChunkW : - ( ( nChunkW - 1 - vx ) / nChunkW );
+	cy0 = vy >= 0 ? vy / nChunkH : - ( ( nChunkH - 1 - vy ) / nChunkH );
+	cx1 = ( vx + c.w - 1 ) / nChunkW;
+	cy1 = ( vy + c.h - 1 ) / nChunkH;
+
+	if ( cx0 < 0 ) { cx0 = 0; }
+	if ( cy0 < 0 ) { cy0 = 0; }
+	if ( cx1 >= tm->nChunksX ) { cx1 = tm->nChunksX - 1; }
+	if ( cy1 >= tm->nChunksY ) { cy1 = tm->nChunksY - 1; }
+
+	for ( cy = cy0; cy <= cy1; cy += 1 )
+	{
+		for ( cx = cx0; cx <= cx1; cx += 1 )
+		{
+			i = cy * tm->nChunksX + cx;
+
+			if ( ! tm->ppChunks[ i ] || tm->pChunkDirty[ i ] )
+			{
+				TileMap_renderChunk( tm, cx, cy );
+			}
+
+			chunk = tm->ppChunks[ i ];
+
+			// Whole chunks in the caller's pixel mode, others around their empty tiles
+			if ( tm->pChunkTiles[ i ] * tm->nTileWidth * tm->nTileHeight == chunk->width * chunk->height )
+			{
+				PGE_drawSprite( cx * nChunkW - nScrollX, cy * nChunkH - nScrollY, chunk );
+			}
+			else if ( tm->pChunkTiles[ i ] > 0 )
+			{
+				TileMap_drawChunkTiles( tm, cx, cy, cx * nChunkW - nScrollX, cy * nChunkH - nScrollY );
+			}
+		}
+	}
+}
+
+
+//================================================================================
+
+/* Particles.
+   Fields are kept in parallel arrays, padded to a multiple of four so
+   the vector loops need no scalar tail. Drawing first turns positions
+   into pixel offsets, -1 for those outside the clip, in one vector pass,
+   then plots them in a tight loop per pixel mode.
+*/
+
+struct _Particles
+{
+	int32_t nCount;
+	int32_t nCapacity;
+
+	float*   pX;
+	float*   pY;
+	float*   pVX;
+	float*   pVY;
+	float*   pLife;
+	Pixel*   pCol;
+	int32_t* pOffsets;  // scratch for drawing
+};
+
+Particles* Particles_new ( int32_t nCapacity )
+{
+	Particles* ps;
+	int32_t    n;
+
+	if ( nCapacity <= 0 )
+	{
+		return NULL;
+	}
+
+	n = ( nCapacity + 3 ) & ~3;
+
+	ps = ( Particles* ) calloc( 1, sizeof( Particles ) );
+
+	ps->nCapacity = nCapacity;
+
+	ps->pX       = ( float* ) calloc( n, sizeof( float ) );
+	ps->pY       = ( float* ) calloc( n, sizeof( float ) );
+	ps->pVX      = ( float* ) calloc( n, sizeof( float ) );
+	ps->pVY      = ( float* ) calloc( n, sizeof( float ) );
+	ps->pLife    = ( float* ) calloc( n, sizeof( float ) );
+	ps->pCol     = ( Pixel* ) calloc( n, sizeof( Pixel ) );
+	ps->pOffsets = ( int32_t* ) calloc( n, sizeof( int32_t ) );
+
+	return ps;
+}
+
+void Particles_free ( Particles* ps )
+{
+	if ( ! ps )
+	{
+		return;
+	}
+
+	free( ps->pX );
+	free( ps->pY );
+	free( ps->pVX );
+	free( ps->pVY );
+	free( ps->pLife );
+	free( ps->pCol );
+	free( ps->pOffsets );
+	free( ps );
+}
+
+bool Particles_emit ( Particles* ps, float x, float y, float vx, float vy, float fLife, Pixel col )
+{
+	int32_t i;
+
+	if ( ps->nCount == ps->nCapacity || fLife <= 0.0f )
+	{
+		return false;
+	}
+
+	i = ps->nCount;
+
+	ps->pX[ i ]    = x;
+	ps->pY[ i ]    = y;
+	ps->pVX[ i ]   = vx;
+	ps->pVY[ i ]   = vy;
+	ps->pLife[ i ] = fLife;
+	ps->pCol[ i ]  = col;
+
+	ps->nCount += 1;
+
+	return true;
+}
+
+int32_t Particles_getCount ( Particles* ps )
+{
+	return ps->nCount;
+}
+
+void Particles_clear ( Particles* ps )
+{
+	ps->nCount = 0;
+}
+
+void Particles_update ( Particles* ps, float fElapsedTime, float ax, float ay )
+{
+	float   dvx;
+	float   dvy;
+	int32_t last;
+	int32_t i;
+
+	dvx = ax * fElapsedTime;
+	dvy = ay * fElapsedTime;
+
+	i = 0;
+
+	#ifdef PGE_SSE2
+
+		__m128 dt   = _mm_set1_ps( fElapsedTime );
+		__m128 vdvx = _mm_set1_ps( dvx );
+		__m128 vdvy = _mm_set1_ps( dvy );
+
+		// Slots past the count are padding, harmless to update
+		for ( ; i < ps->nCount; i += 4 )
+		{
+			__m128 vx = _mm_loadu_ps( ps->pVX + i );
+			__m128 vy = _mm_loadu_ps( ps->pVY + i );
+
+			_mm_storeu_ps( ps->pX + i, _mm_add_ps( _mm_loadu_ps( ps->pX + i ), _mm_mul_ps( vx, dt ) ) );
+			_mm_storeu_ps( ps->pY + i, _mm_add_ps( _mm_loadu_ps( ps->pY + i ), _mm_mul_ps( vy, dt ) ) );
+			_mm_storeu_ps( ps->pVX + i, _mm_add_ps( vx, vdvx ) );
+			_mm_storeu_ps( ps->pVY + i, _mm_add_ps( vy, vdvy ) );
+			_mm_storeu_ps( ps->pLife + i, _mm_sub_ps( _mm_loadu_ps( ps->pLife + i ), dt ) );
+		}
+
+	#endif
+
+	for ( ; i < ps->nCount; i += 1 )
+	{
+		ps->pX[ i ]    += ps->pVX[ i ] * fElapsedTime;
+		ps->pY[ i ]    += ps->pVY[ i ] * fElapsedTime;
+		ps->pVX[ i ]   += dvx;
+		ps->pVY[ i ]   += dvy;
+		ps->pLife[ i ] -= fElapsedTime;
+	}
+
+
+	// Remove the dead by moving the last live particle into their slot
+	for ( i = 0; i < ps->nCount; )
+	{
+		if ( ps->pLife[ i ] > 0.0f )
+		{
+			i += 1;
+
+			continue;
+		}
+
+		last = ps->nCount - 1;
+
+		ps->pX[ i ]    = ps->pX[ last ];
+		ps->pY[ i ]    = ps->pY[ last ];
+		ps->pVX[ i ]   = ps->pVX[ last ];
+		ps->pVY[ i ]   = ps->pVY[ last ];
+		ps->pLife[ i ] = ps->pLife[ last ];
+		ps->pCol[ i ]  = ps->pCol[ last ];
+
+		ps->nCount -= 1;
+	}
+}
+
+#ifdef PGE_SSE2
+
+	// SSE2 has no 32 bit multiply keeping the low halves, so two widening ones make it
+	static __m128i PGE_mulloEpi32 ( __m128i a, __m128i b )
+	{
+		__m128i even;
+		__m128i odd;
+
+		even = _mm_mul_epu32( a, b );
+		odd  = _mm_mul_epu32( _mm_srli_si128( a, 4 ), _mm_srli_si128( b, 4 ) );
+
+		return _mm_unpacklo_epi32(
+
+			_mm_shuffle_epi32( even, _MM_SHUFFLE( 0, 0, 2, 0 ) ),
+			_mm_shuffle_epi32( odd,  _MM_SHUFFLE( 0, 0, 2, 0 ) )
+		);
+	}
+
+#endif
+
+// Offset into the target of each particle, or -1 when outside the clip rectangle c
+static void Particles_computeOffsets ( Particles* ps, Rect c, int32_t w )
+{
+	float   fx0;
+	float   fy0;
+	float   fx1;
+	float   fy1;
+	int32_t i;
+
+	fx0 = ( float ) c.x;
+	fy0 = ( float ) c.y;
+	fx1 = ( float ) ( c.x + c.w );
+	fy1 = ( float ) ( c.y + c.h );
+
+	i = 0;
+
+	#ifdef PGE_SSE2
+
+		__m128  vx0  = _mm_set1_ps( fx0 );
+		__m128  vy0  = _mm_set1_ps( fy0 );
+		__m128  vx1  = _mm_set1_ps( fx1 );
+		__m128  vy1  = _mm_set1_ps( fy1 );
+		__m128i vwi  = _mm_set1_epi32( w );
+		__m128i none = _mm_set1_epi32( -1 );
+
+		for ( ; i < ps->nCount; i += 4 )
+		{
+			__m128 x = _mm_loadu_ps( ps->pX + i );
+			__m128 y = _mm_loadu_ps( ps->pY + i );
+
+			// Also false for NaN
+			__m128 in = _mm_and_ps(
+
+				_mm_and_ps( _mm_cmpge_ps( x, vx0 ), _mm_cmplt_ps( x, vx1 ) ),
+				_mm_and_ps( _mm_cmpge_ps( y, vy0 ), _mm_cmplt_ps( y, vy1 ) )
+			);
+
+			// Truncation is the floor for the positions kept
+			__m128i off = _mm_add_epi32( PGE_mulloEpi32( _mm_cvttps_epi32( y ), vwi ), _mm_cvttps_epi32( x ) );
+
+			off = _mm_or_si128( _mm_and_si128( _mm_castps_si128( in ), off ), _mm_andnot_si128( _mm_castps_si128( in ), none ) );
+
+			_mm_storeu_si128( ( __m128i* ) ( ps->pOffsets + i ), off );
+		}
+
+	#endif
+
+	for ( ; i < ps->nCount; i += 1 )
+	{
+		if ( ps->pX[ i ] >= fx0 && ps->pX[ i ] < fx1 && ps->pY[ i ] >= fy0 && ps->pY[ i ] < fy1 )
+		{
+			ps->pOffsets[ i ] = ( int32_t ) ps->pY[ i ] * w + ( int32_t ) ps->pX[ i ];
+		}
+		else
+		{
+			ps->pOffsets[ i ] = -1;
+		}
+	}
+}
+
+void PGE_drawParticles ( Particles* ps )
+{
+	Sprite*  dst;
+	Pixel*   pix;
+	int32_t* off;
+	int32_t  i;
+
+	dst = PGE_getDrawTarget();
+
+	if ( ! dst || ! ps )
+	{
+		return;
+	}
+
+	Particles_computeOffsets( ps, pCtx->clip, dst->nStride );
+
+	pix = dst->pColData;
+	off = ps->pOffsets;
+
+	switch ( pCtx->pixelMode )
+	{
+		case PIXEL_NORMAL:
+
+			for ( i = 0; i < ps->nCount; i += 1 )
+			{
+				if ( off[ i ] >= 0 )
+				{
+					pix[ off[ i ] ] = ps->pCol[ i ];
+				}
+			}
+			break;
+
+		case PIXEL_ADD:
+
+			for ( i = 0; i < ps->nCount; i += 1 )
+			{
+				if ( off[ i ] >= 0 )
+				{
+					PGE_addPixel( pix + off[ i ], ps->pCol[ i ] );
+				}
+			}
+			break;
+
+		case PIXEL_ALPHA:
+
+			for ( i = 0; i < ps->nCount; i += 1 )
+			{
+				if ( off[ i ] >= 0 )
+				{
+					PGE_alphaPixel( pix + off[ i ], ps->pCol[ i ] );
+				}
+			}
+			break;
+
+		default:
+
+			for ( i = 0; i < ps->nCount; i += 1 )
+			{
+				if ( off[ i ] >= 0 )
+				{
+					PGE_blendSpan( pix + off[ i ], ps->pCol + i, 1 );
+				}
+			}
+			break;
+	}
+}
+
+
+//================================================================================
+
+float PGE_getElapsedTime ( void )
+{
+	return pCtx->fElapsedTime;
+}
+
+void PGE_setFixedTimestep ( float fHz, int32_t nMaxSteps, bool ( *onSimulate ) ( float fStep ) )
+{
+	pCtx->pfnSimulate  = fHz > 0.0f ? onSimulate : NULL;
+	pCtx->fStep        = fHz > 0.0f ? 1.0f / fHz : 0.0f;
+	pCtx->nMaxSteps    = nMaxSteps > 0 ? nMaxSteps : 1;
+	pCtx->fAccumulator = 0.0;
+	pCtx->fAlpha       = 0.0f;
+}
+
+float PGE_getInterpolationAlpha ( void )
+{
+	return pCtx->fAlpha;
+}
+
+// Runs as many whole steps as the frame's elapsed time covers
+// False as soon as a step asks to quit, with no further steps run
+static bool PGE_simulate ( void )
+{
+	int32_t nSteps;
+
+	pCtx->fAccumulator += pCtx->fElapsedTime;
+
+	for ( nSteps = 0; nSteps < pCtx->nMaxSteps && pCtx->fAccumulator >= pCtx->fStep; nSteps += 1 )
+	{
+		if ( ! pCtx->pfnSimulate( pCtx->fStep ) )
+		{
+			pCtx->bAtomActive = false;
+
+			return false;
+		}
+
+		pCtx->fAccumulator -= pCtx->fStep;
+	}
+
+	// Too far behind, drop the backlog rather than spiral
+	if ( pCtx->fAccumulator >= pCtx->fStep )
+	{
+		pCtx->fAccumulator -= ( int64_t ) ( pCtx->fAccumulator / pCtx->fStep ) * ( double ) pCtx->fStep;
+	}
+
+	pCtx->fAlpha = ( float ) ( pCtx->fAccumulator / pCtx->fStep );
+
+	return true;
+}
+
+int32_t PGE_getScreenWidth ( void )
+{
+	return PGE_SCREEN_WIDTH;
+}
+
+int32_t PGE_getScreenHeight ( void )
+{
+	return PGE_SCREEN_HEIGHT;
+}
+
+static void PGE_updateViewport ( void )
+{
+	int32_t ww;
+	int32_t wh;
+	float   wasp;
+
+	ww   = PGE_SCREEN_WIDTH * PGE_PIXEL_WIDTH;
+	wh   = PGE_SCREEN_HEIGHT * PGE_PIXEL_HEIGHT;
+	wasp = ( float ) ww / ( float ) wh;
+
+	pCtx->nViewW = ( int32_t ) pCtx->nWindowWidth;
+	pCtx->nViewH = ( int32_t ) ( ( float ) pCtx->nViewW / wasp );
+
+	if ( pCtx->nViewH > pCtx->nWindowHeight )
+	{
+		pCtx->nViewH = pCtx->nWindowHeight;
+		pCtx->nViewW = ( int32_t ) ( ( float ) pCtx->nViewH * wasp );
+	}
+
+	pCtx->nViewX = ( pCtx->nWindowWidth - pCtx->nViewW ) / 2;
+	pCtx->nViewY = ( pCtx->nWindowHeight - pCtx->nViewH ) / 2;
+}
+
+void PGE_updateWindowSize ( int32_t x, int32_t y )
+{
+	pCtx->nWindowWidth = x;
+	pCtx->nWindowHeight = y;
+
+	PGE_updateViewport();
+}
+
+
+//================================================================================
+
+bool PGE_isFocused ( void )
+{
+	return pCtx->bHasInputFocus;
+}
+
+
+//================================================================================
+
+HWButton PGE_getMouse ( enum MouseButton b )
+{
+	return pCtx->pMouseState[ b ];
+}
+
+int32_t PGE_getMouseX ( void )
+{
+	return pCtx->nMousePosX;
+}
+
+int32_t PGE_getMouseY ( void )
+{
+	return pCtx->nMousePosY;
+}
+
+static void PGE_updateMouse ( int32_t x, int32_t y )
+{
+	/* Mouse coords come in screen space,
+	   but leave in pixel space.
+	*/
+
+	// Full Screen mode may have a weird viewport we must clamp to
+	x -= pCtx->nViewX;
+	y -= pCtx->nViewY;
+
+	pCtx->nMousePosXCache = ( int32_t ) ( ( float ) x /
+	                                ( float ) ( pCtx->nWindowWidth - ( pCtx->nViewX * 2 ) ) *
+	                                ( float ) PGE_SCREEN_WIDTH );
+
+	pCtx->nMousePosYCache = ( int32_t ) ( ( float ) y /
+	                                ( float ) ( pCtx->nWindowHeight - ( pCtx->nViewY * 2 ) ) *
+	                                ( float ) PGE_SCREEN_HEIGHT );
+
+	if ( pCtx->nMousePosXCache >= ( int32_t ) PGE_SCREEN_WIDTH )
+	{
+		pCtx->nMousePosXCache = PGE_SCREEN_WIDTH - 1;
+	}
+	if ( pCtx->nMousePosYCache >= ( int32_t ) PGE_SCREEN_HEIGHT )
+	{
+		pCtx->nMousePosYCache = PGE_SCREEN_HEIGHT - 1;
+	}
+
+	if ( pCtx->nMousePosXCache < 0 )
+	{
+		pCtx->nMousePosXCache = 0;
+	}
+	if ( pCtx->nMousePosYCache < 0 )
+	{
+		pCtx->nMousePosYCache = 0;
+	}
+}
+
+
+//================================================================================
+
+HWButton PGE_getKey ( enum Key k )
+{
+	return pCtx->pKeyboardState[ k ];
+}
+
+#ifdef _WIN32
+
+	static enum Key mapKey ( unsigned int sym )
+	{
+		// Create Keyboard Mapping
+		switch ( sym )
+		{
+			case 0x00 : return KEY_NONE;
+			case 0x41 : return KEY_A;
+			case 0x42 : return KEY_B;
+			case 0x43 : return KEY_C;
+			case 0x44 : return KEY_D;
+			case 0x45 : return KEY_E;
+			case 0x46 : return KEY_F;
+			case 0x47 : return KEY_G;
+			case 0x48 : return KEY_H;
+			case 0x49 : return KEY_I;
+			case 0x4A : return KEY_J;
+			case 0x4B : return KEY_K;
+			case 0x4C : return KEY_L;
+			case 0x4D : return KEY_M;
+			case 0x4E : return KEY_N;
+			case 0x4F : return KEY_O;
+			case 0x50 : return KEY_P;
+			case 0x51 : return KEY_Q;
+			case 0x52 : return KEY_R;
+			case 0x53 : return KEY_S;
+			case 0x54 : return KEY_T;
+			case 0x55 : return KEY_U;
+			case 0x56 : return KEY_V;
+			case 0x57 : return KEY_W;
+			case 0x58 : return KEY_X;
+			case 0x59 : return KEY_Y;
+			case 0x5A : return KEY_Z;
+
+			case VK_F1  : return KEY_F1;
+			case VK_F2  : return KEY_F2;
+			case VK_F3  : return KEY_F3;
+			case VK_F4  : return KEY_F4;
+			case VK_F5  : return KEY_F5;
+			case VK_F6  : return KEY_F6;
+			case VK_F7  : return KEY_F7;
+			case VK_F8  : return KEY_F8;
+			case VK_F9  : return KEY_F9;
+			case VK_F10 : return KEY_F10;
+			case VK_F11 : return KEY_F11;
+			case VK_F12 : return KEY_F12;
+
+			case VK_DOWN   : return KEY_DOWN;
+			case VK_LEFT   : return KEY_LEFT;
+			case VK_RIGHT  : return KEY_RIGHT;
+			case VK_UP     : return KEY_UP;
+			case VK_RETURN : return KEY_ENTER;
+			// case VK_RETURN : return KEY_RETURN;
+
+			case VK_BACK    : return KEY_BACK;
+			case VK_ESCAPE  : return KEY_ESCAPE;
+			// case VK_RETURN  : return KEY_ENTER;
+			case VK_PAUSE   : return KEY_PAUSE;
+			case VK_SCROLL  : return KEY_SCROLL;
+			case VK_TAB     : return KEY_TAB;
+			case VK_DELETE  : return KEY_DEL;
+			case VK_HOME    : return KEY_HOME;
+			case VK_END     : return KEY_END;
+			case VK_PRIOR   : return KEY_PGUP;
+			case VK_NEXT    : return KEY_PGDN;
+			case VK_INSERT  : return KEY_INS;
+			case VK_SHIFT   : return KEY_SHIFT;
+			case VK_CONTROL : return KEY_CTRL;
+			case VK_SPACE   : return KEY_SPACE;
+
+			case 0x30 : return KEY_0;
+			case 0x31 : return KEY_1;
+			case 0x32 : return KEY_2;
+			case 0x33 : return KEY_3;
+			case 0x34 : return KEY_4;
+			case 0x35 : return KEY_5;
+			case 0x36 : return KEY_6;
+			case 0x37 : return KEY_7;
+			case 0x38 : return KEY_8;
+			case 0x39 : return KEY_9;
+
+			case VK_NUMPAD0 : return KEY_NP0;
+			case VK_NUMPAD1 : return KEY_NP1;
+			case VK_NUMPAD2 : return KEY_NP2;
+			case VK_NUMPAD3 : return KEY_NP3;
+			case VK_NUMPAD4 : return KEY_NP4;
+			case VK_NUMPAD5 : return KEY_NP5;
+			case VK_NUMPAD6 : return KEY_NP6;
+			case VK_NUMPAD7 : return KEY_NP7;
+			case VK_NUMPAD8 : return KEY_NP8;
+			case VK_NUMPAD9 : return KEY_NP9;
+
+			case VK_MULTIPLY : return KEY_NP_MUL;
+			case VK_ADD      : return KEY_NP_ADD;
+			case VK_DIVIDE   : return KEY_NP_DIV;
+			case VK_SUBTRACT : return KEY_NP_SUB;
+			case VK_DECIMAL  : return KEY_NP_DECIMAL;
+		}
+
+		//
+		return KEY_NONE;
+	}
+
+#else
+
+	static enum Key mapKey ( unsigned int sym )
+	{
+		// Create Keyboard Mapping
+		switch ( sym )
+		{
+			case 0x00 : return KEY_NONE;
+			case 0x61 : return KEY_A;
+			case 0x62 : return KEY_B;
+			case 0x63 : return KEY_C;
+			case 0x64 : return KEY_D;
+			case 0x65 : return KEY_E;
+			case 0x66 : return KEY_F;
+			case 0x67 : return KEY_G;
+			case 0x68 : return KEY_H;
+			case 0x69 : return KEY_I;
+			case 0x6A : return KEY_J;
+			case 0x6B : return KEY_K;
+			case 0x6C : return KEY_L;
+			case 0x6D : return KEY_M;
+			case 0x6E : return KEY_N;
+			case 0x6F : return KEY_O;
+			case 0x70 : return KEY_P;
+			case 0x71 : return KEY_Q;
+			case 0x72 : return KEY_R;
+			case 0x73 : return KEY_S;
+			case 0x74 : return KEY_T;
+			case 0x75 : return KEY_U;
+			case 0x76 : return KEY_V;
+			case 0x77 : return KEY_W;
+			case 0x78 : return KEY_X;
+			case 0x79 : return KEY_Y;
+			case 0x7A : return KEY_Z;
+
+			case XK_F1  : return KEY_F1;
+			case XK_F2  : return KEY_F2;
+			case XK_F3  : return KEY_F3;
+			case XK_F4  : return KEY_F4;
+			case XK_F5  : return KEY_F5;
+			case XK_F6  : return KEY_F6;
+			case XK_F7  : return KEY_F7;
+			case XK_F8  : return KEY_F8;
+			case XK_F9  : return KEY_F9;
+			case XK_F10 : return KEY_F10;
+			case XK_F11 : return KEY_F11;
+			case XK_F12 : return KEY_F12;
+
+			case XK_Down     : return KEY_DOWN;
+			case XK_Left     : return KEY_LEFT;
+			case XK_Right    : return KEY_RIGHT;
+			case XK_Up       : return KEY_UP;
+			case XK_KP_Enter : return KEY_ENTER;
+			case XK_Return   : return KEY_ENTER;
+
+			case XK_BackSpace   : return KEY_BACK;
+			case XK_Escape      : return KEY_ESCAPE;
+			case XK_Linefeed    : return KEY_ENTER;
+			case XK_Pause       : return KEY_PAUSE;
+			case XK_Scroll_Lock : return KEY_SCROLL;
+			case XK_Tab         : return KEY_TAB;
+			case XK_Delete      : return KEY_DEL;
+			case XK_Home        : return KEY_HOME;
+			case XK_End         : return KEY_END;
+			case XK_Page_Up     : return KEY_PGUP;
+			case XK_Page_Down   : return KEY_PGDN;
+			case XK_Insert      : return KEY_INS;
+			case XK_Shift_L     : return KEY_SHIFT;
+			case XK_Shift_R     : return KEY_SHIFT;
+			case XK_Control_L   : return KEY_CTRL;
+			case XK_Control_R   : return KEY_CTRL;
+			case XK_space       : return KEY_SPACE;
+
+			case XK_0 : return KEY_0;
+			case XK_1 : return KEY_1;
+			case XK_2 : return KEY_2;
+			case XK_3 : return KEY_3;
+			case XK_4 : return KEY_4;
+			case XK_5 : return KEY_5;
+			case XK_6 : return KEY_6;
+			case XK_7 : return KEY_7;
+			case XK_8 : return KEY_8;
+			case XK_9 : return KEY_9;
+
+			case XK_KP_0 : return KEY_NP0;
+			case XK_KP_1 : return KEY_NP1;
+			case XK_KP_2 : return KEY_NP2;
+			case XK_KP_3 : return KEY_NP3;
+			case XK_KP_4 : return KEY_NP4;
+			case XK_KP_5 : return KEY_NP5;
+			case XK_KP_6 : return KEY_NP6;
+			case XK_KP_7 : return KEY_NP7;
+			case XK_KP_8 : return KEY_NP8;
+			case XK_KP_9 : return KEY_NP9;
+
+			case XK_KP_Multiply : return KEY_NP_MUL;
+			case XK_KP_Add      : return KEY_NP_ADD;
+			case XK_KP_Divide   : return KEY_NP_DIV;
+			case XK_KP_Subtract : return KEY_NP_SUB;
+			case XK_KP_Decimal  : return KEY_NP_DECIMAL;
+		}
+
+		//
+		return KEY_NONE;
+	}
+
+#endif
+
+
+//================================================================================
+
+/* Frame capture.
+   The engine thread only ever copies the presented frame into a free
+   slot of the ring; encoding and file I/O happen on the writer thread.
+*/
+
+struct _Capture
+{
+	FILE*              f;
+	enum CaptureFormat format;
+	int32_t            width;
+	int32_t            height;
+
+	PGE_Mutex  mutex;
+	PGE_Cond   cond;
+	PGE_Thread thread;
+
+	// Ring of frames, guarded by mutex
+	Pixel*   pFrames;
+	int32_t  nSlots;
+	int32_t  nHead;    // oldest queued frame
+	int32_t  nQueued;
+	bool     bStop;
+	uint32_t nFrames;  // frames handed to the writer
+	uint32_t nDropped;
+
+	// Writer scratch
+	uint8_t* pScratch;  // Y4M planes, or an encoded RLE frame
+	Pixel*   pPrev;     // RLE, previous frame
+};
+
+typedef struct _Capture Capture;
+
+static void Capture_writeY4M ( Capture* cap, const Pixel* frame )
+{
+	int32_t  nPixels;
+	int32_t  i;
+	uint8_t* py;
+	uint8_t* pu;
+	uint8_t* pv;
+
+	nPixels = cap->width * cap->height;
+
+	py = cap->pScratch;
+	pu = py + nPixels;
+	pv = pu + nPixels;
+
+	// BT.601, studio range
+	for ( i = 0; i < nPixels; i += 1 )
+	{
+		int r = frame[ i ].r;
+		int g = frame[ i ].g;
+		int b = frame[ i ].b;
+
+		py[ i ] = ( uint8_t ) ( ( (  66 * r + 129 * g +  25 * b + 128 ) >> 8 ) +  16 );
+		pu[ i ] = ( uint8_t ) ( ( ( -38 * r -  74 * g + 112 * b + 128 ) >> 8 ) + 128 );
+		pv[ i ] = ( uint8_t ) ( ( ( 112 * r -  94 * g -  18 * b + 128 ) >> 8 ) + 128 );
+	}
+
+	fputs( "FRAME\n", cap->f );
+	fwrite( cap->pScratch, 1, nPixels * 3, cap->f );
+}
+
+/* Each frame is a uint32 byte count followed by
+   { uint32 unchanged, uint32 changed, changed x RGBA } records
+   relative to the previous frame, which starts out all zero.
+*/
+static void Capture_writeRLE ( Capture* cap, const Pixel* frame )
+{
+	const uint32_t* cur;
+	const uint32_t* prev;
+	uint8_t*        out;
+	uint32_t        rec [ 2 ];
+	uint32_t        nBytes;
+	int32_t         nPixels;
+	int32_t         i;
+	int32_t         j;
+
+	cur     = ( const uint32_t* ) frame;
+	prev    = ( const uint32_t* ) cap->pPrev;
+	out     = cap->pScratch + 4;
+	nPixels = cap->width * cap->height;
+
+	i = 0;
+
+	while ( i < nPixels )
+	{
+		j = i;
+
+		while ( j < nPixels && cur[ j ] == prev[ j ] )
+		{
+			j += 1;
+		}
+
+		rec[ 0 ] = j - i;
+		i        = j;
+
+		while ( j < nPixels && cur[ j ] != prev[ j ] )
+		{
+			j += 1;
+		}
+
+		rec[ 1 ] = j - i;
+
+		memcpy( out, rec, 8 );
+		memcpy( out + 8, cur + i, ( j - i ) * sizeof( Pixel ) );
+
+		out += 8 + ( j - i ) * sizeof( Pixel );
+		i    = j;
+	}
+
+	nBytes = ( uint32_t ) ( out - cap->pScratch - 4 );
+
+	memcpy( cap->pScratch, &nBytes, 4 );
+	memcpy( cap->pPrev, frame, nPixels * sizeof( Pixel ) );
+
+	fwrite( cap->pScratch, 1, nBytes + 4, cap->f );
+}
+
+static PGE_THREAD_FUNC( Capture_writerThread )
+{
+	Capture* cap;
+	Pixel*   frame;
+	int32_t  nPixels;
+
+	cap     = ( Capture* ) arg;
+	nPixels = cap->width * cap->height;
+
+	while ( true )
+	{
+		Mutex_lock( &cap->mutex );
+
+		while ( cap->nQueued == 0 && ! cap->bStop )
+		{
+			Cond_wait( &cap->cond, &cap->mutex );
+		}
+
+		if ( cap->nQueued == 0 )
+		{
+			Mutex_unlock( &cap->mutex );
+
+			break;
+		}
+
+		frame = cap->pFrames + cap->nHead * nPixels;
+
+		Mutex_unlock( &cap->mutex );
+
+
+		// The slot stays queued, and so untouched by the producer, while it is written
+		if ( cap->format == CAPTURE_RAW )
+		{
+			fwrite( frame, sizeof( Pixel ), nPixels, cap->f );
+		}
+		else if ( cap->format == CAPTURE_Y4M )
+		{
+			Capture_writeY4M( cap, frame );
+		}
+		else
+		{
+			Capture_writeRLE( cap, frame );
+		}
+
+
+		Mutex_lock( &cap->mutex );
+
+		cap->nHead    = ( cap->nHead + 1 ) % cap->nSlots;
+		cap->nQueued -= 1;
+
+		Mutex_unlock( &cap->mutex );
+	}
+
+	PGE_THREAD_RETURN;
+}
+
+enum rcode PGE_captureStart ( const char* sFile, enum CaptureFormat format, int32_t nBuffers, int32_t nFps )
+{
+	Capture* cap;
+	int32_t  nPixels;
+
+	if ( pCtx->pCapture || ! pCtx->pDefaultDrawTarget || nBuffers < 1 || nFps < 1 )
+	{
+		return FAIL;
+	}
+
+	cap = ( Capture* ) calloc( 1, sizeof( Capture ) );
+
+	cap->f = fopen( sFile, "wb" );
+
+	if ( ! cap->f )
+	{
+		free( cap );
+
+		return NO_FILE;
+	}
+
+	cap->format = format;
+	cap->width  = pCtx->pDefaultDrawTarget->width;
+	cap->height = pCtx->pDefaultDrawTarget->height;
+	cap->nSlots = nBuffers;
+
+	nPixels = cap->width * cap->height;
+
+	cap->pFrames = ( Pixel* ) malloc( ( size_t ) nPixels * nBuffers * sizeof( Pixel ) );
+
+	if ( format == CAPTURE_Y4M )
+	{
+		cap->pScratch = ( uint8_t* ) malloc( nPixels * 3 );
+
+		fprintf( cap->f, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", cap->width, cap->height, nFps );
+	}
+	else if ( format == CAPTURE_RLE )
+	{
+		// Worst case is a record per changed pixel
+		cap->pScratch = ( uint8_t* ) malloc( ( size_t ) ( nPixels + 1 ) * ( 8 + sizeof( Pixel ) ) );
+		cap->pPrev    = ( Pixel* ) calloc( nPixels, sizeof( Pixel ) );
+
+		fwrite( "olcRLE\0\0", 1, 8, cap->f );
+		fwrite( &cap->width,  4, 1, cap->f );
+		fwrite( &cap->height, 4, 1, cap->f );
+	}
+
+	Mutex_init( &cap->mutex );
+	Cond_init( &cap->cond );
+
+	if ( ! cap->pFrames || ! Thread_create( &cap->thread, Capture_writerThread, cap ) )
+	{
+		Mutex_destroy( &cap->mutex );
+		Cond_destroy( &cap->cond );
+		fclose( cap->f );
+		free( cap->pFrames );
+		free( cap->pScratch );
+		free( cap->pPrev );
+		free( cap );
+
+		return FAIL;
+	}
+
+	pCtx->pCapture = cap;
+
+	return OK;
+}
+
+void PGE_captureStop ( void )
+{
+	Capture* cap;
+
+	cap = pCtx->pCapture;
+
+	if ( ! cap )
+	{
+		return;
+	}
+
+	Mutex_lock( &cap->mutex );
+	cap->bStop = true;
+	Cond_signal( &cap->cond );
+	Mutex_unlock( &cap->mutex );
+
+	Thread_join( cap->thread );
+
+	Mutex_destroy( &cap->mutex );
+	Cond_destroy( &cap->cond );
+	fclose( cap->f );
+	free( cap->pFrames );
+	free( cap->pScratch );
+	free( cap->pPrev );
+	free( cap );
+
+	pCtx->pCapture = NULL;
+}
+
+uint32_t PGE_getCaptureFrameCount ( void )
+{
+	return pCtx->pCapture ? pCtx->pCapture->nFrames : 0;
+}
+
+uint32_t PGE_getCaptureDropCount ( void )
+{
+	return pCtx->pCapture ? pCtx->pCapture->nDropped : 0;
+}
+
+// Called by the engine thread once per presented frame
+static void PGE_captureFrame ( void )
+{
+	Capture* cap;
+	int32_t  nPixels;
+	int32_t  slot;
+
+	cap = pCtx->pCapture;
+
+	if ( ! cap )
+	{
+		return;
+	}
+
+	nPixels = cap->width * cap->height;
+
+	Mutex_lock( &cap->mutex );
+
+	if ( cap->nQueued == cap->nSlots )
+	{
+		cap->nDropped += 1;
+
+		Mutex_unlock( &cap->mutex );
+
+		return;
+	}
+
+	slot = ( cap->nHead + cap->nQueued ) % cap->nSlots;
+
+	Mutex_unlock( &cap->mutex );
+
+
+	// Only the writer consumes, and only queued slots, so this one is ours
+	memcpy( cap->pFrames + slot * nPixels, pCtx->pDefaultDrawTarget->pColData, nPixels * sizeof( Pixel ) );
+
+
+	Mutex_lock( &cap->mutex );
+
+	cap->nQueued += 1;
+	cap->nFrames += 1;
+
+	Cond_signal( &cap->cond );
+	Mutex_unlock( &cap->mutex );
+}
+
+
+//================================================================================
+
+/* Shared framebuffer.
+   The default draw target's pixels move into a shared memory mapping,
+   after a SharedFrameHeader, so other processes see every frame as it
+   is drawn, without copies. The header's sequence count is odd from
+   the start of a frame's drawing until it is complete, so a reader
+   can tell a whole frame from one in progress; the engine never waits
+   on readers.
+*/
+
+struct _SharedFrame
+{
+	SharedFrameHeader* pHeader;
+	size_t             nSize;
+	char*              sName;  // NULL for an anonymous memfd
+
+	#ifdef _WIN32
+
+		HANDLE hMapping;
+
+	#else
+
+		int fd;
+
+	#endif
+};
+
+typedef struct _SharedFrame SharedFrame;
+
+// The pixels start a cache line in, whatever the header grows to
+#define SHARED_FRAME_HEADER_SIZE 64
+
+static void SharedFrame_free ( SharedFrame* sh )
+{
+	#ifdef _WIN32
+
+		UnmapViewOfFile( sh->pHeader );
+		CloseHandle( sh->hMapping );
+
+	#else
+
+		munmap( sh->pHeader, sh->nSize );
+		close( sh->fd );
+
+		// Readers that mapped it keep it, new ones can no longer open it
+		if ( sh->sName )
+		{
+			shm_unlink( sh->sName );
+		}
+
+	#endif
+
+	free( sh->sName );
+	free( sh );
+}
+
+static SharedFrameHeader* SharedFrame_map ( SharedFrame* sh, const char* sName )
+{
+	#ifdef _WIN32
+
+		if ( ! sName )
+		{
+			return NULL;
+		}
+
+		sh->hMapping = CreateFileMappingA( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, ( DWORD ) ( ( uint64_t ) sh->nSize >> 32 ), ( DWORD ) sh->nSize, sName );
+
+		if ( ! sh->hMapping )
+		{
+			return NULL;
+		}
+
+		sh->pHeader = ( SharedFrameHeader* ) MapViewOfFile( sh->hMapping, FILE_MAP_ALL_ACCESS, 0, 0, sh->nSize );
+
+		if ( ! sh->pHeader )
+		{
+			CloseHandle( sh->hMapping );
+		}
+
+		return sh->pHeader;
+
+	#else
+
+		void* p;
+
+		if ( sName )
+		{
+			sh->fd = shm_open( sName, O_CREAT | O_RDWR, 0644 );
+		}
+		else
+		{
+			#ifdef __linux__
+
+				sh->fd = ( int ) syscall( SYS_memfd_create, "pge-frame", MFD_CLOEXEC );
+
+			#else
+
+				sh->fd = -1;
+
+			#endif
+		}
+
+		if ( sh->fd < 0 )
+		{
+			return NULL;
+		}
+
+		p = MAP_FAILED;
+
+		if ( ftruncate( sh->fd, ( off_t ) sh->nSize ) == 0 )
+		{
+			p = mmap( NULL, sh->nSize, PROT_READ | PROT_WRITE, MAP_SHARED, sh->fd, 0 );
+		}
+
+		if ( p == MAP_FAILED )
+		{
+			close( sh->fd );
+
+			if ( sName )
+			{
+				shm_unlink( sName );
+			}
+
+			return NULL;
+		}
+
+		sh->pHeader = ( SharedFrameHeader* ) p;
+
+		return sh->pHeader;
+
+	#endif
+}
+
+enum rcode PGE_shareFramebuffer ( const char* sName )
+{
+	SharedFrame*       sh;
+	SharedFrameHeader* h;
+	Sprite*            sp;
+	Pixel*             pixels;
+	size_t             nBytes;
+
+	sp = pCtx->pDefaultDrawTarget;
+
+	if ( ! sp || pCtx->pShared )
+	{
+		return FAIL;
+	}
+
+	// The pixels are copied into the mapping below
+	PGE_finishTargetInit();
+
+	nBytes = ( size_t ) sp->width * sp->height * sizeof( Pixel );
+
+	sh = ( SharedFrame* ) calloc( 1, sizeof( SharedFrame ) );
+
+	sh->nSize = SHARED_FRAME_HEADER_SIZE + nBytes;
+	sh->sName = sName ? strdup( sName ) : NULL;
+
+	h = SharedFrame_map( sh, sName );
+
+	if ( ! h )
+	{
+		free( sh->sName );
+		free( sh );
+
+		return FAIL;
+	}
+
+	memset( h, 0, SHARED_FRAME_HEADER_SIZE );
+
+	h->nMagic      = PGE_SHARED_FRAME_MAGIC;
+	h->nVersion    = 1;
+	h->nHeaderSize = SHARED_FRAME_HEADER_SIZE;
+	h->nFormat     = PGE_SHARED_FRAME_RGBA8;
+	h->nWidth      = sp->width;
+	h->nHeight     = sp->height;
+	h->nStride     = sp->width * sizeof( Pixel );
+	h->nOriginX    = pCtx->nScrollOriginX;
+	h->nOriginY    = pCtx->nScrollOriginY;
+
+	/* Odd from the start, as the target may still be drawn to before
+	   the first frame, e.g. by UI_onUserCreate. The first
+	   PGE_shareFrameEnd makes it even.
+	*/
+	PGE_ATOMIC_STORE( &h->nSeq, 1 );
+
+	PGE_ATOMIC_FENCE();
+
+
+	// Carry the target's pixels over, then draw into the mapping from now on
+	pixels = ( Pixel* ) ( ( uint8_t* ) h + SHARED_FRAME_HEADER_SIZE );
+
+	memcpy( pixels, sp->pColData, nBytes );
+
+	if ( sp->bOwnsData )
+	{
+		free( sp->pColData );
+	}
+
+	sp->pColData  = pixels;
+	sp->bOwnsData = false;
+
+	pCtx->pShared = sh;
+
+	return OK;
+}
+
+int PGE_getSharedFramebufferFd ( void )
+{
+	#ifdef _WIN32
+
+		return -1;
+
+	#else
+
+		return pCtx->pShared ? pCtx->pShared->fd : -1;
+
+	#endif
+}
+
+// Drawing into the target is about to start, readers should hold off
+static void PGE_shareFrameBegin ( void )
+{
+	SharedFrameHeader* h;
+
+	if ( ! pCtx->pShared )
+	{
+		return;
+	}
+
+	h = pCtx->pShared->pHeader;
+
+	// Still odd if no frame has ended since the share
+	if ( h->nSeq & 1 )
+	{
+		return;
+	}
+
+	PGE_ATOMIC_STORE( &h->nSeq, h->nSeq + 1 );
+
+	// Nothing drawn may become visible before the count turns odd
+	PGE_ATOMIC_FENCE();
+}
+
+static void PGE_shareFrameEnd ( void )
+{
+	SharedFrameHeader* h;
+
+	if ( ! pCtx->pShared )
+	{
+		return;
+	}
+
+	h = pCtx->pShared->pHeader;
+
+	h->nFrame  += 1;
+	h->nOriginX = pCtx->nScrollOriginX;
+	h->nOriginY = pCtx->nScrollOriginY;
+
+	PGE_ATOMIC_STORE( &h->nSeq, h->nSeq + 1 );
+}
+
+// The target's pixels live in the mapping, so go with it
+static void PGE_shareStop ( void )
+{
+	if ( ! pCtx->pShared )
+	{
+		return;
+	}
+
+	SharedFrame_free( pCtx->pShared );
+
+	pCtx->pShared = NULL;
+}
+
+
+//================================================================================
+
+/* Input record and replay.
+   A log holds, for each frame, the elapsed time and input state as
+   seen just before the engine derives button states from it:
+
+     header  "olcINPT\0", uint32 screen width, uint32 screen height
+     frame   float elapsed, int16 mouse x, int16 mouse y,
+             uint8 mouse buttons (bits 0-4) | 0x80 when followed by
+             32 bytes of key state bits, written only when keys change
+
+   Values are in native byte order. The whole log lives in memory,
+   so neither recording nor replay touch the disk during the frame loop.
+*/
+
+struct _InputLog
+{
+	char*    sFile;
+	uint8_t* pData;
+	size_t   nSize;
+	size_t   nCap;
+	size_t   nPos;
+	uint8_t  keyBits [ 32 ];  // key state as of the last frame with keys
+};
+
+typedef struct _InputLog InputLog;
+
+static void InputLog_append ( InputLog* log, const void* p, size_t n )
+{
+	if ( log->nSize + n > log->nCap )
+	{
+		log->nCap  = ( log->nSize + n ) * 2;
+		log->pData = ( uint8_t* ) realloc( log->pData, log->nCap );
+	}
+
+	memcpy( log->pData + log->nSize, p, n );
+
+	log->nSize += n;
+}
+
+static void InputLog_free ( InputLog* log )
+{
+	free( log->sFile );
+	free( log->pData );
+	free( log );
+}
+
+enum rcode PGE_recordStart ( const char* sFile )
+{
+	InputLog* log;
+	uint32_t  size [ 2 ];
+
+	if ( pCtx->pRecordLog || pCtx->pReplayLog )
+	{
+		return FAIL;
+	}
+
+	log = ( InputLog* ) calloc( 1, sizeof( InputLog ) );
+
+	log->sFile = strdup( sFile );
+
+	// Forces key state into the first frame
+	memset( log->keyBits, 0xFF, sizeof( log->keyBits ) );
+
+	size[ 0 ] = PGE_SCREEN_WIDTH;
+	size[ 1 ] = PGE_SCREEN_HEIGHT;
+
+	InputLog_append( log, "olcINPT\0", 8 );
+	InputLog_append( log, size, sizeof( size ) );
+
+	pCtx->pRecordLog = log;
+
+	return OK;
+}
+
+enum rcode PGE_recordStop ( void )
+{
+	FILE* f;
+	bool  bOk;
+
+	if ( ! pCtx->pRecordLog )
+	{
+		return FAIL;
+	}
+
+	f = fopen( pCtx->pRecordLog->sFile, "wb" );
+
+	if ( f )
+	{
+		bOk = fwrite( pCtx->pRecordLog->pData, 1, pCtx->pRecordLog->nSize, f ) == pCtx->pRecordLog->nSize;
+
+		fclose( f );
+	}
+
+	InputLog_free( pCtx->pRecordLog );
+
+	pCtx->pRecordLog = NULL;
+
+	if ( ! f )
+	{
+		return NO_FILE;
+	}
+
+	return bOk ? OK : FAIL;
+}
+
+enum rcode PGE_replayStart ( const char* sFile )
+{
+	InputLog* log;
+	FILE*     f;
+	long      size;
+
+	if ( pCtx->pRecordLog || pCtx->pReplayLog )
+	{
+		return FAIL;
+	}
+
+	f = fopen( sFile, "rb" );
+
+	if ( ! f )
+	{
+		return NO_FILE;
+	}
+
+	fseek( f, 0, SEEK_END );
+	size = ftell( f );
+	fseek( f, 0, SEEK_SET );
+
+	log = ( InputLog* ) calloc( 1, sizeof( InputLog ) );
+
+	log->nSize = size > 0 ? ( size_t ) size : 0;
+	log->pData = ( uint8_t* ) malloc( log->nSize + 1 );
+
+	if ( size < 16 || fread( log->pData, 1, log->nSize, f ) != log->nSize ||
+	     memcmp( log->pData, "olcINPT\0", 8 ) != 0 )
+	{
+		fclose( f );
+		InputLog_free( log );
+
+		return FAIL;
+	}
+
+	fclose( f );
+
+	log->nPos  = 16;
+	pCtx->pReplayLog = log;
+
+	return OK;
+}
+
+bool PGE_isReplaying ( void )
+{
+	return pCtx->pReplayLog != NULL;
+}
+
+static void PGE_recordFrame ( void )
+{
+	InputLog* log;
+	uint8_t   rec [ 9 ];
+	uint8_t   keyBits [ 32 ];
+	int16_t   x;
+	int16_t   y;
+	int       i;
+
+	log = pCtx->pRecordLog;
+
+	memset( keyBits, 0, sizeof( keyBits ) );
+
+	for ( i = 0; i < 256; i += 1 )
+	{
+		keyBits[ i >> 3 ] |= pCtx->pKeyNewState[ i ] << ( i & 7 );
+	}
 
-			case VK_F1  : return KEY_F1;
-			case VK_F2  : return KEY_F2;
-			case VK_F3  : return KEY_F3;
-			case VK_F4  : return KEY_F4;
-			case VK_F5  : return KEY_F5;
-			case VK_F6  : return KEY_F6;
-			case VK_F7  : return KEY_F7;
-			case VK_F8  : return KEY_F8;
-			case VK_F9  : return KEY_F9;
-			case VK_F10 : return KEY_F10;
-			case VK_F11 : return KEY_F11;
-			case VK_F12 : return KEY_F12;
+	x = ( int16_t ) pCtx->nMousePosXCache;
+	y = ( int16_t ) pCtx->nMousePosYCache;
 
-			case VK_DOWN   : return KEY_DOWN;
-			case VK_LEFT   : return KEY_LEFT;
-			case VK_RIGHT  : return KEY_RIGHT;
-			case VK_UP     : return KEY_UP;
-			case VK_RETURN : return KEY_ENTER;
-			// case VK_RETURN : return KEY_RETURN;
+	memcpy( rec + 0, &pCtx->fElapsedTime, 4 );
+	memcpy( rec + 4, &x, 2 );
+	memcpy( rec + 6, &y, 2 );
 
-			case VK_BACK    : return KEY_BACK;
-			case VK_ESCAPE  : return KEY_ESCAPE;
-			// case VK_RETURN  : return KEY_ENTER;
-			case VK_PAUSE   : return KEY_PAUSE;
-			case VK_SCROLL  : return KEY_SCROLL;
-			case VK_TAB     : return KEY_TAB;
-			case VK_DELETE  : return KEY_DEL;
-			case VK_HOME    : return KEY_HOME;
-			case VK_END     : return KEY_END;
-			case VK_PRIOR   : return KEY_PGUP;
-			case VK_NEXT    : return KEY_PGDN;
-			case VK_INSERT  : return KEY_INS;
-			case VK_SHIFT   : return KEY_SHIFT;
-			case VK_CONTROL : return KEY_CTRL;
-			case VK_SPACE   : return KEY_SPACE;
+	rec[ 8 ] = 0;
 
-			case 0x30 : return KEY_0;
-			case 0x31 : return KEY_1;
-			case 0x32 : return KEY_2;
-			case 0x33 : return KEY_3;
-			case 0x34 : return KEY_4;
-			case 0x35 : return KEY_5;
-			case 0x36 : return KEY_6;
-			case 0x37 : return KEY_7;
-			case 0x38 : return KEY_8;
-			case 0x39 : return KEY_9;
+	for ( i = 0; i < 5; i += 1 )
+	{
+		rec[ 8 ] |= pCtx->pMouseNewState[ i ] << i;
+	}
 
-			case VK_NUMPAD0 : return KEY_NP0;
-			case VK_NUMPAD1 : return KEY_NP1;
-			case VK_NUMPAD2 : return KEY_NP2;
-			case VK_NUMPAD3 : return KEY_NP3;
-			case VK_NUMPAD4 : return KEY_NP4;
-			case VK_NUMPAD5 : return KEY_NP5;
-			case VK_NUMPAD6 : return KEY_NP6;
-			case VK_NUMPAD7 : return KEY_NP7;
-			case VK_NUMPAD8 : return KEY_NP8;
-			case VK_NUMPAD9 : return KEY_NP9;
+	if ( memcmp( keyBits, log->keyBits, sizeof( keyBits ) ) != 0 )
+	{
+		rec[ 8 ] |= 0x80;
 
-			case VK_MULTIPLY : return KEY_NP_MUL;
-			case VK_ADD      : return KEY_NP_ADD;
-			case VK_DIVIDE   : return KEY_NP_DIV;
-			case VK_SUBTRACT : return KEY_NP_SUB;
-			case VK_DECIMAL  : return KEY_NP_DECIMAL;
-		}
+		memcpy( log->keyBits, keyBits, sizeof( keyBits ) );
+	}
 
-		//
-		return KEY_NONE;
+	InputLog_append( log, rec, sizeof( rec ) );
+
+	if ( rec[ 8 ] & 0x80 )
+	{
+		InputLog_append( log, keyBits, sizeof( keyBits ) );
 	}
+}
 
-#else
+// Overwrites this frame's input, returns false at the end of the log
+static bool PGE_replayFrame ( void )
+{
+	InputLog* log;
+	uint8_t*  rec;
+	int16_t   x;
+	int16_t   y;
+	int       i;
 
-	static enum Key mapKey ( unsigned int sym )
+	log = pCtx->pReplayLog;
+	rec = log->pData + log->nPos;
+
+	if ( log->nPos + 9 > log->nSize ||
+	     ( ( rec[ 8 ] & 0x80 ) && log->nPos + 9 + 32 > log->nSize ) )
 	{
-		// Create Keyboard Mapping
-		switch ( sym )
-		{
-			case 0x00 : return KEY_NONE;
-			case 0x61 : return KEY_A;
-			case 0x62 : return KEY_B;
-			case 0x63 : return KEY_C;
-			case 0x64 : return KEY_D;
-			case 0x65 : return KEY_E;
-			case 0x66 : return KEY_F;
-			case 0x67 : return KEY_G;
-			case 0x68 : return KEY_H;
-			case 0x69 : return KEY_I;
-			case 0x6A : return KEY_J;
-			case 0x6B : return KEY_K;
-			case 0x6C : return KEY_L;
-			case 0x6D : return KEY_M;
-			case 0x6E : return KEY_N;
-			case 0x6F : return KEY_O;
-			case 0x70 : return KEY_P;
-			case 0x71 : return KEY_Q;
-			case 0x72 : return KEY_R;
-			case 0x73 : return KEY_S;
-			case 0x74 : return KEY_T;
-			case 0x75 : return KEY_U;
-			case 0x76 : return KEY_V;
-			case 0x77 : return KEY_W;
-			case 0x78 : return KEY_X;
-			case 0x79 : return KEY_Y;
-			case 0x7A : return KEY_Z;
+		InputLog_free( log );
 
-			case XK_F1  : return KEY_F1;
-			case XK_F2  : return KEY_F2;
-			case XK_F3  : return KEY_F3;
-			case XK_F4  : return KEY_F4;
-			case XK_F5  : return KEY_F5;
-			case XK_F6  : return KEY_F6;
-			case XK_F7  : return KEY_F7;
-			case XK_F8  : return KEY_F8;
-			case XK_F9  : return KEY_F9;
-			case XK_F10 : return KEY_F10;
-			case XK_F11 : return KEY_F11;
-			case XK_F12 : return KEY_F12;
+		pCtx->pReplayLog = NULL;
 
-			case XK_Down     : return KEY_DOWN;
-			case XK_Left     : return KEY_LEFT;
-			case XK_Right    : return KEY_RIGHT;
-			case XK_Up       : return KEY_UP;
-			case XK_KP_Enter : return KEY_ENTER;
-			case XK_Return   : return KEY_ENTER;
+		return false;
+	}
 
-			case XK_BackSpace   : return KEY_BACK;
-			case XK_Escape      : return KEY_ESCAPE;
-			case XK_Linefeed    : return KEY_ENTER;
-			case XK_Pause       : return KEY_PAUSE;
-			case XK_Scroll_Lock : return KEY_SCROLL;
-			case XK_Tab         : return KEY_TAB;
-			case XK_Delete      : return KEY_DEL;
-			case XK_Home        : return KEY_HOME;
-			case XK_End         : return KEY_END;
-			case XK_Page_Up     : return KEY_PGUP;
-			case XK_Page_Down   : return KEY_PGDN;
-			case XK_Insert      : return KEY_INS;
-			case XK_Shift_L     : return KEY_SHIFT;
-			case XK_Shift_R     : return KEY_SHIFT;
-			case XK_Control_L   : return KEY_CTRL;
-			case XK_Control_R   : return KEY_CTRL;
-			case XK_space       : return KEY_SPACE;
+	memcpy( &pCtx->fElapsedTime, rec + 0, 4 );
+	memcpy( &x, rec + 4, 2 );
+	memcpy( &y, rec + 6, 2 );
 
-			case XK_0 : return KEY_0;
-			case XK_1 : return KEY_1;
-			case XK_2 : return KEY_2;
-			case XK_3 : return KEY_3;
-			case XK_4 : return KEY_4;
-			case XK_5 : return KEY_5;
-			case XK_6 : return KEY_6;
-			case XK_7 : return KEY_7;
-			case XK_8 : return KEY_8;
-			case XK_9 : return KEY_9;
+	pCtx->nMousePosXCache = x;
+	pCtx->nMousePosYCache = y;
 
-			case XK_KP_0 : return KEY_NP0;
-			case XK_KP_1 : return KEY_NP1;
-			case XK_KP_2 : return KEY_NP2;
-			case XK_KP_3 : return KEY_NP3;
-			case XK_KP_4 : return KEY_NP4;
-			case XK_KP_5 : return KEY_NP5;
-			case XK_KP_6 : return KEY_NP6;
-			case XK_KP_7 : return KEY_NP7;
-			case XK_KP_8 : return KEY_NP8;
-			case XK_KP_9 : return KEY_NP9;
+	for ( i = 0; i < 5; i += 1 )
+	{
+		pCtx->pMouseNewState[ i ] = ( rec[ 8 ] >> i ) & 1;
+	}
 
-			case XK_KP_Multiply : return KEY_NP_MUL;
-			case XK_KP_Add      : return KEY_NP_ADD;
-			case XK_KP_Divide   : return KEY_NP_DIV;
-			case XK_KP_Subtract : return KEY_NP_SUB;
-			case XK_KP_Decimal  : return KEY_NP_DECIMAL;
-		}
+	log->nPos += 9;
 
-		//
-		return KEY_NONE;
+	if ( rec[ 8 ] & 0x80 )
+	{
+		memcpy( log->keyBits, rec + 9, 32 );
+
+		log->nPos += 32;
 	}
 
-#endif
+	for ( i = 0; i < 256; i += 1 )
+	{
+		pCtx->pKeyNewState[ i ] = ( log->keyBits[ i >> 3 ] >> ( i & 7 ) ) & 1;
+	}
+
+	return true;
+}
 
 
 //================================================================================
@@ -600,7 +9142,7 @@ HWButton PGE_getKey ( enum Key k )
 		{
 			case WM_CREATE:
 
-				sge = ( ( LPCREATESTRUCT ) lParam )->lpCreateParams;
+				pCtx->sge = ( ( LPCREATESTRUCT ) lParam )->lpCreateParams;
 
 				return 0;
 
@@ -608,157 +9150,313 @@ HWButton PGE_getKey ( enum Key k )
 
 				PGE_updateWindowSize( lParam & 0xFFFF, ( lParam >> 16 ) & 0xFFFF );
 
-				return 0;
+				return 0;
+
+			case WM_KEYDOWN:
+
+				pCtx->pKeyNewState[ mapKey( wParam ) ] = true;
+
+				return 0;
+
+			case WM_KEYUP:
+
+				pCtx->pKeyNewState[ mapKey( wParam ) ] = false;
+
+				return 0;
+
+			case WM_LBUTTONDOWN:
+
+				pCtx->pMouseNewState[ 0 ] = true;
+
+				return 0;
+
+			case WM_LBUTTONUP:
+
+				pCtx->pMouseNewState[ 0 ] = false;
+
+				return 0;
+
+			case WM_RBUTTONDOWN:
+
+				pCtx->pMouseNewState[ 1 ] = true;
+
+				return 0;
+
+			case WM_RBUTTONUP:
+
+				pCtx->pMouseNewState[ 1 ] = false;
+
+				return 0;
+
+			case WM_MBUTTONDOWN:
+
+				pCtx->pMouseNewState[ 2 ] = true;
+
+				return 0;
+
+			case WM_MBUTTONUP:
+
+				pCtx->pMouseNewState[ 2 ] = false;
+
+				return 0;
+
+			case WM_MOUSEMOVE:
+
+				uint16_t  x = lParam & 0xFFFF;
+				uint16_t  y = ( lParam >> 16 ) & 0xFFFF;
+				int16_t  ix = *( ( int16_t* ) &x );
+				int16_t  iy = *( ( int16_t* ) &y );
+
+				PGE_updateMouse( ix, iy );
+
+				return 0;
+
+			case WM_SETFOCUS:
+
+				pCtx->bHasInputFocus = true;
+
+				return 0;
+
+			case WM_KILLFOCUS:
+
+				pCtx->bHasInputFocus = false;
+
+				return 0;
+
+			case WM_CLOSE:
+
+				pCtx->bAtomActive = false;
+
+				return 0;
+
+			case WM_DESTROY:
+
+				PostQuitMessage( 0 );
+
+				return 0;
+		}
+
+		return DefWindowProc( hWnd, uMsg, wParam, lParam );
+	}
+
+#endif
 
-			case WM_KEYDOWN:
 
-				pKeyNewState[ mapKey( wParam ) ] = true;
+// Upload the default draw target and display it
+static void PGE_drawScreenQuad ( void )
+{
+	glBegin( GL_QUADS );
 
-				return 0;
+		glTexCoord2f( 0.0, 1.0 );
+		glVertex3f( - 1.0f, - 1.0f, 0.0f );
 
-			case WM_KEYUP:
+		glTexCoord2f( 0.0, 0.0 );
+		glVertex3f( - 1.0f,   1.0f, 0.0f );
 
-				pKeyNewState[ mapKey( wParam ) ] = false;
+		glTexCoord2f( 1.0, 0.0 );
+		glVertex3f(   1.0f,   1.0f, 0.0f );
 
-				return 0;
+		glTexCoord2f( 1.0, 1.0 );
+		glVertex3f(   1.0f, - 1.0f, 0.0f );
 
-			case WM_LBUTTONDOWN:
+	glEnd();
+}
 
-				pMouseNewState[ 0 ] = true;
+// Part of the screen quad, x and y as fractions of the screen from its top left
+static void PGE_drawScreenQuadPiece ( float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1 )
+{
+	glTexCoord2f( u0, v1 );
+	glVertex3f( x0 * 2.0f - 1.0f, 1.0f - y1 * 2.0f, 0.0f );
 
-				return 0;
+	glTexCoord2f( u0, v0 );
+	glVertex3f( x0 * 2.0f - 1.0f, 1.0f - y0 * 2.0f, 0.0f );
 
-			case WM_LBUTTONUP:
+	glTexCoord2f( u1, v0 );
+	glVertex3f( x1 * 2.0f - 1.0f, 1.0f - y0 * 2.0f, 0.0f );
 
-				pMouseNewState[ 0 ] = false;
+	glTexCoord2f( u1, v1 );
+	glVertex3f( x1 * 2.0f - 1.0f, 1.0f - y1 * 2.0f, 0.0f );
+}
 
-				return 0;
+// The screen quad for a ring scrolled target, split where the target wraps
+static void PGE_drawScreenQuadWrapped ( void )
+{
+	float fu;
+	float fv;
 
-			case WM_RBUTTONDOWN:
+	fu = ( float ) pCtx->nScrollOriginX / pCtx->pDefaultDrawTarget->width;
+	fv = ( float ) pCtx->nScrollOriginY / pCtx->pDefaultDrawTarget->height;
 
-				pMouseNewState[ 1 ] = true;
+	// The origin lands top left, the target's left and top edges follow on from its right and bottom
+	glBegin( GL_QUADS );
 
-				return 0;
+		PGE_drawScreenQuadPiece( 0.0f,        0.0f,        1.0f - fu, 1.0f - fv, fu,   fv,   1.0f, 1.0f );
+		PGE_drawScreenQuadPiece( 1.0f - fu,   0.0f,        1.0f,      1.0f - fv, 0.0f, fv,   fu,   1.0f );
+		PGE_drawScreenQuadPiece( 0.0f,        1.0f - fv,   1.0f - fu, 1.0f,      fu,   0.0f, 1.0f, fv   );
+		PGE_drawScreenQuadPiece( 1.0f - fu,   1.0f - fv,   1.0f,      1.0f,      0.0f, 0.0f, fu,   fv   );
 
-			case WM_RBUTTONUP:
+	glEnd();
+}
 
-				pMouseNewState[ 1 ] = false;
+// Upload what changed and composite the layers
+static void PGE_presentFrame ( void )
+{
+	Layer*  layer;
+	int32_t i;
+	double  tSwap;
 
-				return 0;
+	PGE_phaseBegin( PHASE_UPLOAD );
 
-			case WM_MBUTTONDOWN:
+	glViewport( pCtx->nViewX, pCtx->nViewY, pCtx->nViewW, pCtx->nViewH );
 
-				pMouseNewState[ 2 ] = true;
+	if ( pCtx->nLayers > 1 )
+	{
+		glClear( GL_COLOR_BUFFER_BIT );
+	}
 
-				return 0;
+	// Back to front, layer 0 on top
+	for ( i = pCtx->nLayers - 1; i >= 0; i -= 1 )
+	{
+		layer = pCtx->pLayers + i;
 
-			case WM_MBUTTONUP:
+		if ( ! layer->bEnabled )
+		{
+			continue;
+		}
 
-				pMouseNewState[ 2 ] = false;
+		if ( ! layer->glTexture )
+		{
+			layer->glTexture = PGE_createTexture( layer->pSprite );
+		}
+		else
+		{
+			glBindTexture( GL_TEXTURE_2D, layer->glTexture );
 
-				return 0;
+			// Copy pixel array into texture, layers are all screen sized
+			if ( i == 0 || layer->bDirty )
+			{
+				glPixelStorei( GL_UNPACK_ROW_LENGTH, layer->pSprite->nStride );
 
-			case WM_MOUSEMOVE:
+				glTexSubImage2D(
 
-				uint16_t  x = lParam & 0xFFFF;
-				uint16_t  y = ( lParam >> 16 ) & 0xFFFF;
-				int16_t  ix = *( ( int16_t* ) &x );
-				int16_t  iy = *( ( int16_t* ) &y );
+					GL_TEXTURE_2D,
+					0, 0, 0,
+					PGE_SCREEN_WIDTH, PGE_SCREEN_HEIGHT,
+					GL_RGBA,
+					GL_UNSIGNED_BYTE,
+					Sprite_getData( layer->pSprite )
+				);
 
-				PGE_updateMouse( ix, iy );
+				glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+			}
+		}
 
-				return 0;
+		layer->bDirty = false;
 
-			case WM_SETFOCUS:
+		// Display texture on screen
+		if ( i == 0 && pCtx->bScrollRing )
+		{
+			PGE_drawScreenQuadWrapped();
+		}
+		else
+		{
+			PGE_drawScreenQuad();
+		}
+	}
 
-				bHasInputFocus = true;
+	PGE_phaseEnd();
 
-				return 0;
+	PGE_phaseBegin( PHASE_DECALS );
 
-			case WM_KILLFOCUS:
+	PGE_drawDecals();
 
-				bHasInputFocus = false;
+	PGE_phaseEnd();
 
-				return 0;
+	// Present Graphics to screen
+	PGE_phaseBegin( PHASE_SWAP );
 
-			case WM_CLOSE:
+	tSwap = PGE_getTime();
 
-				bAtomActive = false;
+	#ifdef _WIN32
 
-				return 0;
+		SwapBuffers( pCtx->glDeviceContext );
 
-			case WM_DESTROY:
+	#else
 
-				PostQuitMessage( 0 );
+		glXSwapBuffers( pCtx->olc_Display, pCtx->olc_Window );
 
-				return 0;
-		}
+	#endif
 
-		return DefWindowProc( hWnd, uMsg, wParam, lParam );
+	// The first swap is often where the driver finishes its setup
+	if ( pCtx->startup.fFirstSwap == 0.0f )
+	{
+		pCtx->startup.fFirstSwap = ( float ) ( PGE_getTime() - tSwap );
 	}
 
-#endif
-
+	PGE_phaseEnd();
+}
 
 static void PGE_engineThread ( void )
 {
-	int i;
+	int  i;
+	bool bSimulated;
 
-	// Start OpenGL, the context is owned by the game thread
-	PGE_OpenGLCreate();
+	if ( ! pCtx->bHeadless )
+	{
+		// Start OpenGL, the context is owned by the game thread
+		PGE_OpenGLCreate();
 
 
-	// Create Screen Texture - disable filtering
-	glEnable( GL_TEXTURE_2D );
-	glGenTextures( 1, &glBuffer );
-	glBindTexture( GL_TEXTURE_2D, glBuffer );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
-	glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL );
+		// Create Screen Texture, layers are blended over each other
+		glEnable( GL_TEXTURE_2D );
+		glEnable( GL_BLEND );
+		glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+		glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
 
-	glTexImage2D(
+		pCtx->glBuffer = PGE_createTexture( pCtx->pDefaultDrawTarget );
 
-		GL_TEXTURE_2D,
-		0,
-		GL_RGBA,
-		nScreenWidth, nScreenHeight,
-		0,
-		GL_RGBA,
-		GL_UNSIGNED_BYTE,
-		Sprite_getData( pDefaultDrawTarget )
-	);
+		pCtx->pLayers[ 0 ].glTexture = pCtx->glBuffer;
+	}
 
 
 	// User setup
 	if ( ! UI_onUserCreate() )
 	{
-		bAtomActive = false;
+		pCtx->bAtomActive = false;
 	}
 
+	pCtx->tFrameStart = PGE_getTime();
+
 
-	while ( bAtomActive )
+	while ( pCtx->bAtomActive )
 	{
 		// Run as fast as possible
-		while ( bAtomActive )
+		while ( pCtx->bAtomActive )
 		{
+			// Handle timing
+			pCtx->fElapsedTime = ( float ) ( PGE_getTime() - pCtx->tFrameStart );
+			pCtx->tFrameStart  = PGE_getTime();
+
 			// Xlib message loop -------------------------------------------------
+			PGE_phaseBegin( PHASE_EVENTS );
+
 			#ifndef _WIN32
 
 				XEvent x_event;
 
-				while ( XPending( olc_Display ) )
+				while ( ! pCtx->bHeadless && XPending( pCtx->olc_Display ) )
 				{
-					XNextEvent( olc_Display, &x_event );
+					XNextEvent( pCtx->olc_Display, &x_event );
 
 					// ??
 					if ( x_event.type == Expose )
 					{
 						XWindowAttributes gwa;
 
-						XGetWindowAttributes( olc_Display, olc_Window, &gwa );
+						XGetWindowAttributes( pCtx->olc_Display, pCtx->olc_Window, &gwa );
 
-						nWindowWidth  = gwa.width;
-						nWindowHeight = gwa.height;
+						pCtx->nWindowWidth  = gwa.width;
+						pCtx->nWindowHeight = gwa.height;
 
 						PGE_updateViewport();
 
@@ -772,8 +9470,8 @@ static void PGE_engineThread ( void )
 
 						xce = x_event.xconfigure;
 
-						nWindowWidth  = xce.width;
-						nWindowHeight = xce.height;
+						pCtx->nWindowWidth  = xce.width;
+						pCtx->nWindowHeight = xce.height;
 					}
 
 					else if ( x_event.type == KeyPress )
@@ -783,13 +9481,13 @@ static void PGE_engineThread ( void )
 
 						sym = XLookupKeysym( &x_event.xkey, 0 );
 
-						pKeyNewState[ mapKey( sym ) ] = true;
+						pCtx->pKeyNewState[ mapKey( sym ) ] = true;
 
 						xke = ( XKeyEvent* ) &x_event;
 
 						XLookupString( xke, NULL, 0, &sym, NULL );
 
-						pKeyNewState[ mapKey( sym ) ] = true;
+						pCtx->pKeyNewState[ mapKey( sym ) ] = true;
 					}
 
 					else if ( x_event.type == KeyRelease )
@@ -799,13 +9497,13 @@ static void PGE_engineThread ( void )
 
 						sym = XLookupKeysym( &x_event.xkey, 0 );
 
-						pKeyNewState[ mapKey( sym ) ] = false;
+						pCtx->pKeyNewState[ mapKey( sym ) ] = false;
 
 						xke = ( XKeyEvent* ) &x_event;
 
 						XLookupString( xke, NULL, 0, &sym, NULL );
 
-						pKeyNewState[ mapKey( sym ) ] = false;
+						pCtx->pKeyNewState[ mapKey( sym ) ] = false;
 					}
 
 					else if ( x_event.type == ButtonPress )
@@ -814,17 +9512,17 @@ static void PGE_engineThread ( void )
 						{
 							case 1:
 
-								pMouseNewState[ 0 ] = true;
+								pCtx->pMouseNewState[ 0 ] = true;
 								break;
 
 							case 2:
 
-								pMouseNewState[ 1 ] = true;
+								pCtx->pMouseNewState[ 1 ] = true;
 								break;
 
 							case 3:
 
-								pMouseNewState[ 2 ] = true;
+								pCtx->pMouseNewState[ 2 ] = true;
 								break;
 
 							default:
@@ -839,17 +9537,17 @@ static void PGE_engineThread ( void )
 						{
 							case 1:
 
-								pMouseNewState[ 0 ] = false;
+								pCtx->pMouseNewState[ 0 ] = false;
 								break;
 
 							case 2:
 
-								pMouseNewState[ 1 ] = false;
+								pCtx->pMouseNewState[ 1 ] = false;
 								break;
 
 							case 3:
 
-								pMouseNewState[ 2 ] = false;
+								pCtx->pMouseNewState[ 2 ] = false;
 								break;
 
 							default:
@@ -865,53 +9563,75 @@ static void PGE_engineThread ( void )
 
 					else if ( x_event.type == FocusIn )
 					{
-						bHasInputFocus = true;
+						pCtx->bHasInputFocus = true;
 					}
 
 					else if ( x_event.type == FocusOut )
 					{
-						bHasInputFocus = false;
+						pCtx->bHasInputFocus = false;
 					}
 
 					else if ( x_event.type == ClientMessage )
 					{
-						bAtomActive = false;
+						pCtx->bAtomActive = false;
 					}
 				}
 
 			#endif
 
+			PGE_phaseEnd();
+
+
+			// Record or replay input -------------------------------------------
+			PGE_phaseBegin( PHASE_INPUT );
+
+			if ( pCtx->pReplayLog )
+			{
+				if ( ! PGE_replayFrame() )
+				{
+					// End of log, end of run
+					pCtx->bAtomActive = false;
+
+					PGE_phaseEnd();
+					continue;
+				}
+			}
+			else if ( pCtx->pRecordLog )
+			{
+				PGE_recordFrame();
+			}
+
 
 			// Handle user input - Keyboard --------------------------------------
 
 			for ( i = 0; i < 256; i += 1 )
 			{
-				pKeyboardState[ i ].bPressed  = false;
-				pKeyboardState[ i ].bReleased = false;
+				pCtx->pKeyboardState[ i ].bPressed  = false;
+				pCtx->pKeyboardState[ i ].bReleased = false;
 
 				// state has changed (press/release)
-				if ( pKeyNewState[ i ] != pKeyOldState[ i ] )
+				if ( pCtx->pKeyNewState[ i ] != pCtx->pKeyOldState[ i ] )
 				{
 					// pressed
-					if ( pKeyNewState[ i ] )
+					if ( pCtx->pKeyNewState[ i ] )
 					{
 						// bPressed is set once, the first time key is pressed
-						pKeyboardState[ i ].bPressed = ! pKeyboardState[ i ].bHeld;
+						pCtx->pKeyboardState[ i ].bPressed = ! pCtx->pKeyboardState[ i ].bHeld;
 
 						// bHeld is set for all frames between press and release
-						pKeyboardState[ i ].bHeld = true;
+						pCtx->pKeyboardState[ i ].bHeld = true;
 					}
 
 					// released
 					else
 					{
 						// bReleased is set once, the first time key is released
-						pKeyboardState[ i ].bReleased = true;
-						pKeyboardState[ i ].bHeld = false;
+						pCtx->pKeyboardState[ i ].bReleased = true;
+						pCtx->pKeyboardState[ i ].bHeld = false;
 					}
 				}
 
-				pKeyOldState[ i ] = pKeyNewState[ i ];
+				pCtx->pKeyOldState[ i ] = pCtx->pKeyNewState[ i ];
 			}
 
 
@@ -919,81 +9639,85 @@ static void PGE_engineThread ( void )
 
 			for ( i = 0; i < 5; i += 1 )
 			{
-				pMouseState[ i ].bPressed  = false;
-				pMouseState[ i ].bReleased = false;
+				pCtx->pMouseState[ i ].bPressed  = false;
+				pCtx->pMouseState[ i ].bReleased = false;
 
-				if ( pMouseNewState[ i ] != pMouseOldState[ i ] )
+				if ( pCtx->pMouseNewState[ i ] != pCtx->pMouseOldState[ i ] )
 				{
-					if ( pMouseNewState[ i ] )
+					if ( pCtx->pMouseNewState[ i ] )
 					{
-						pMouseState[ i ].bPressed = ! pMouseState[ i ].bHeld;
-						pMouseState[ i ].bHeld = true;
+						pCtx->pMouseState[ i ].bPressed = ! pCtx->pMouseState[ i ].bHeld;
+						pCtx->pMouseState[ i ].bHeld = true;
 					}
 					else
 					{
-						pMouseState[ i ].bReleased = true;
-						pMouseState[ i ].bHeld = false;
+						pCtx->pMouseState[ i ].bReleased = true;
+						pCtx->pMouseState[ i ].bHeld = false;
 					}
 				}
 
-				pMouseOldState[ i ] = pMouseNewState[ i ];
+				pCtx->pMouseOldState[ i ] = pCtx->pMouseNewState[ i ];
 			}
 
 			// Cache mouse coordinates so they remain consistent during a frame
-			nMousePosX = nMousePosXCache;
-			nMousePosY = nMousePosYCache;
+			pCtx->nMousePosX = pCtx->nMousePosXCache;
+			pCtx->nMousePosY = pCtx->nMousePosYCache;
 
+			PGE_phaseEnd();
 
-			// Handle user frame update ------------------------------------------
 
-			if ( ! UI_onUserUpdate() )
-			{
-				bAtomActive = false;
-			}
+			// Handle finished background loads ---------------------------------
 
+			PGE_shareFrameBegin();
 
-			// Display graphics --------------------------------------------------
+			PGE_phaseBegin( PHASE_LOADS );
+			PGE_completeLoads();
+			PGE_phaseEnd();
 
-			glViewport( nViewX, nViewY, nViewW, nViewH );
 
-			// Copy pixel array into texture
-			glTexSubImage2D(
+			// Handle fixed timestep simulation --------------------------------
 
-				GL_TEXTURE_2D,
-				0, 0, 0,
-				nScreenWidth, nScreenHeight,
-				GL_RGBA,
-				GL_UNSIGNED_BYTE,
-				Sprite_getData( pDefaultDrawTarget )
-			);
+			bSimulated = true;
 
-			// Display texture on screen
-			glBegin( GL_QUADS );
+			if ( pCtx->pfnSimulate )
+			{
+				PGE_phaseBegin( PHASE_SIMULATE );
 
-				glTexCoord2f( 0.0, 1.0 );
-				glVertex3f( - 1.0f, - 1.0f, 0.0f );
+				bSimulated = PGE_simulate();
 
-				glTexCoord2f( 0.0, 0.0 );
-				glVertex3f( - 1.0f,   1.0f, 0.0f );
+				PGE_phaseEnd();
+			}
 
-				glTexCoord2f( 1.0, 0.0 );
-				glVertex3f(   1.0f,   1.0f, 0.0f );
 
-				glTexCoord2f( 1.0, 1.0 );
-				glVertex3f(   1.0f, - 1.0f, 0.0f );
+			// Handle user frame update, unless the simulation quit -------------
 
-			glEnd();
+			PGE_phaseBegin( PHASE_UPDATE );
 
-			// Present Graphics to screen
-			#ifdef _WIN32
+			if ( bSimulated && ! UI_onUserUpdate() )
+			{
+				pCtx->bAtomActive = false;
+			}
 
-				SwapBuffers( glDeviceContext );
+			PGE_phaseEnd();
 
-			#else
-			
-				glXSwapBuffers( olc_Display, olc_Window );
+			PGE_shareFrameEnd();
 
-			#endif
+			PGE_phaseBegin( PHASE_CAPTURE );
+			PGE_captureFrame();
+			PGE_phaseEnd();
+
+
+			// Display graphics --------------------------------------------------
+
+			if ( ! pCtx->bHeadless )
+			{
+				PGE_presentFrame();
+			}
+
+			if ( pCtx->startup.fTotal == 0.0f )
+			{
+				pCtx->startup.fTotal = ( float ) ( PGE_getTime() - pCtx->tStart );
+			}
 
 		}
 
@@ -1006,25 +9730,28 @@ static void PGE_engineThread ( void )
 		else
 		{
 			// User denied destroy for some reason, so continue running
-			bAtomActive = true;
+			pCtx->bAtomActive = true;
 		}
 	}
 
 
 	// ?
-	#ifdef _WIN32
+	if ( ! pCtx->bHeadless )
+	{
+		#ifdef _WIN32
 
-		wglDeleteContext( glRenderContext );
-		PostMessage( olc_hWnd, WM_DESTROY, 0, 0 );
+			wglDeleteContext( pCtx->glRenderContext );
+			PostMessage( pCtx->olc_hWnd, WM_DESTROY, 0, 0 );
 
-	#else
+		#else
 
-		glXMakeCurrent( olc_Display, None, NULL );
-		glXDestroyContext( olc_Display, glDeviceContext );
-		XDestroyWindow( olc_Display, olc_Window );
-		XCloseDisplay( olc_Display );
+			glXMakeCurrent( pCtx->olc_Display, None, NULL );
+			glXDestroyContext( pCtx->olc_Display, pCtx->glDeviceContext );
+			XDestroyWindow( pCtx->olc_Display, pCtx->olc_Window );
+			XCloseDisplay( pCtx->olc_Display );
 
-	#endif
+		#endif
+	}
 }
 
 
@@ -1037,36 +9764,105 @@ enum rcode PGE_construct (
 	char* app_title
 )
 {
-	nScreenWidth  = screen_w;
-	nScreenHeight = screen_h;
-	nPixelWidth   = pixel_w;
-	nPixelHeight  = pixel_h;
+	PGE_resolveKernels();
+
+	pCtx->nScreenWidth  = screen_w;
+	pCtx->nScreenHeight = screen_h;
+	pCtx->nPixelWidth   = pixel_w;
+	pCtx->nPixelHeight  = pixel_h;
 
-	if ( nPixelWidth == 0 || nPixelHeight == 0 ||
-	     nScreenWidth == 0 || nScreenHeight == 0 )
+	if ( pCtx->nPixelWidth == 0 || pCtx->nPixelHeight == 0 ||
+	     pCtx->nScreenWidth == 0 || pCtx->nScreenHeight == 0 )
 	{
 		return FAIL;
 	}
 
-	// Create a sprite that represents the primary drawing target
-	pDefaultDrawTarget = Sprite_new( nScreenWidth, nScreenHeight );
+	// A build for a fixed resolution runs at that resolution only
+	if ( pCtx->nScreenWidth != PGE_SCREEN_WIDTH || pCtx->nScreenHeight != PGE_SCREEN_HEIGHT ||
+	     pCtx->nPixelWidth  != PGE_PIXEL_WIDTH  || pCtx->nPixelHeight  != PGE_PIXEL_HEIGHT )
+	{
+		return FAIL;
+	}
+
+	/* Create a sprite that represents the primary drawing target.
+	   Its pixels are initialised by PGE_start, alongside window and
+	   GL context creation, as a large target takes a while to fill.
+	   A draw or share before then initialises them first instead.
+	*/
+	pCtx->pDefaultDrawTarget = Sprite_alloc( PGE_SCREEN_WIDTH, PGE_SCREEN_HEIGHT );
+	pCtx->bTargetInitPending = true;
 
 	PGE_setDrawTarget( NULL );
 
+	PGE_addLayer( pCtx->pDefaultDrawTarget );
+
 
 	// Set the title bar text
 	if ( app_title != NULL )
 	{
-		appTitle = strdup( app_title );
+		pCtx->appTitle = strdup( app_title );
 	}
 	else
 	{
-		appTitle = strdup( "Untitled" );
+		pCtx->appTitle = strdup( "Untitled" );
 	}
 
 	return OK;
 }
 
+void PGE_setHeadless ( bool headless )
+{
+	pCtx->bHeadless = headless;
+}
+
+const StartupProfile* PGE_getStartupProfile ( void )
+{
+	return &pCtx->startup;
+}
+
+static PGE_THREAD_FUNC( PGE_initTargetThread )
+{
+	Sprite_initPixels( ( Sprite* ) arg );
+
+	PGE_THREAD_RETURN;
+}
+
+/* Creates the window, initialising the default target's pixels on a
+   helper thread meanwhile. Falls back to doing it inline.
+*/
+static bool PGE_startWindow ( void )
+{
+	PGE_Thread initThread;
+	bool       bThreaded;
+	bool       bOk;
+
+	bThreaded = false;
+
+	if ( pCtx->bTargetInitPending )
+	{
+		pCtx->bTargetInitPending = false;
+
+		bThreaded = ! pCtx->bHeadless &&
+		            Thread_create( &initThread, PGE_initTargetThread, pCtx->pDefaultDrawTarget );
+
+		if ( ! bThreaded )
+		{
+			Sprite_initPixels( pCtx->pDefaultDrawTarget );
+		}
+	}
+
+	bOk = pCtx->bHeadless || PGE_windowCreate();
+
+	if ( bThreaded )
+	{
+		Thread_join( initThread );
+	}
+
+	PGE_syncInlineTarget();
+
+	return bOk;
+}
+
 #ifdef _WIN32
 
 	// https://docs.microsoft.com/en-us/windows/win32/procthread/creating-threads
@@ -1074,6 +9870,9 @@ enum rcode PGE_construct (
 
 	DWORD WINAPI myThreadFunction ( LPVOID lpParam )
 	{
+		// Same engine as the thread that started it
+		PGE_setCurrentContext( ( PGE_Context* ) lpParam );
+
 		PGE_engineThread();
 
 		return 0;
@@ -1083,14 +9882,26 @@ enum rcode PGE_construct (
 	{
 		HANDLE engineThread;
 
-		if ( ! PGE_windowCreate() )
+		pCtx->tStart = PGE_getTime();
+
+		if ( ! PGE_startWindow() )
 		{
 			return FAIL;
 		}
 
+		// No window, so no message loop to service
+		if ( pCtx->bHeadless )
+		{
+			pCtx->bAtomActive = true;
+
+			PGE_engineThread();
+
+			return OK;
+		}
+
 
 		// Start the thread...
-		bAtomActive = true;
+		pCtx->bAtomActive = true;
 
 		// std::thread t = std::thread(&PixelGameEngine::EngineThread, this);
 		engineThread = CreateThread(
@@ -1098,7 +9909,7 @@ enum rcode PGE_construct (
             NULL,              // default security attributes
             0,                 // use default stack size  
             myThreadFunction,  // thread function name
-            NULL,              // argument to thread function 
+            pCtx,              // argument to thread function 
             0,                 // use default creation flags 
             NULL               // returns the thread identifier		
 		);
@@ -1126,14 +9937,16 @@ enum rcode PGE_construct (
 
 	enum rcode PGE_start ( void )
 	{
-		if ( ! PGE_windowCreate() )
+		pCtx->tStart = PGE_getTime();
+
+		if ( ! PGE_startWindow() )
 		{
 			return FAIL;
 		}
 
 
 		// Start the thread...
-		bAtomActive = true;
+		pCtx->bAtomActive = true;
 
 		// std::thread t = std::thread(&PixelGameEngine::EngineThread, this);
 		PGE_engineThread();
@@ -1167,14 +9980,20 @@ enum rcode PGE_construct (
 		wc.hbrBackground = NULL;
 		wc.lpszClassName = "OLC_PIXEL_GAME_ENGINE";
 
+		double t;
+
+		t = PGE_getTime();
+
 		RegisterClass( &wc );
 
+		pCtx->startup.fDisplayOpen = ( float ) ( PGE_getTime() - t );
 
-		nWindowWidth  = ( LONG ) nScreenWidth  * ( LONG ) nPixelWidth;
-		nWindowHeight = ( LONG ) nScreenHeight * ( LONG ) nPixelHeight;
 
-		nViewW = nWindowWidth;
-		nViewH = nWindowHeight;
+		pCtx->nWindowWidth  = ( LONG ) PGE_SCREEN_WIDTH  * ( LONG ) PGE_PIXEL_WIDTH;
+		pCtx->nWindowHeight = ( LONG ) PGE_SCREEN_HEIGHT * ( LONG ) PGE_PIXEL_HEIGHT;
+
+		pCtx->nViewW = pCtx->nWindowWidth;
+		pCtx->nViewH = pCtx->nWindowHeight;
 
 
 		// Define window furniture
@@ -1199,7 +10018,7 @@ enum rcode PGE_construct (
 		int width;
 		int height;
 
-		RECT rWndRect = { 0, 0, nWindowWidth, nWindowHeight };
+		RECT rWndRect = { 0, 0, pCtx->nWindowWidth, pCtx->nWindowHeight };
 
 		AdjustWindowRectEx( &rWndRect, dwStyle, FALSE, dwExStyle );
 
@@ -1207,11 +10026,13 @@ enum rcode PGE_construct (
 		height = rWndRect.bottom - rWndRect.top;
 
 
-		olc_hWnd = CreateWindowEx(
+		t = PGE_getTime();
+
+		pCtx->olc_hWnd = CreateWindowEx(
 
 			dwExStyle,
 			"OLC_PIXEL_GAME_ENGINE",
-			appTitle,
+			pCtx->appTitle,
 			dwStyle,
 			nCosmeticOffset,
 			nCosmeticOffset,
@@ -1220,16 +10041,22 @@ enum rcode PGE_construct (
 			NULL,
 			NULL,
 			GetModuleHandle( NULL ),
-			sge
+			pCtx->sge
 		);
 
-		return olc_hWnd;
+		pCtx->startup.fWindowMap = ( float ) ( PGE_getTime() - t );
+
+		return pCtx->olc_hWnd;
 	}
 
 	static bool PGE_OpenGLCreate ( void )
 	{
+		double t;
+
+		t = PGE_getTime();
+
 		// Create Device Context
-		glDeviceContext = GetDC( olc_hWnd );
+		pCtx->glDeviceContext = GetDC( pCtx->olc_hWnd );
 
 		PIXELFORMATDESCRIPTOR pfd = {
 
@@ -1240,67 +10067,172 @@ enum rcode PGE_construct (
 			PFD_MAIN_PLANE, 0, 0, 0, 0
 		};
 
-		int pf = ChoosePixelFormat( glDeviceContext, &pfd );
+		int pf = ChoosePixelFormat( pCtx->glDeviceContext, &pfd );
 
 		if ( ! pf )
 		{
 			return false;
 		}
 
-		SetPixelFormat( glDeviceContext, pf, &pfd );
+		SetPixelFormat( pCtx->glDeviceContext, pf, &pfd );
+
+		pCtx->startup.fVisualSelect = ( float ) ( PGE_getTime() - t );
 
-		glRenderContext = wglCreateContext( glDeviceContext );
+		t = PGE_getTime();
 
-		if ( ! glRenderContext )
+		pCtx->glRenderContext = wglCreateContext( pCtx->glDeviceContext );
+
+		if ( ! pCtx->glRenderContext )
 		{
 			return false;
 		}
 
-		wglMakeCurrent( glDeviceContext, glRenderContext );
+		wglMakeCurrent( pCtx->glDeviceContext, pCtx->glRenderContext );
+
+		pCtx->startup.fContextCreate = ( float ) ( PGE_getTime() - t );
 
-		glViewport( nViewX, nViewY, nViewW, nViewH );
+		glViewport( pCtx->nViewX, pCtx->nViewY, pCtx->nViewW, pCtx->nViewH );
 
 		return true;
 	}
 
 #else
 
+	/* Picks a double buffered RGB config, preferring one without depth
+	   or stencil buffers as the engine draws only flat textured quads.
+	*/
+	static bool PGE_chooseFBConfig ( void )
+	{
+		GLXFBConfig* configs;
+		int          nConfigs;
+		int          nDepth;
+		int          nStencil;
+		int          i;
+
+		int olc_GLAttribs [] = {
+
+			GLX_X_RENDERABLE,  True,
+			GLX_DRAWABLE_TYPE, GLX_WINDOW_BIT,
+			GLX_RENDER_TYPE,   GLX_RGBA_BIT,
+			GLX_RED_SIZE,      8,
+			GLX_GREEN_SIZE,    8,
+			GLX_BLUE_SIZE,     8,
+			GLX_DEPTH_SIZE,    0,
+			GLX_STENCIL_SIZE,  0,
+			GLX_DOUBLEBUFFER,  True,
+			None
+		};
+
+		configs = glXChooseFBConfig(
+
+			pCtx->olc_Display,
+			DefaultScreen( pCtx->olc_Display ),
+			olc_GLAttribs,
+			&nConfigs
+		);
+
+		if ( configs == NULL || nConfigs == 0 )
+		{
+			return false;
+		}
+
+		// Sorting favours deeper depth buffers, so look for an empty one
+		pCtx->glFBConfig = configs[ 0 ];
+
+		for ( i = 0; i < nConfigs; i += 1 )
+		{
+			glXGetFBConfigAttrib( pCtx->olc_Display, configs[ i ], GLX_DEPTH_SIZE,   &nDepth );
+			glXGetFBConfigAttrib( pCtx->olc_Display, configs[ i ], GLX_STENCIL_SIZE, &nStencil );
+
+			if ( nDepth == 0 && nStencil == 0 )
+			{
+				pCtx->glFBConfig = configs[ i ];
+
+				break;
+			}
+		}
+
+		XFree( configs );
+
+		pCtx->olc_VisualInfo = glXGetVisualFromFBConfig( pCtx->olc_Display, pCtx->glFBConfig );
+
+		return pCtx->olc_VisualInfo != NULL;
+	}
+
 	static Display* PGE_windowCreate ( void )
 	{
+		double t;
+
 		//XInitThreads();
 
 
 		// Grab the default display and window
-		olc_Display    = XOpenDisplay( NULL );
-		olc_WindowRoot = DefaultRootWindow( olc_Display );
+		t = PGE_getTime();
+
+		pCtx->olc_Display = XOpenDisplay( NULL );
+
+		if ( pCtx->olc_Display == NULL )
+		{
+			return NULL;
+		}
+
+		pCtx->olc_WindowRoot = DefaultRootWindow( pCtx->olc_Display );
+
+		pCtx->startup.fDisplayOpen = ( float ) ( PGE_getTime() - t );
 
 
 		// Based on the display capabilities, configure the appearance of the window
-		GLint olc_GLAttribs [] = {
+		t = PGE_getTime();
 
-			GLX_RGBA,
-			GLX_DEPTH_SIZE,
-			24,
-			GLX_DOUBLEBUFFER,
-			None
-		};
+		if ( ! PGE_chooseFBConfig() )
+		{
+			XCloseDisplay( pCtx->olc_Display );
+
+			return NULL;
+		}
 
-		olc_VisualInfo = glXChooseVisual( olc_Display, 0, olc_GLAttribs );
+		pCtx->startup.fVisualSelect = ( float ) ( PGE_getTime() - t );
 
 
-		olc_ColourMap = XCreateColormap(
+		/* The context only needs the config, so create it before the
+		   window rather than after, PGE_OpenGLCreate makes it current.
+		*/
+		t = PGE_getTime();
 
-			olc_Display,
-			olc_WindowRoot,
-			olc_VisualInfo->visual,
+		pCtx->glDeviceContext = glXCreateNewContext(
+
+			pCtx->olc_Display,
+			pCtx->glFBConfig,
+			GLX_RGBA_TYPE,
+			NULL,
+			True
+		);
+
+		if ( pCtx->glDeviceContext == NULL )
+		{
+			XCloseDisplay( pCtx->olc_Display );
+
+			return NULL;
+		}
+
+		pCtx->startup.fContextCreate = ( float ) ( PGE_getTime() - t );
+
+
+		t = PGE_getTime();
+
+		pCtx->olc_ColourMap = XCreateColormap(
+
+			pCtx->olc_Display,
+			pCtx->olc_WindowRoot,
+			pCtx->olc_VisualInfo->visual,
 			AllocNone
 		);
 
-		olc_SetWindowAttribs.colormap = olc_ColourMap;
+		pCtx->olc_SetWindowAttribs.colormap = pCtx->olc_ColourMap;
 
 
 		// Register which events we are interested in receiving
-		olc_SetWindowAttribs.event_mask = (
+		pCtx->olc_SetWindowAttribs.event_mask = (
 
 			ExposureMask      |
 			KeyPressMask      |
@@ -1314,27 +10246,31 @@ enum rcode PGE_construct (
 
 
 		// Create the window
-		olc_Window = XCreateWindow(
+		pCtx->olc_Window = XCreateWindow(
 
-			olc_Display,                   // display
-			olc_WindowRoot,                // parent
+			pCtx->olc_Display,                   // display
+			pCtx->olc_WindowRoot,                // parent
 			30, 30,                        // x, y
-			nScreenWidth * nPixelWidth,    // w
-			nScreenHeight * nPixelHeight,  // h
+			PGE_SCREEN_WIDTH * PGE_PIXEL_WIDTH,    // w
+			PGE_SCREEN_HEIGHT * PGE_PIXEL_HEIGHT,  // h
 			0,                             // border width
-			olc_VisualInfo->depth,         // depth
+			pCtx->olc_VisualInfo->depth,         // depth
 			InputOutput,                   // class?
-			olc_VisualInfo->visual,        // ?
+			pCtx->olc_VisualInfo->visual,        // ?
 			CWColormap | CWEventMask,      // ?
-			&olc_SetWindowAttribs
+			&pCtx->olc_SetWindowAttribs
 		);
 
-		Atom wmDelete = XInternAtom( olc_Display, "WM_DELETE_WINDOW", true );
-		XSetWMProtocols( olc_Display, olc_Window, &wmDelete, 1 );
+		Atom wmDelete = XInternAtom( pCtx->olc_Display, "WM_DELETE_WINDOW", true );
+		XSetWMProtocols( pCtx->olc_Display, pCtx->olc_Window, &wmDelete, 1 );
 
-		XMapWindow( olc_Display, olc_Window);
+		XMapWindow( pCtx->olc_Display, pCtx->olc_Window);
 
-		XStoreName( olc_Display, olc_Window, appTitle );
+		XStoreName( pCtx->olc_Display, pCtx->olc_Window, pCtx->appTitle );
+
+		XFlush( pCtx->olc_Display );
+
+		pCtx->startup.fWindowMap = ( float ) ( PGE_getTime() - t );
 
 
 		//
@@ -1342,18 +10278,22 @@ enum rcode PGE_construct (
 
 
 		//
-		return olc_Display;
+		return pCtx->olc_Display;
 	}
 
 	static bool PGE_OpenGLCreate ( void )
 	{
 		XWindowAttributes gwa;
+		double            t;
+
+		t = PGE_getTime();
+
+		glXMakeCurrent( pCtx->olc_Display, pCtx->olc_Window, pCtx->glDeviceContext );
 
-		glDeviceContext = glXCreateContext( olc_Display, olc_VisualInfo, NULL, GL_TRUE );
-		glXMakeCurrent( olc_Display, olc_Window, glDeviceContext );
+		pCtx->startup.fContextCreate += ( float ) ( PGE_getTime() - t );
 
 
-		XGetWindowAttributes( olc_Display, olc_Window, &gwa );
+		XGetWindowAttributes( pCtx->olc_Display, pCtx->olc_Window, &gwa );
 		glViewport( 0, 0, gwa.width, gwa.height );
 
 		return true;
@@ -1369,19 +10309,91 @@ enum rcode PGE_construct (
 */
 enum rcode PGE_destroy ( void )
 {
+	int32_t i;
+
 	#ifdef _WIN32
 
 		//
 
 	#else
 
-		XFree( olc_VisualInfo );
+		if ( pCtx->olc_VisualInfo )
+		{
+			XFree( pCtx->olc_VisualInfo );
+		}
 
 	#endif
 
-	Sprite_free( pDefaultDrawTarget );
+	PGE_captureStop();
+
+	Loader_destroy();
+
+	if ( pCtx->pRecordLog )
+	{
+		PGE_recordStop();
+	}
+
+	if ( pCtx->pReplayLog )
+	{
+		InputLog_free( pCtx->pReplayLog );
+
+		pCtx->pReplayLog = NULL;
+	}
+
+	// Layer 0 is the default draw target
+	for ( i = 1; i < pCtx->nLayers; i += 1 )
+	{
+		Sprite_free( pCtx->pLayers[ i ].pSprite );
+	}
+
+	free( pCtx->pLayers );
+
+	pCtx->pLayers   = NULL;
+	pCtx->nLayers   = 0;
+	pCtx->nLayerCap = 0;
+
+	free( pCtx->pDecalVerts );
+	free( pCtx->pDecalRuns );
+
+	pCtx->pDecalVerts   = NULL;
+	pCtx->nDecalVerts   = 0;
+	pCtx->nDecalVertCap = 0;
+	pCtx->pDecalRuns    = NULL;
+	pCtx->nDecalRuns    = 0;
+	pCtx->nDecalRunCap  = 0;
+
+	Sprite_free( pCtx->pDefaultDrawTarget );
+
+	PGE_shareStop();
+
+	pCtx->pDefaultDrawTarget = NULL;
+	pCtx->pDrawTarget        = NULL;
+	pgeDrawTarget            = NULL;
+
+	free( pCtx->pClips );
+
+	pCtx->pClips   = NULL;
+	pCtx->nClips   = 0;
+	pCtx->nClipCap = 0;
+
+	for ( i = 0; i < pCtx->nClipStates; i += 1 )
+	{
+		free( pCtx->pClipStates[ i ].pClips );
+	}
+
+	free( pCtx->pClipStates );
+
+	pCtx->pClipStates   = NULL;
+	pCtx->nClipStates   = 0;
+	pCtx->nClipStateCap = 0;
+
+	memset( &pCtx->clip, 0, sizeof( Rect ) );
+
+	pgeClip = pCtx->clip;
+
+	PGE_clearLoadStats();
 
-	free( appTitle );
+	free( pCtx->appTitle );
 
 	return OK;
 }
@@ -0,0 +1,320 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>  // rand
+
+#include "../olcPGE_min.h"
+
+/* Times the draw kernels, then a headless engine's frame phases, with
+   hardware counters next to each timing where the system allows them.
+   Columns are left as "-" when counters cannot be opened, e.g. when
+   /proc/sys/kernel/perf_event_paranoid is above 2, or in a VM.
+*/
+
+#define SCREEN_W 640
+#define SCREEN_H 360
+#define FRAMES   50
+#define SPRITE   64
+
+
+static int32_t nFrame;
+
+bool UI_onUserCreate  ( void ) { return true; }
+bool UI_onUserDestroy ( void ) { return true; }
+
+bool UI_onUserUpdate ( void )
+{
+	PGE_clearRGB( 0, 0, 0 );
+
+	nFrame += 1;
+
+	return nFrame < FRAMES;
+}
+
+static void header ( void )
+{
+	printf( "  %-16s %9s %9s %6s %9s %9s %9s\n", "", "ms", "ns/px", "IPC", "L1/px", "LLC/px", "br/px" );
+}
+
+static void report ( const char* sName, const PerfSample* s, double nPixels )
+{
+	printf( "  %-16s %9.3f %9.3f", sName, s->fSeconds * 1e3, s->fSeconds / nPixels * 1e9 );
+
+	if ( PGE_perfIsOpen() && s->nCycles > 0 )
+	{
+		printf(
+
+			" %6.2f %9.4f %9.4f %9.4f\n",
+			( double ) s->nInstructions / ( double ) s->nCycles,
+			( double ) s->nL1Misses     / nPixels,
+			( double ) s->nLLCMisses    / nPixels,
+			( double ) s->nBranchMisses / nPixels
+		);
+	}
+	else
+	{
+		printf( " %6s %9s %9s %9s\n", "-", "-", "-", "-" );
+	}
+}
+
+static Sprite* makeSprite ( void )
+{
+	Sprite* sp;
+	Pixel   p;
+	int32_t x;
+	int32_t y;
+
+	sp = Sprite_new( SPRITE, SPRITE );
+
+	for ( y = 0; y < SPRITE; y += 1 )
+	{
+		for ( x = 0; x < SPRITE; x += 1 )
+		{
+			p.r = x * 4;
+			p.g = y * 4;
+			p.b = rand();
+			p.a = ( x ^ y ) & 8 ? 255 : 96;
+
+			sp->pColData[ y * SPRITE + x ] = p;
+		}
+	}
+
+	return sp;
+}
+
+static void kernels ( void )
+{
+	Sprite*    sp;
+	Sprite*    ch;
+	SpriteRLE* rle;
+	Particles* ps;
+	Pixel      col;
+	PerfSample t;
+	PerfSample d;
+	float      m [ 6 ];
+	int32_t    x;
+	int32_t    y;
+	int32_t    i;
+	int32_t    f;
+
+	sp = makeSprite();
+
+	printf( "draw kernels, %d frames\n", FRAMES );
+
+	header();
+
+
+	PGE_perfSample( &t );
+
+	for ( f = 0; f < FRAMES; f += 1 )
+	{
+		PGE_clearRGB( f, 0, 0 );
+	}
+
+	PGE_perfElapsed( &t, &d );
+	report( "clear", &d, ( double ) FRAMES * SCREEN_W * SCREEN_H );
+
+
+	// A pixel at a time, as user code plots; see PGE_INLINE
+	PGE_perfSample( &t );
+
+	for ( f = 0; f < FRAMES; f += 1 )
+	{
+		for ( y = 0; y < SCREEN_H; y += 1 )
+		{
+			for ( x = 0; x < SCREEN_W; x += 1 )
+			{
+				PGE_drawRGB( x, y, x, y, f );
+			}
+		}
+	}
+
+	PGE_perfElapsed( &t, &d );
+	report( "drawRGB", &d, ( double ) FRAMES * SCREEN_W * SCREEN_H );
+
+
+	PGE_setPixelMode( PIXEL_NORMAL );
+
+	PGE_perfSample( &t );
+
+	for ( f = 0; f < FRAMES; f += 1 )
+	{
+		for ( i = 0; i < 100; i += 1 )
+		{
+			PGE_drawSprite( ( i * 37 + f ) % SCREEN_W - SPRITE / 2, ( i * 53 ) % SCREEN_H - SPRITE / 2, sp );
+		}
+	}
+
+	PGE_perfElapsed( &t, &d );
+	report( "sprite normal", &d, ( double ) FRAMES * 100 * SPRITE * SPRITE );
+
+
+	PGE_setPixelMode( PIXEL_ALPHA );
+
+	PGE_perfSample( &t );
+
+	for ( f = 0; f < FRAMES; f += 1 )
+	{
+		for ( i = 0; i < 100; i += 1 )
+		{
+			PGE_drawSprite( ( i * 37 + f ) % SCREEN_W - SPRITE / 2, ( i * 53 ) % SCREEN_H - SPRITE / 2, sp );
+		}
+	}
+
+	PGE_perfElapsed( &t, &d );
+	report( "sprite alpha", &d, ( double ) FRAMES * 100 * SPRITE * SPRITE );
+
+
+	// A character like sprite, an opaque disc in a transparent square, masked then run length encoded
+	ch = makeSprite();
+
+	for ( y = 0; y < SPRITE; y += 1 )
+	{
+		for ( x = 0; x < SPRITE; x += 1 )
+		{
+			ch->pColData[ y * SPRITE + x ].a = ( x - SPRITE / 2 ) * ( x - SPRITE / 2 ) + ( y - SPRITE / 2 ) * ( y - SPRITE / 2 ) < SPRITE * SPRITE / 5 ? 255 : 0;
+		}
+	}
+
+	rle = SpriteRLE_new( ch );
+
+	for ( i = 0; i < 2; i += 1 )
+	{
+		PGE_setPixelMode( PIXEL_MASK );
+
+		PGE_perfSample( &t );
+
+		for ( f = 0; f < FRAMES; f += 1 )
+		{
+			for ( x = 0; x < 100; x += 1 )
+			{
+				if ( i == 1 )
+				{
+					PGE_drawSpriteRLE( ( x * 37 + f ) % SCREEN_W - SPRITE / 2, ( x * 53 ) % SCREEN_H - SPRITE / 2, rle );
+				}
+				else
+				{
+					PGE_drawSprite( ( x * 37 + f ) % SCREEN_W - SPRITE / 2, ( x * 53 ) % SCREEN_H - SPRITE / 2, ch );
+				}
+			}
+		}
+
+		PGE_perfElapsed( &t, &d );
+		report( i == 1 ? "sprite rle" : "sprite mask", &d, ( double ) FRAMES * 100 * SPRITE * SPRITE );
+	}
+
+	SpriteRLE_free( rle );
+	Sprite_free( ch );
+
+
+	// Rotated about a quarter turn and scaled up, covering about 2.2x the sprite
+	PGE_setPixelMode( PIXEL_NORMAL );
+
+	m[ 0 ] = 1.2f; m[ 1 ] = - 0.9f; m[ 2 ] = 200.0f;
+	m[ 3 ] = 0.9f; m[ 4 ] =   1.2f; m[ 5 ] = 100.0f;
+
+	for ( i = 0; i < 2; i += 1 )
+	{
+		PGE_perfSample( &t );
+
+		for ( f = 0; f < FRAMES * 10; f += 1 )
+		{
+			PGE_drawSpriteTransformed( sp, m, i == 1 );
+		}
+
+		PGE_perfElapsed( &t, &d );
+		report( i == 1 ? "affine bilinear" : "affine nearest", &d, ( double ) FRAMES * 10 * SPRITE * SPRITE * 2.25 );
+	}
+
+
+	ps = Particles_new( 100000 );
+
+	for ( i = 0; i < 100000; i += 1 )
+	{
+		col.r = rand();
+		col.g = rand();
+		col.b = rand();
+		col.a = 128;
+
+		Particles_emit( ps, rand() % SCREEN_W, rand() % SCREEN_H, 0.0f, 0.0f, 1000.0f, col );
+	}
+
+	PGE_setPixelMode( PIXEL_ADD );
+
+	PGE_perfSample( &t );
+
+	for ( f = 0; f < FRAMES; f += 1 )
+	{
+		PGE_drawParticles( ps );
+	}
+
+	PGE_perfElapsed( &t, &d );
+	report( "particles add", &d, ( double ) FRAMES * 100000 );
+
+	PGE_setPixelMode( PIXEL_NORMAL );
+
+	Particles_free( ps );
+
+	Sprite_free( sp );
+}
+
+static void phases ( void )
+{
+	const PhaseStat* st;
+	int32_t          i;
+
+	printf( "\nengine phases, headless, %d frames\n", FRAMES );
+
+	header();
+
+	PGE_benchStart();
+
+	PGE_setHeadless( true );
+	PGE_start();
+
+	for ( i = 0; i < PGE_getPhaseStatCount(); i += 1 )
+	{
+		st = PGE_getPhaseStat( i );
+
+		if ( st->nCalls > 0 )
+		{
+			// Totals over the run; a phase has no pixel count of its own, so each frame's screen stands in
+			report( st->sName, &st->total, ( double ) st->nCalls * SCREEN_W * SCREEN_H );
+		}
+	}
+
+	PGE_benchStop();
+}
+
+int main ( void )
+{
+	int32_t i;
+
+	if ( PGE_construct( SCREEN_W, SCREEN_H, 1, 1, "bench_draw" ) != OK )
+	{
+		return 1;
+	}
+
+	// Set PGE_KERNELS to compare variants
+	printf( "kernels:" );
+
+	for ( i = 0; i < PGE_getKernelCount(); i += 1 )
+	{
+		printf( " %s=%s", PGE_getKernelName( i ), PGE_getKernelVariant( i ) );
+	}
+
+	printf( "\n\n" );
+
+	if ( PGE_perfOpen() != OK )
+	{
+		printf( "hardware counters unavailable, timing only\n\n" );
+	}
+
+	kernels();
+	phases();
+
+	PGE_perfClose();
+	PGE_destroy();
+
+	return 0;
+}
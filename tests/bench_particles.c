@@ -0,0 +1,169 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>  // rand
+#include <time.h>
+
+#include "../olcPGE_min.h"
+
+/* Times the particle system at 10k, 100k and 1M particles, headless.
+   Particles live long enough that the count holds steady, and are
+   spread a little past the screen edges so clipping is exercised.
+*/
+
+#define SCREEN_W 640
+#define SCREEN_H 360
+#define FRAMES   50
+
+
+bool UI_onUserCreate  ( void ) { return true; }
+bool UI_onUserUpdate  ( void ) { return true; }
+bool UI_onUserDestroy ( void ) { return true; }
+
+static double now ( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return ( double ) ts.tv_sec + ( double ) ts.tv_nsec * 1e-9;
+}
+
+static float frand ( float lo, float hi )
+{
+	return lo + ( hi - lo ) * ( ( float ) rand() / ( float ) RAND_MAX );
+}
+
+static void report ( const char* sName, int32_t n, double t )
+{
+	printf( "  %-12s %8.3f ms/frame  %6.2f ns/particle\n", sName, t / FRAMES * 1e3, t / FRAMES / n * 1e9 );
+}
+
+// Array of structs, plotted a call at a time
+struct OldParticle
+{
+	float    x;
+	float    y;
+	float    vx;
+	float    vy;
+	float    life;
+	uint32_t col;
+};
+
+static void bench ( int32_t n )
+{
+	Particles*          ps;
+	struct OldParticle* aos;
+	Pixel               col;
+	double              t;
+	int32_t             i;
+	int32_t             f;
+
+	ps = Particles_new( n );
+
+	for ( i = 0; i < n; i += 1 )
+	{
+		col.r = rand();
+		col.g = rand();
+		col.b = rand();
+		col.a = 128;
+
+		Particles_emit(
+
+			ps,
+			frand( - 20.0f, SCREEN_W + 20.0f ), frand( - 20.0f, SCREEN_H + 20.0f ),
+			frand( - 30.0f, 30.0f ), frand( - 30.0f, 30.0f ),
+			1000.0f,
+			col
+		);
+	}
+
+	printf( "%d particles\n", n );
+
+
+	t = now();
+
+	for ( f = 0; f < FRAMES; f += 1 )
+	{
+		Particles_update( ps, 1.0f / 60.0f, 0.0f, 9.8f );
+	}
+
+	report( "update", n, now() - t );
+
+
+	PGE_setPixelMode( PIXEL_ADD );
+
+	t = now();
+
+	for ( f = 0; f < FRAMES; f += 1 )
+	{
+		PGE_drawParticles( ps );
+	}
+
+	report( "draw add", n, now() - t );
+
+
+	PGE_setPixelMode( PIXEL_ALPHA );
+
+	t = now();
+
+	for ( f = 0; f < FRAMES; f += 1 )
+	{
+		PGE_drawParticles( ps );
+	}
+
+	report( "draw alpha", n, now() - t );
+
+
+	// What the effects layer used to do, for comparison
+	PGE_setPixelMode( PIXEL_NORMAL );
+
+	aos = ( struct OldParticle* ) malloc( n * sizeof( struct OldParticle ) );
+
+	for ( i = 0; i < n; i += 1 )
+	{
+		aos[ i ].x    = frand( - 20.0f, SCREEN_W + 20.0f );
+		aos[ i ].y    = frand( - 20.0f, SCREEN_H + 20.0f );
+		aos[ i ].vx   = frand( - 30.0f, 30.0f );
+		aos[ i ].vy   = frand( - 30.0f, 30.0f );
+		aos[ i ].life = 1000.0f;
+		aos[ i ].col  = rand();
+	}
+
+	t = now();
+
+	for ( f = 0; f < FRAMES; f += 1 )
+	{
+		for ( i = 0; i < n; i += 1 )
+		{
+			aos[ i ].x    += aos[ i ].vx / 60.0f;
+			aos[ i ].y    += aos[ i ].vy / 60.0f;
+			aos[ i ].vy   += 9.8f / 60.0f;
+			aos[ i ].life -= 1.0f / 60.0f;
+
+			PGE_drawRGB( ( int32_t ) aos[ i ].x, ( int32_t ) aos[ i ].y, aos[ i ].col, aos[ i ].col >> 8, aos[ i ].col >> 16 );
+		}
+	}
+
+	report( "aos+drawRGB", n, now() - t );
+
+	free( aos );
+
+	Particles_free( ps );
+}
+
+int main ( void )
+{
+	if ( PGE_construct( SCREEN_W, SCREEN_H, 1, 1, "bench_particles" ) != OK )
+	{
+		return 1;
+	}
+
+	bench( 10000 );
+	bench( 100000 );
+	bench( 1000000 );
+
+	PGE_destroy();
+
+	return 0;
+}
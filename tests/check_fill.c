@@ -0,0 +1,167 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>  // rand
+#include <string.h>
+
+#include "../olcPGE_min.h"
+
+/* Checks PGE_floodFill against a plain 4-connected breadth first fill
+   on random grids, drawn into views with random clips. Exits non-zero
+   on any difference.
+*/
+
+#define TRIALS 3000
+
+
+bool UI_onUserCreate  ( void ) { return true; }
+bool UI_onUserDestroy ( void ) { return true; }
+bool UI_onUserUpdate  ( void ) { return false; }
+
+static bool samePixel ( Pixel a, Pixel b )
+{
+	return memcmp( &a, &b, sizeof( Pixel ) ) == 0;
+}
+
+// Fills from ( x, y ) within clip c, which it lies in, queueing pixel offsets
+static void referenceFill ( Pixel* p, int32_t nStride, int32_t x, int32_t y, Pixel col, Rect c, int32_t* queue )
+{
+	static const int32_t dx [ 4 ] = { 1, -1, 0,  0 };
+	static const int32_t dy [ 4 ] = { 0,  0, 1, -1 };
+
+	Pixel   old;
+	int32_t nHead;
+	int32_t nTail;
+	int32_t px;
+	int32_t py;
+	int32_t nx;
+	int32_t ny;
+	int32_t k;
+
+	old = p[ y * nStride + x ];
+
+	if ( samePixel( old, col ) )
+	{
+		return;
+	}
+
+	nHead = 0;
+	nTail = 0;
+
+	p[ y * nStride + x ] = col;
+	queue[ nTail ] = y * nStride + x;
+	nTail += 1;
+
+	while ( nHead < nTail )
+	{
+		px = queue[ nHead ] % nStride;
+		py = queue[ nHead ] / nStride;
+
+		nHead += 1;
+
+		for ( k = 0; k < 4; k += 1 )
+		{
+			nx = px + dx[ k ];
+			ny = py + dy[ k ];
+
+			if ( nx < c.x || ny < c.y || nx >= c.x + c.w || ny >= c.y + c.h )
+			{
+				continue;
+			}
+
+			if ( samePixel( p[ ny * nStride + nx ], old ) )
+			{
+				p[ ny * nStride + nx ] = col;
+				queue[ nTail ] = ny * nStride + nx;
+				nTail += 1;
+			}
+		}
+	}
+}
+
+int main ( void )
+{
+	Sprite*  big;
+	Sprite*  view;
+	Pixel*   expected;
+	int32_t* queue;
+	Pixel    col;
+	Rect     c;
+	int32_t  w;
+	int32_t  h;
+	int32_t  nStride;
+	int32_t  nPixels;
+	int32_t  nDensity;
+	int32_t  x;
+	int32_t  y;
+	int32_t  i;
+	int32_t  t;
+	int32_t  nBad;
+
+	srand( 1 );
+
+	if ( PGE_construct( 64, 64, 1, 1, "check_fill" ) != OK )
+	{
+		return 1;
+	}
+
+	nBad = 0;
+
+	for ( t = 0; t < TRIALS; t += 1 )
+	{
+		// A view inside a wider sprite, so the fill must keep to its stride
+		w        = 1 + rand() % 90;
+		h        = 1 + rand() % 60;
+		nStride  = w + 7;
+		nPixels  = nStride * ( h + 3 );
+		nDensity = rand() % 60;
+
+		big  = Sprite_new( nStride, h + 3 );
+		view = Sprite_newView( big, 5, 2, w, h );
+
+		for ( i = 0; i < nPixels; i += 1 )
+		{
+			big->pColData[ i ] = ( Pixel ) { 0, 0, rand() % 100 < nDensity, 255 };
+		}
+
+		expected = ( Pixel* ) malloc( nPixels * sizeof( Pixel ) );
+		queue    = ( int32_t* ) malloc( nPixels * sizeof( int32_t ) );
+
+		memcpy( expected, big->pColData, nPixels * sizeof( Pixel ) );
+
+		x   = rand() % w;
+		y   = rand() % h;
+		col = ( Pixel ) { 9, rand() % 2, rand() % 3 == 0, 255 };
+
+		PGE_setDrawTarget( view );
+		PGE_pushClip( rand() % w - 5, rand() % h - 5, rand() % ( w + 5 ), rand() % ( h + 5 ) );
+
+		c = PGE_getClip();
+
+		PGE_floodFill( x, y, col );
+
+		PGE_popClip();
+		PGE_setDrawTarget( NULL );
+
+		if ( x >= c.x && y >= c.y && x < c.x + c.w && y < c.y + c.h )
+		{
+			referenceFill( expected + 2 * nStride + 5, nStride, x, y, col, c, queue );
+		}
+
+		if ( memcmp( expected, big->pColData, nPixels * sizeof( Pixel ) ) != 0 )
+		{
+			nBad += 1;
+		}
+
+		Sprite_free( view );
+		Sprite_free( big );
+		free( expected );
+		free( queue );
+	}
+
+	PGE_destroy();
+
+	printf( "flood fill: %d of %d trials differ\n", nBad, TRIALS );
+
+	return nBad != 0;
+}
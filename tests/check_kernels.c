@@ -0,0 +1,198 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>  // rand, setenv
+#include <string.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../olcPGE_min.h"
+
+/* Checks that every kernel variant draws the same pixels as the scalar
+   ones. Kernels are picked once per process, so each PGE_KERNELS cap
+   draws the scene in a forked child, which sends the result back over
+   a pipe. The scene covers clears, sprites in each pixel mode, scaling
+   and rotation with both samplers, at odd sizes and under a clip, so
+   the vector tails run too. Palette expansion is left to PNG loading.
+   Exits non-zero on any difference.
+*/
+
+#define TARGET_W 160
+#define TARGET_H 120
+#define NPIXELS  ( TARGET_W * TARGET_H )
+
+
+static const char* sLevels [] = { "scalar", "sse2", "avx2", "avx512" };
+
+bool UI_onUserCreate  ( void ) { return true; }
+bool UI_onUserDestroy ( void ) { return true; }
+bool UI_onUserUpdate  ( void ) { return false; }
+
+static void drawScene ( Sprite* target )
+{
+	Sprite* sp;
+	float   m [ 6 ];
+	int32_t i;
+	int32_t k;
+
+	srand( 1 );
+
+	// Odd sizes, so no row is a whole number of vectors
+	sp = Sprite_new( 37, 29 );
+
+	for ( i = 0; i < 37 * 29; i += 1 )
+	{
+		k = rand() % 4;
+
+		sp->pColData[ i ] = ( Pixel ) { rand(), rand(), rand(), k == 0 ? 0 : k == 1 ? 255 : rand() };
+	}
+
+	PGE_setDrawTarget( target );
+	PGE_clearRGB( 20, 40, 60 );
+
+	PGE_pushClip( 3, 5, TARGET_W - 7, TARGET_H - 9 );
+	PGE_clearRGB( 60, 40, 20 );
+
+	for ( k = 0; k < 4; k += 1 )
+	{
+		PGE_setPixelMode( ( enum PixelMode ) k );
+
+		for ( i = 0; i < 12; i += 1 )
+		{
+			PGE_drawSprite( rand() % ( TARGET_W + 40 ) - 40, rand() % ( TARGET_H + 30 ) - 30, sp );
+		}
+	}
+
+	PGE_setPixelMode( PIXEL_NORMAL );
+
+	for ( i = 0; i < 16; i += 1 )
+	{
+		// Scaled only, then rotated as well
+		m[ 0 ] = 0.5f + ( rand() % 300 ) / 100.0f;
+		m[ 1 ] = i < 8 ? 0.0f : ( rand() % 200 - 100 ) / 100.0f;
+		m[ 2 ] = ( float ) ( rand() % TARGET_W - 20 );
+		m[ 3 ] = i < 8 ? 0.0f : ( rand() % 200 - 100 ) / 100.0f;
+		m[ 4 ] = 0.5f + ( rand() % 300 ) / 100.0f;
+		m[ 5 ] = ( float ) ( rand() % TARGET_H - 20 );
+
+		PGE_drawSpriteTransformed( sp, m, i % 2 == 1 );
+	}
+
+	PGE_popClip();
+	PGE_setDrawTarget( NULL );
+
+	Sprite_free( sp );
+}
+
+// Draws the scene under the given cap, into pixels
+static bool drawWithKernels ( const char* sLevel, Pixel* pixels )
+{
+	Sprite* target;
+	size_t  nRead;
+	ssize_t n;
+	pid_t   pid;
+	int     fd [ 2 ];
+	int     nStatus;
+	int32_t i;
+
+	if ( pipe( fd ) != 0 )
+	{
+		return false;
+	}
+
+	// Or the child would print what is still buffered as well
+	fflush( stdout );
+
+	pid = fork();
+
+	if ( pid == 0 )
+	{
+		close( fd[ 0 ] );
+
+		setenv( "PGE_KERNELS", sLevel, 1 );
+
+		if ( PGE_construct( 64, 64, 1, 1, "check_kernels" ) != OK )
+		{
+			_exit( 1 );
+		}
+
+		printf( "  %-7s", sLevel );
+
+		for ( i = 0; i < PGE_getKernelCount(); i += 1 )
+		{
+			printf( " %s=%s", PGE_getKernelName( i ), PGE_getKernelVariant( i ) );
+		}
+
+		printf( "\n" );
+		fflush( stdout );
+
+		target = Sprite_new( TARGET_W, TARGET_H );
+
+		drawScene( target );
+
+		nRead = write( fd[ 1 ], target->pColData, NPIXELS * sizeof( Pixel ) );
+
+		_exit( nRead == NPIXELS * sizeof( Pixel ) ? 0 : 1 );
+	}
+
+	close( fd[ 1 ] );
+
+	nRead = 0;
+
+	while ( nRead < NPIXELS * sizeof( Pixel ) )
+	{
+		n = read( fd[ 0 ], ( uint8_t* ) pixels + nRead, NPIXELS * sizeof( Pixel ) - nRead );
+
+		if ( n <= 0 )
+		{
+			break;
+		}
+
+		nRead += n;
+	}
+
+	close( fd[ 0 ] );
+
+	waitpid( pid, &nStatus, 0 );
+
+	return nRead == NPIXELS * sizeof( Pixel ) && WIFEXITED( nStatus ) && WEXITSTATUS( nStatus ) == 0;
+}
+
+int main ( void )
+{
+	Pixel*  expected;
+	Pixel*  actual;
+	int32_t nLevels;
+	int32_t nBad;
+	int32_t i;
+
+	expected = ( Pixel* ) malloc( NPIXELS * sizeof( Pixel ) );
+	actual   = ( Pixel* ) malloc( NPIXELS * sizeof( Pixel ) );
+	nLevels  = sizeof( sLevels ) / sizeof( sLevels[ 0 ] );
+	nBad     = 0;
+
+	printf( "kernel variants:\n" );
+
+	if ( ! drawWithKernels( sLevels[ 0 ], expected ) )
+	{
+		return 1;
+	}
+
+	for ( i = 1; i < nLevels; i += 1 )
+	{
+		if ( ! drawWithKernels( sLevels[ i ], actual ) || memcmp( expected, actual, NPIXELS * sizeof( Pixel ) ) != 0 )
+		{
+			printf( "  %s differs from scalar\n", sLevels[ i ] );
+
+			nBad += 1;
+		}
+	}
+
+	free( expected );
+	free( actual );
+
+	printf( "kernel variants: %s\n", nBad ? "FAILED" : "ok" );
+
+	return nBad != 0;
+}
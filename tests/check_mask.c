@@ -0,0 +1,128 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>  // rand
+
+#include "../olcPGE_min.h"
+
+/* Checks SpriteMask_get and SpriteMask_overlap against the sprites'
+   alpha, pixel by pixel, for random sprites at random offsets. Widths
+   run past 64 so overlaps straddle the mask's words. Exits non-zero on
+   any difference.
+*/
+
+#define TRIALS     20000
+#define ALPHA_MIN  128
+
+
+bool UI_onUserCreate  ( void ) { return true; }
+bool UI_onUserDestroy ( void ) { return true; }
+bool UI_onUserUpdate  ( void ) { return false; }
+
+// Sparse or dense, with alphas either side of ALPHA_MIN
+static Sprite* makeSprite ( int32_t w, int32_t h, int32_t nPerMille )
+{
+	Sprite* sp;
+	int32_t i;
+
+	sp = Sprite_new( w, h );
+
+	for ( i = 0; i < w * h; i += 1 )
+	{
+		sp->pColData[ i ].a = rand() % 1000 < nPerMille ? ALPHA_MIN : ALPHA_MIN - 1;
+	}
+
+	return sp;
+}
+
+static bool isSolid ( const Sprite* sp, int32_t x, int32_t y )
+{
+	return x >= 0 && y >= 0 && x < sp->width && y < sp->height && sp->pColData[ y * sp->width + x ].a >= ALPHA_MIN;
+}
+
+static bool referenceOverlap ( const Sprite* a, int32_t ax, int32_t ay, const Sprite* b, int32_t bx, int32_t by )
+{
+	int32_t x;
+	int32_t y;
+
+	for ( y = 0; y < a->height; y += 1 )
+	{
+		for ( x = 0; x < a->width; x += 1 )
+		{
+			if ( isSolid( a, x, y ) && isSolid( b, x + ax - bx, y + ay - by ) )
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+int main ( void )
+{
+	Sprite*     a;
+	Sprite*     b;
+	SpriteMask* ma;
+	SpriteMask* mb;
+	int32_t     ax;
+	int32_t     ay;
+	int32_t     bx;
+	int32_t     by;
+	int32_t     x;
+	int32_t     y;
+	int32_t     t;
+	int32_t     nHits;
+	int32_t     nBad;
+
+	srand( 1 );
+
+	nHits = 0;
+	nBad  = 0;
+
+	for ( t = 0; t < TRIALS; t += 1 )
+	{
+		a = makeSprite( 1 + rand() % 150, 1 + rand() % 20, rand() % 2 ? 3 : 100 );
+		b = makeSprite( 1 + rand() % 150, 1 + rand() % 20, rand() % 2 ? 3 : 100 );
+
+		ma = SpriteMask_new( a, ALPHA_MIN );
+		mb = SpriteMask_new( b, ALPHA_MIN );
+
+		// One pixel of margin, where the mask must read as clear
+		for ( y = -1; y <= a->height; y += 1 )
+		{
+			for ( x = -1; x <= a->width; x += 1 )
+			{
+				if ( SpriteMask_get( ma, x, y ) != isSolid( a, x, y ) )
+				{
+					nBad += 1;
+				}
+			}
+		}
+
+		ax = rand() % 100 - 50;
+		ay = rand() % 30  - 15;
+		bx = rand() % 200 - 100;
+		by = rand() % 30  - 15;
+
+		if ( referenceOverlap( a, ax, ay, b, bx, by ) )
+		{
+			nHits += 1;
+
+			nBad += ! SpriteMask_overlap( ma, ax, ay, mb, bx, by );
+		}
+		else
+		{
+			nBad += SpriteMask_overlap( ma, ax, ay, mb, bx, by );
+		}
+
+		SpriteMask_free( ma );
+		SpriteMask_free( mb );
+		Sprite_free( a );
+		Sprite_free( b );
+	}
+
+	printf( "sprite masks: %d differences in %d trials, %d overlapping\n", nBad, TRIALS, nHits );
+
+	return nBad != 0;
+}
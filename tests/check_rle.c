@@ -0,0 +1,157 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>  // rand
+#include <string.h>
+
+#include "../olcPGE_min.h"
+
+/* Checks PGE_drawSpriteRLE against PGE_drawSprite, in every pixel
+   mode, at random positions partly off the target and under random
+   clips. The source is a view, so has a stride wider than itself, and
+   mixes transparent, opaque and part transparent pixels. Exits
+   non-zero on any difference.
+*/
+
+#define TRIALS   2000
+#define TARGET_W 100
+#define TARGET_H 80
+
+
+bool UI_onUserCreate  ( void ) { return true; }
+bool UI_onUserDestroy ( void ) { return true; }
+bool UI_onUserUpdate  ( void ) { return false; }
+
+static void fillBackground ( Sprite* sp )
+{
+	int32_t i;
+
+	for ( i = 0; i < sp->width * sp->height; i += 1 )
+	{
+		sp->pColData[ i ] = ( Pixel ) { i, i >> 2, i >> 5, ( i * 7 ) & 255 };
+	}
+}
+
+/* PGE_drawSprite in PIXEL_NORMAL copies transparent pixels as well,
+   which the RLE draw skips, so those are put back afterwards
+*/
+static void referenceDraw ( Sprite* target, int32_t x, int32_t y, Sprite* sp, const Sprite* background )
+{
+	int32_t sx;
+	int32_t sy;
+	int32_t i;
+	int32_t j;
+
+	PGE_drawSprite( x, y, sp );
+
+	if ( PGE_getPixelMode() != PIXEL_NORMAL )
+	{
+		return;
+	}
+
+	for ( j = 0; j < target->height; j += 1 )
+	{
+		for ( i = 0; i < target->width; i += 1 )
+		{
+			sx = i - x;
+			sy = j - y;
+
+			if ( sx >= 0 && sy >= 0 && sx < sp->width && sy < sp->height && sp->pColData[ sy * sp->nStride + sx ].a == 0 )
+			{
+				target->pColData[ j * target->width + i ] = background->pColData[ j * target->width + i ];
+			}
+		}
+	}
+}
+
+int main ( void )
+{
+	Sprite*    background;
+	Sprite*    expected;
+	Sprite*    actual;
+	Sprite*    sheet;
+	Sprite*    sp;
+	SpriteRLE* rle;
+	int32_t    cx;
+	int32_t    cy;
+	int32_t    cw;
+	int32_t    ch;
+	int32_t    x;
+	int32_t    y;
+	int32_t    k;
+	int32_t    i;
+	int32_t    t;
+	int32_t    nBad;
+
+	srand( 1 );
+
+	if ( PGE_construct( 64, 64, 1, 1, "check_rle" ) != OK )
+	{
+		return 1;
+	}
+
+	sheet = Sprite_new( 40, 30 );
+
+	for ( i = 0; i < 40 * 30; i += 1 )
+	{
+		k = rand() % 10;
+
+		sheet->pColData[ i ] = ( Pixel ) { rand(), rand(), rand(), k < 4 ? 0 : k < 8 ? 255 : rand() };
+	}
+
+	sp  = Sprite_newView( sheet, 3, 2, 30, 25 );
+	rle = SpriteRLE_new( sp );
+
+	background = Sprite_new( TARGET_W, TARGET_H );
+	expected   = Sprite_new( TARGET_W, TARGET_H );
+	actual     = Sprite_new( TARGET_W, TARGET_H );
+
+	fillBackground( background );
+
+	nBad = 0;
+
+	for ( t = 0; t < TRIALS; t += 1 )
+	{
+		x  = rand() % 140 - 50;
+		y  = rand() % 120 - 40;
+		cx = rand() % 120 - 10;
+		cy = rand() % 100 - 10;
+		cw = rand() % 100;
+		ch = rand() % 90;
+
+		PGE_setPixelMode( ( enum PixelMode ) ( t % 4 ) );
+
+		memcpy( expected->pColData, background->pColData, TARGET_W * TARGET_H * sizeof( Pixel ) );
+		memcpy( actual->pColData,   background->pColData, TARGET_W * TARGET_H * sizeof( Pixel ) );
+
+		PGE_setDrawTarget( expected );
+		PGE_pushClip( cx, cy, cw, ch );
+		referenceDraw( expected, x, y, sp, background );
+		PGE_popClip();
+
+		PGE_setDrawTarget( actual );
+		PGE_pushClip( cx, cy, cw, ch );
+		PGE_drawSpriteRLE( x, y, rle );
+		PGE_popClip();
+
+		if ( memcmp( expected->pColData, actual->pColData, TARGET_W * TARGET_H * sizeof( Pixel ) ) != 0 )
+		{
+			nBad += 1;
+		}
+	}
+
+	PGE_setDrawTarget( NULL );
+
+	SpriteRLE_free( rle );
+	Sprite_free( sp );
+	Sprite_free( sheet );
+	Sprite_free( background );
+	Sprite_free( expected );
+	Sprite_free( actual );
+
+	PGE_destroy();
+
+	printf( "rle sprites: %d of %d trials differ\n", nBad, TRIALS );
+
+	return nBad != 0;
+}
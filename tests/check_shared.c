@@ -0,0 +1,218 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../olcPGE_min.h"
+
+/* Checks the shared framebuffer from a forked reader process. The
+   engine fills each frame with a single colour. Before that,
+   UI_onUserCreate draws a gradient and holds it while the reader
+   watches. Every frame the reader's seqlock accepts must be one colour
+   throughout. Also checks that the mapping is gone
+   after PGE_destroy. Linux only. Exits non-zero on any failure.
+*/
+
+#define SCREEN_W 64
+#define SCREEN_H 48
+#define FRAMES   3000
+
+
+static int32_t nFrame;
+static int     readyPipe [ 2 ];  // the reader writes a byte once it is mapped
+
+bool UI_onUserDestroy ( void ) { return true; }
+
+// Not a finished frame, so readers must not take it, however long it stays up
+bool UI_onUserCreate ( void )
+{
+	char    c;
+	int32_t x;
+	int32_t y;
+
+	if ( read( readyPipe[ 0 ], &c, 1 ) != 1 )
+	{
+		return false;
+	}
+
+	for ( y = 0; y < SCREEN_H; y += 1 )
+	{
+		for ( x = 0; x < SCREEN_W; x += 1 )
+		{
+			PGE_drawRGB( x, y, x, y, 0 );
+		}
+	}
+
+	usleep( 50000 );
+
+	return true;
+}
+
+bool UI_onUserUpdate ( void )
+{
+	int32_t x;
+	int32_t y;
+
+	nFrame += 1;
+
+	for ( y = 0; y < SCREEN_H; y += 1 )
+	{
+		for ( x = 0; x < SCREEN_W; x += 1 )
+		{
+			PGE_drawRGB( x, y, nFrame, nFrame >> 8, 255 );
+		}
+	}
+
+	return nFrame < FRAMES;
+}
+
+static double now ( void )
+{
+	struct timespec t;
+
+	clock_gettime( CLOCK_MONOTONIC, &t );
+
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Takes frames until the engine is nearly done, returns the number that were torn
+static int32_t readFrames ( const char* sName )
+{
+	const SharedFrameHeader* h;
+	const uint32_t*          px;
+	uint32_t*                copy;
+	struct stat              st;
+	uint32_t                 s;
+	uint32_t                 i;
+	uint64_t                 nLast;
+	double                   tEnd;
+	int32_t                  nTorn;
+	int32_t                  nGood;
+	int                      fd;
+
+	fd = shm_open( sName, O_RDONLY, 0 );
+
+	if ( fd < 0 || fstat( fd, &st ) != 0 )
+	{
+		return 1;
+	}
+
+	h = ( const SharedFrameHeader* ) mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+
+	if ( h == MAP_FAILED || h->nMagic != PGE_SHARED_FRAME_MAGIC || h->nWidth != SCREEN_W || h->nHeight != SCREEN_H ||
+	     ( size_t ) st.st_size < h->nHeaderSize + SCREEN_W * SCREEN_H * 4 )
+	{
+		return 1;
+	}
+
+	if ( write( readyPipe[ 1 ], "r", 1 ) != 1 )
+	{
+		return 1;
+	}
+
+	px    = ( const uint32_t* ) ( ( const uint8_t* ) h + h->nHeaderSize );
+	copy  = ( uint32_t* ) malloc( SCREEN_W * SCREEN_H * 4 );
+	nLast = 0;
+	nTorn = 0;
+	nGood = 0;
+	tEnd  = now() + 30.0;
+
+	while ( nLast < FRAMES - 100 && now() < tEnd )
+	{
+		// The reader loop from olcPGE_min.h
+		s = __atomic_load_n( &h->nSeq, __ATOMIC_ACQUIRE );
+
+		memcpy( copy, px, SCREEN_W * SCREEN_H * 4 );
+
+		__atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+		if ( ( s & 1 ) || __atomic_load_n( &h->nSeq, __ATOMIC_RELAXED ) != s )
+		{
+			continue;
+		}
+
+		for ( i = 1; i < SCREEN_W * SCREEN_H; i += 1 )
+		{
+			if ( copy[ i ] != copy[ 0 ] )
+			{
+				nTorn += 1;
+
+				break;
+			}
+		}
+
+		nGood += 1;
+		nLast  = h->nFrame;
+	}
+
+	free( copy );
+
+	return nTorn + ( nGood == 0 );
+}
+
+int main ( void )
+{
+	char    sName [ 64 ];
+	pid_t   pid;
+	int     nStatus;
+	int32_t nBad;
+
+	snprintf( sName, sizeof( sName ), "/pge-check-shared-%d", ( int ) getpid() );
+
+	if ( PGE_construct( SCREEN_W, SCREEN_H, 1, 1, "check_shared" ) != OK )
+	{
+		return 1;
+	}
+
+	PGE_setHeadless( true );
+
+	if ( PGE_shareFramebuffer( sName ) != OK )
+	{
+		printf( "shared framebuffer: could not share\n" );
+
+		return 1;
+	}
+
+	if ( pipe( readyPipe ) != 0 )
+	{
+		return 1;
+	}
+
+	pid = fork();
+
+	if ( pid == 0 )
+	{
+		_exit( readFrames( sName ) ? 1 : 0 );
+	}
+
+	// So UI_onUserCreate sees end of file if the reader fails early
+	close( readyPipe[ 1 ] );
+
+	PGE_start();
+
+	waitpid( pid, &nStatus, 0 );
+
+	nBad = ! WIFEXITED( nStatus ) || WEXITSTATUS( nStatus ) != 0;
+
+	PGE_destroy();
+
+	// PGE_destroy unlinks the name
+	if ( shm_open( sName, O_RDONLY, 0 ) >= 0 )
+	{
+		shm_unlink( sName );
+
+		nBad += 1;
+	}
+
+	printf( "shared framebuffer: %s\n", nBad ? "FAILED" : "ok" );
+
+	return nBad != 0;
+}